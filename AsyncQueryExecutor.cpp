@@ -0,0 +1,306 @@
+#include "AsyncQueryExecutor.h"
+#include <boost/asio/post.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/strand.hpp>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+struct AsyncQueryExecutor::Operation {
+    const PreparedStatement* statement = nullptr;
+    std::vector<std::string> params;
+    int resultFormat = 0;
+    Callback done;  // empty once finished
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+
+    // The deadline timer and the socket wait can complete on different
+    // executor threads; the strand keeps them from running at once.
+    boost::asio::strand<boost::asio::io_context::executor_type> strand;
+    PooledConnection conn;
+    std::unique_ptr<boost::asio::posix::stream_descriptor> socket;
+    std::unique_ptr<boost::asio::steady_timer> queueTimeout;
+    std::unique_ptr<boost::asio::steady_timer> deadlineTimer;
+    std::unique_ptr<PGResultWrapper> result;
+    std::chrono::steady_clock::time_point sentAt{};
+
+    explicit Operation(boost::asio::io_context& io) : strand(boost::asio::make_strand(io)) {}
+
+    // The socket belongs to libpq; the descriptor object only watches it.
+    ~Operation() {
+        if (socket) socket->release();
+    }
+};
+
+namespace {
+
+std::exception_ptr queryError(PGconn* conn) {
+    return std::make_exception_ptr(std::runtime_error("Query failed: " + std::string(PQerrorMessage(conn))));
+}
+
+}
+
+AsyncQueryExecutor::AsyncQueryExecutor(std::shared_ptr<ConnectionPool> pool, AsyncQueryConfig config)
+    : pool_(std::move(pool)), work_(boost::asio::make_work_guard(io_)),
+      connectWork_(boost::asio::make_work_guard(connectIo_)) {
+    if (!pool_) {
+        throw std::runtime_error("Invalid connection pool provided to AsyncQueryExecutor.");
+    }
+    pool_->setReleaseListener([this] {
+        boost::asio::post(io_, [this] { startWaiting(); });
+    });
+    connector_ = std::thread([this] { connectIo_.run(); });
+    for (size_t i = 0; i < std::max<size_t>(config.threads, 1); i++) {
+        threads_.emplace_back([this] {
+            for (;;) {
+                try {
+                    io_.run();
+                    return;
+                } catch (const std::exception& e) {
+                    std::cerr << "[AsyncQuery] Handler threw: " << e.what() << std::endl;
+                }
+            }
+        });
+    }
+}
+
+AsyncQueryExecutor::~AsyncQueryExecutor() {
+    connectWork_.reset();
+    connectIo_.stop();
+    connector_.join();
+    work_.reset();
+    io_.stop();
+    for (auto& thread : threads_) thread.join();
+    pool_->setReleaseListener(nullptr);
+}
+
+void AsyncQueryExecutor::execPrepared(const PreparedStatement& statement, std::vector<std::string> params,
+                                      int resultFormat, Callback done) {
+    auto op = std::make_shared<Operation>(io_);
+    op->statement = &statement;
+    op->params = std::move(params);
+    op->resultFormat = resultFormat;
+    op->done = std::move(done);
+    op->deadline = Deadline::get();
+    boost::asio::post(op->strand, [this, op] { start(op); });
+}
+
+// Queries already waiting keep their place: a new one only goes straight
+// to the pool when nobody is ahead of it.
+void AsyncQueryExecutor::start(const std::shared_ptr<Operation>& op) {
+    std::exception_ptr error;
+    {
+        std::lock_guard<std::mutex> lock(waitingMutex_);
+        if (waiting_.empty()) {
+            try {
+                op->conn = pool_->tryCheckoutIdle();
+            } catch (...) {
+                error = std::current_exception();
+            }
+        }
+        if (!op->conn && !error) {
+            auto timeout = std::chrono::steady_clock::now() + pool_->config().checkoutTimeout;
+            bool deadlineFirst = op->deadline < timeout;
+            op->queueTimeout = std::make_unique<boost::asio::steady_timer>(op->strand, std::min(timeout, op->deadline));
+            op->queueTimeout->async_wait([this, op, deadlineFirst](const boost::system::error_code& ec) {
+                if (ec) return;  // cancelled: the query got a connection
+                {
+                    std::lock_guard<std::mutex> lock(waitingMutex_);
+                    auto it = std::find(waiting_.begin(), waiting_.end(), op);
+                    if (it == waiting_.end()) return;
+                    waiting_.erase(it);
+                }
+                if (deadlineFirst) finish(op, std::make_exception_ptr(DeadlineExceeded()));
+                else finish(op, std::make_exception_ptr(std::runtime_error("Timed out waiting for a database connection")));
+            });
+            waiting_.push_back(op);
+            requestConnections();
+            return;
+        }
+    }
+    if (error) finish(op, error);
+    else send(op);
+}
+
+void AsyncQueryExecutor::startWaiting() {
+    for (;;) {
+        std::shared_ptr<Operation> op;
+        std::exception_ptr error;
+        {
+            std::lock_guard<std::mutex> lock(waitingMutex_);
+            if (waiting_.empty()) return;
+            PooledConnection conn;
+            try {
+                conn = pool_->tryCheckoutIdle();
+                if (!conn) {
+                    requestConnections();
+                    return;
+                }
+            } catch (...) {
+                error = std::current_exception();
+            }
+            op = waiting_.front();
+            waiting_.pop_front();
+            op->queueTimeout->cancel();
+            op->conn = std::move(conn);
+        }
+        boost::asio::post(op->strand, [this, op, error] {
+            if (error) finish(op, error);
+            else send(op);
+        });
+    }
+}
+
+// Caller holds waitingMutex_. One connect per waiting query, as far as the
+// pool has room; each new connection lands in the pool's idle set and is
+// picked up by startWaiting().
+void AsyncQueryExecutor::requestConnections() {
+    while (opening_ < waiting_.size() && pool_->size() + opening_ < pool_->config().maxSize) {
+        opening_++;
+        boost::asio::post(connectIo_, [this] {
+            bool opened = pool_->addConnection();
+            {
+                std::lock_guard<std::mutex> lock(waitingMutex_);
+                opening_--;
+            }
+            if (opened) {
+                boost::asio::post(io_, [this] { startWaiting(); });
+            } else {
+                failWaiting(std::make_exception_ptr(std::runtime_error("Database connection failed")));
+            }
+        });
+    }
+}
+
+// A connect made for the waiting queries failed; the oldest one gets the
+// error, as it would have had it connected inline.
+void AsyncQueryExecutor::failWaiting(std::exception_ptr error) {
+    std::shared_ptr<Operation> op;
+    {
+        std::lock_guard<std::mutex> lock(waitingMutex_);
+        if (waiting_.empty()) return;
+        op = waiting_.front();
+        waiting_.pop_front();
+        op->queueTimeout->cancel();
+    }
+    boost::asio::post(op->strand, [this, op, error] { finish(op, error); });
+}
+
+void AsyncQueryExecutor::send(const std::shared_ptr<Operation>& op) {
+    PGconn* pg = op->conn.get();
+    std::vector<const char*> values;
+    values.reserve(op->params.size());
+    for (const auto& param : op->params) values.push_back(param.c_str());
+
+    if (PQsetnonblocking(pg, 1) != 0 ||
+        !PQsendQueryPrepared(pg, op->statement->name, op->statement->nParams, values.data(), nullptr, nullptr,
+                             op->resultFormat)) {
+        finish(op, queryError(pg));
+        return;
+    }
+    op->sentAt = std::chrono::steady_clock::now();
+    try {
+        op->socket = std::make_unique<boost::asio::posix::stream_descriptor>(op->strand, PQsocket(pg));
+    } catch (...) {
+        finish(op, std::current_exception());
+        return;
+    }
+    if (op->deadline != std::chrono::steady_clock::time_point::max()) {
+        op->deadlineTimer = std::make_unique<boost::asio::steady_timer>(op->strand, op->deadline);
+        op->deadlineTimer->async_wait([this, op](const boost::system::error_code& ec) {
+            if (ec || !op->done) return;
+            cancel(op);
+        });
+    }
+    flush(op);
+}
+
+// Deadline passed with the query in flight. The connection is still busy,
+// so the pool holds it back from reuse until the cancel has wound it down.
+void AsyncQueryExecutor::cancel(const std::shared_ptr<Operation>& op) {
+    if (PGcancel* cancel = PQgetCancel(op->conn.get())) {
+        char error[256];
+        PQcancel(cancel, error, sizeof(error));
+        PQfreeCancel(cancel);
+    }
+    finish(op, std::make_exception_ptr(DeadlineExceeded()));
+}
+
+void AsyncQueryExecutor::flush(const std::shared_ptr<Operation>& op) {
+    int pending = PQflush(op->conn.get());
+    if (pending < 0) {
+        finish(op, queryError(op->conn.get()));
+        return;
+    }
+    if (pending == 0) {
+        awaitResult(op);
+        return;
+    }
+    op->socket->async_wait(boost::asio::posix::stream_descriptor::wait_write,
+                           [this, op](const boost::system::error_code& ec) {
+                               if (ec) finish(op, std::make_exception_ptr(boost::system::system_error(ec)));
+                               else flush(op);
+                           });
+}
+
+// A single statement yields one result followed by NULL; anything after the
+// first result is drained and dropped.
+void AsyncQueryExecutor::awaitResult(const std::shared_ptr<Operation>& op) {
+    op->socket->async_wait(boost::asio::posix::stream_descriptor::wait_read,
+                           [this, op](const boost::system::error_code& ec) {
+        if (ec) {
+            finish(op, std::make_exception_ptr(boost::system::system_error(ec)));
+            return;
+        }
+        PGconn* pg = op->conn.get();
+        if (!PQconsumeInput(pg)) {
+            finish(op, queryError(pg));
+            return;
+        }
+        while (!PQisBusy(pg)) {
+            PGresult* res = PQgetResult(pg);
+            if (!res) {
+                finish(op, nullptr);
+                return;
+            }
+            if (op->result) PQclear(res);
+            else op->result = std::make_unique<PGResultWrapper>(res);
+        }
+        awaitResult(op);
+    });
+}
+
+// The connection goes back to the pool before the callback runs, so a
+// queued query can start on it while this one's response is being built.
+void AsyncQueryExecutor::finish(const std::shared_ptr<Operation>& op, std::exception_ptr error) {
+    if (!op->done) return;  // already finished; a wait aborted by that is completing
+    if (op->deadlineTimer) op->deadlineTimer->cancel();
+    if (op->socket) {
+        op->socket->release();
+        op->socket.reset();
+    }
+    if (PGconn* pg = op->conn.get()) {
+        if (!error && !op->result) error = queryError(pg);
+        PQsetnonblocking(pg, 0);
+    }
+    if (!error) {
+        ExecStatusType status = PQresultStatus(op->result->get());
+        if (status != PGRES_TUPLES_OK && status != PGRES_COMMAND_OK) {
+            error = std::make_exception_ptr(
+                std::runtime_error("Query failed: " + std::string(PQresultErrorMessage(op->result->get()))));
+        }
+    }
+    op->conn.release();
+    if (op->sentAt != std::chrono::steady_clock::time_point{}) {
+        if (const Metrics::Histogram* latency = pool_->statementLatency(*op->statement)) latency->recordSince(op->sentAt);
+    }
+
+    Callback done = std::move(op->done);
+    op->done = nullptr;
+    try {
+        if (error) done(nullptr, error);
+        else done(std::move(op->result), nullptr);
+    } catch (const std::exception& e) {
+        std::cerr << "[AsyncQuery] Callback threw: " << e.what() << std::endl;
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef ASYNC_QUERY_EXECUTOR_H
+#define ASYNC_QUERY_EXECUTOR_H
+
+#include "ConnectionPool.h"
+#include "LocationService.h"
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct AsyncQueryConfig {
+    // Event loop threads. Each one multiplexes any number of in-flight
+    // queries, so a couple is plenty.
+    size_t threads = 2;
+};
+
+// Runs prepared statements without blocking the calling thread. Queries are
+// sent with libpq's non-blocking API and the connection's socket is watched
+// by a Boost.Asio io_context; the callback fires on one of the executor's
+// threads once the result has arrived. When every pooled connection is busy
+// the query queues here (bounded by the pool's checkoutTimeout) instead of
+// parking a thread on the pool, and a connector thread opens more up to the
+// pool's maxSize; connecting never blocks an event loop thread. A Deadline open on the calling thread goes
+// with the query: when it passes first the query is cancelled and `done`
+// gets DeadlineExceeded. Each query's handlers run on a strand of its own.
+class AsyncQueryExecutor {
+public:
+    // Exactly one of result / error is set.
+    using Callback = std::function<void(std::unique_ptr<PGResultWrapper> result, std::exception_ptr error)>;
+
+private:
+    struct Operation;
+
+    std::shared_ptr<ConnectionPool> pool_;
+    boost::asio::io_context io_;
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work_;
+    std::vector<std::thread> threads_;
+
+    std::mutex waitingMutex_;
+    std::deque<std::shared_ptr<Operation>> waiting_;  // queries with no connection yet
+    size_t opening_ = 0;                               // connects requested for them; under waitingMutex_
+
+    // New connections are dialed here, never on the event loop threads.
+    boost::asio::io_context connectIo_;
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> connectWork_;
+    std::thread connector_;
+
+    void start(const std::shared_ptr<Operation>& op);
+    void send(const std::shared_ptr<Operation>& op);
+    void flush(const std::shared_ptr<Operation>& op);
+    void awaitResult(const std::shared_ptr<Operation>& op);
+    void cancel(const std::shared_ptr<Operation>& op);
+    void finish(const std::shared_ptr<Operation>& op, std::exception_ptr error);
+    void startWaiting();
+    void requestConnections();
+    void failWaiting(std::exception_ptr error);
+
+public:
+    AsyncQueryExecutor(std::shared_ptr<ConnectionPool> pool, AsyncQueryConfig config = {});
+    ~AsyncQueryExecutor();
+    AsyncQueryExecutor(const AsyncQueryExecutor&) = delete;
+    AsyncQueryExecutor& operator=(const AsyncQueryExecutor&) = delete;
+
+    // Returns immediately. A non-TUPLES_OK/COMMAND_OK result is reported as
+    // an error with the server's message.
+    void execPrepared(const PreparedStatement& statement, std::vector<std::string> params,
+                      int resultFormat, Callback done);
+};
+
+#endif
@@ -0,0 +1,84 @@
+#include "Compression.h"
+#include <cctype>
+#include <cstdlib>
+#include <stdexcept>
+#include <zlib.h>
+
+namespace {
+
+constexpr int GzipWindowBits = 15 + 16;  // 32K window, gzip wrapper instead of zlib's
+constexpr int MemLevel = 8;
+
+std::string_view trim(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+    return s;
+}
+
+bool equalsFolded(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (std::tolower(static_cast<unsigned char>(a[i])) != std::tolower(static_cast<unsigned char>(b[i]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// q of one "coding;q=0.5" entry; 1 when absent.
+double qualityOf(std::string_view params) {
+    for (size_t start = 0; start < params.size();) {
+        size_t end = params.find(';', start);
+        if (end == std::string_view::npos) end = params.size();
+        std::string_view param = trim(params.substr(start, end - start));
+        if (param.size() > 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=') {
+            return std::strtod(std::string(param.substr(2)).c_str(), nullptr);
+        }
+        start = end + 1;
+    }
+    return 1.0;
+}
+
+}
+
+namespace Compression {
+
+std::string gzip(std::string_view data, int level) {
+    z_stream stream{};
+    if (deflateInit2(&stream, level, Z_DEFLATED, GzipWindowBits, MemLevel, Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw std::runtime_error("deflateInit2 failed");
+    }
+    std::string out(deflateBound(&stream, static_cast<uLong>(data.size())), '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in = static_cast<uInt>(data.size());
+    stream.next_out = reinterpret_cast<Bytef*>(out.data());
+    stream.avail_out = static_cast<uInt>(out.size());
+    int status = deflate(&stream, Z_FINISH);  // deflateBound guarantees one call is enough
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    if (status != Z_STREAM_END) throw std::runtime_error("deflate failed");
+    return out;
+}
+
+bool acceptsGzip(std::string_view acceptEncoding) {
+    double gzipQuality = -1, anyQuality = -1;
+    for (size_t start = 0; start < acceptEncoding.size();) {
+        size_t end = acceptEncoding.find(',', start);
+        if (end == std::string_view::npos) end = acceptEncoding.size();
+        std::string_view entry = acceptEncoding.substr(start, end - start);
+        size_t semicolon = entry.find(';');
+        std::string_view coding = trim(entry.substr(0, semicolon));
+        double q = semicolon == std::string_view::npos ? 1.0 : qualityOf(entry.substr(semicolon + 1));
+        if (equalsFolded(coding, "gzip") || equalsFolded(coding, "x-gzip")) gzipQuality = q;
+        else if (coding == "*") anyQuality = q;
+        start = end + 1;
+    }
+    return gzipQuality >= 0 ? gzipQuality > 0 : anyQuality > 0;
+}
+
+std::string encodeIfWorthIt(std::string_view text, const CompressionConfig& config) {
+    if (!config.enabled || text.size() < config.minBytes) return {};
+    return gzip(text, config.level);
+}
+
+}
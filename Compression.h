@@ -0,0 +1,30 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+struct CompressionConfig {
+    bool enabled = true;
+    // Bodies shorter than this go out as they are: below about a packet,
+    // gzip saves no round-trips and costs a header plus CPU.
+    size_t minBytes = 1024;
+    int level = 6;  // zlib's 1 (fastest) .. 9 (smallest)
+};
+
+// gzip Content-Encoding for response bodies, via zlib.
+namespace Compression {
+    // A complete gzip member holding `data`. Throws if zlib fails.
+    std::string gzip(std::string_view data, int level);
+
+    // Whether an Accept-Encoding header value admits gzip: listed (or
+    // x-gzip, or *) with a non-zero q. An explicit gzip entry overrides *.
+    bool acceptsGzip(std::string_view acceptEncoding);
+
+    // gzip(text) if compression is enabled and text is long enough,
+    // otherwise empty.
+    std::string encodeIfWorthIt(std::string_view text, const CompressionConfig& config);
+}
+
+#endif
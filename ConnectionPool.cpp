@@ -0,0 +1,494 @@
+#include "ConnectionPool.h"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <poll.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// How long a cancelled query gets to wind down before its connection is
+// given up on.
+constexpr std::chrono::milliseconds CancelGrace{100};
+// How long a released connection with a query still running may take to
+// finish it before it is closed instead.
+constexpr std::chrono::seconds DrainTimeout{5};
+
+const Metrics::Counter deadlineCancels{"db_deadline_cancels_total",
+                                       "Queries cancelled because their request deadline passed"};
+const char* const HedgeHelp = "Reads sent a second time after running long, by which attempt answered first";
+const Metrics::Counter hedgesLost{"db_hedged_queries_total", HedgeHelp, "winner=\"first\""};
+const Metrics::Counter hedgesWon{"db_hedged_queries_total", HedgeHelp, "winner=\"hedge\""};
+
+constexpr int TimedOut = -1;
+constexpr int PollFailed = -2;  // errno says why
+
+// Index of the first of `conns` whose result can be read without blocking,
+// TimedOut once `until` passes, or PollFailed if the sockets cannot be
+// waited on. A connection whose socket failed counts as ready, so
+// PQgetResult reports the error.
+int waitReady(PGconn* const* conns, int count, Clock::time_point until) {
+    for (;;) {
+        for (int i = 0; i < count; i++) {
+            if (!PQconsumeInput(conns[i]) || !PQisBusy(conns[i])) return i;
+        }
+        int timeoutMs = -1;
+        if (until != Clock::time_point::max()) {
+            auto left = std::chrono::ceil<std::chrono::milliseconds>(until - Clock::now()).count();
+            if (left <= 0) return TimedOut;
+            timeoutMs = static_cast<int>(std::min<long long>(left, INT_MAX));
+        }
+        pollfd fds[2];
+        for (int i = 0; i < count; i++) fds[i] = {PQsocket(conns[i]), POLLIN, 0};
+        if (poll(fds, count, timeoutMs) < 0 && errno != EINTR) return PollFailed;
+    }
+}
+
+// The last result of the query in flight, as PQexec would return it.
+PGresult* lastResult(PGconn* conn) {
+    PGresult* last = nullptr;
+    while (PGresult* next = PQgetResult(conn)) {
+        if (last) PQclear(last);
+        last = next;
+    }
+    return last;
+}
+
+// Asks the server to stop the query in flight on `conn`, without waiting.
+void sendCancel(PGconn* conn) {
+    if (PGcancel* cancel = PQgetCancel(conn)) {
+        char error[256];
+        PQcancel(cancel, error, sizeof(error));
+        PQfreeCancel(cancel);
+    }
+}
+
+// Drains whatever results have arrived; true once the connection is idle.
+bool drained(PGconn* conn) {
+    if (!PQconsumeInput(conn)) return false;
+    while (!PQisBusy(conn)) {
+        PGresult* res = PQgetResult(conn);
+        if (!res) return PQtransactionStatus(conn) == PQTRANS_IDLE;
+        PQclear(res);
+    }
+    return false;
+}
+
+// Cancels the query, then gives it CancelGrace to finish so the connection
+// is idle again. If it does not, the connection is left busy and the pool
+// winds it down after release.
+void cancelQuery(PGconn* conn) {
+    sendCancel(conn);
+    PGconn* conns[1] = {conn};
+    if (waitReady(conns, 1, Clock::now() + CancelGrace) == 0) PQclear(lastResult(conn));
+}
+
+}
+
+PooledConnection& PooledConnection::operator=(PooledConnection&& other) noexcept {
+    if (this != &other) {
+        release();
+        pool_ = other.pool_;
+        conn_ = other.conn_;
+        broken_ = other.broken_;
+        other.pool_ = nullptr;
+        other.conn_ = nullptr;
+        other.broken_ = false;
+    }
+    return *this;
+}
+
+PGresult* PooledConnection::execPrepared(const PreparedStatement& statement, const char* const* paramValues,
+                                         int resultFormat) const {
+    auto start = std::chrono::steady_clock::now();
+    PGresult* res = nullptr;
+    if (!Deadline::active()) {
+        res = PQexecPrepared(conn_, statement.name, statement.nParams, paramValues, nullptr, nullptr, resultFormat);
+    } else if (PQsendQueryPrepared(conn_, statement.name, statement.nParams, paramValues, nullptr, nullptr,
+                                   resultFormat)) {
+        awaitResult();
+        res = lastResult(conn_);
+    }
+    if (const Metrics::Histogram* latency = pool_->statementLatency(statement)) latency->recordSince(start);
+    return res;
+}
+
+PGresult* PooledConnection::execParams(const char* sql, int nParams, const char* const* paramValues,
+                                       int resultFormat) const {
+    if (!Deadline::active()) {
+        return PQexecParams(conn_, sql, nParams, nullptr, paramValues, nullptr, nullptr, resultFormat);
+    }
+    if (!PQsendQueryParams(conn_, sql, nParams, nullptr, paramValues, nullptr, nullptr, resultFormat)) return nullptr;
+    awaitResult();
+    return lastResult(conn_);
+}
+
+PGresult* PooledConnection::execPreparedHedged(const PreparedStatement& statement, const char* const* paramValues,
+                                               int resultFormat, std::chrono::nanoseconds hedgeAfter,
+                                               HedgeOutcome* outcome) const {
+    auto start = Clock::now();
+    auto send = [&](PGconn* conn) {
+        return PQsendQueryPrepared(conn, statement.name, statement.nParams, paramValues, nullptr, nullptr,
+                                   resultFormat) != 0;
+    };
+    if (!send(conn_)) return nullptr;
+
+    Clock::time_point deadline = Deadline::get();
+    PGconn* conns[2] = {conn_, nullptr};
+    PooledConnection hedge;
+    int ready = waitReady(conns, 1, std::min(deadline, start + hedgeAfter));
+    if (ready == TimedOut && Clock::now() < deadline) {
+        try {
+            hedge = pool_->tryCheckoutIdle();
+        } catch (const DatabaseUnavailable&) {
+        }
+        if (hedge && send(hedge.conn_)) conns[1] = hedge.conn_;
+        ready = waitReady(conns, conns[1] ? 2 : 1, deadline);
+    }
+    if (ready == PollFailed) {
+        int error = errno;
+        if (conns[1]) {
+            sendCancel(conns[1]);
+            hedge.broken_ = true;
+        }
+        lost("poll", error);
+    }
+    if (ready == TimedOut) {
+        for (PGconn* conn : conns) if (conn) cancelQuery(conn);
+        deadlineCancels.inc();
+        throw DeadlineExceeded();
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start);
+    if (outcome) *outcome = {conns[1] != nullptr, elapsed};
+    // The loser is cancelled rather than waited on; the pool winds its
+    // connection down once it is released.
+    if (conns[1]) {
+        (ready == 0 ? hedgesLost : hedgesWon).inc();
+        sendCancel(conns[1 - ready]);
+    }
+    PGresult* res = lastResult(conns[ready]);
+    if (const Metrics::Histogram* latency = pool_->statementLatency(statement)) latency->record(elapsed);
+    return res;
+}
+
+void PooledConnection::awaitResult() const {
+    if (!Deadline::active()) return;
+    PGconn* conns[1] = {conn_};
+    int ready = waitReady(conns, 1, Deadline::get());
+    if (ready == 0) return;
+    if (ready == PollFailed) lost("poll", errno);
+    cancelQuery(conn_);
+    deadlineCancels.inc();
+    throw DeadlineExceeded();
+}
+
+void PooledConnection::lost(const char* what, int error) const {
+    sendCancel(conn_);
+    broken_ = true;
+    throw std::runtime_error(std::string("Connection lost: ") + what + ": " + std::strerror(error));
+}
+
+void PooledConnection::release() {
+    if (pool_ && conn_) pool_->giveBack(conn_, broken_);
+    pool_ = nullptr;
+    conn_ = nullptr;
+    broken_ = false;
+}
+
+ConnectionPool::ConnectionPool(ConnectionPoolConfig config) : config_(std::move(config)) {
+    if (config_.maxSize == 0) {
+        throw std::runtime_error("Connection pool maxSize must be at least 1.");
+    }
+    if (config_.minSize > config_.maxSize) config_.minSize = config_.maxSize;
+    idle_.reserve(config_.maxSize);
+    for (const auto& statement : config_.statements) {
+        statementLatency_.emplace(statement.name,
+                                  Metrics::Histogram("db_statement_duration_seconds", "Prepared statement round-trip time",
+                                                     std::string("statement=\"") + statement.name + '"'));
+    }
+}
+
+const Metrics::Histogram* ConnectionPool::statementLatency(const PreparedStatement& statement) const {
+    auto it = statementLatency_.find(statement.name);
+    return it == statementLatency_.end() ? nullptr : &it->second;
+}
+
+ConnectionPool::~ConnectionPool() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& c : idle_) PQfinish(c.conn);
+    for (auto& c : draining_) PQfinish(c.conn);
+    idle_.clear();
+    draining_.clear();
+}
+
+PGconn* ConnectionPool::connect() const {
+    std::string timeout = std::to_string(config_.connectTimeoutSeconds);
+    const char* keywords[] = {"dbname", "connect_timeout", nullptr};
+    const char* values[] = {config_.conninfo.c_str(), timeout.c_str(), nullptr};
+    PGconn* conn = PQconnectdbParams(keywords, values, 1);
+    if (PQstatus(conn) != CONNECTION_OK) {
+        std::string error = PQerrorMessage(conn);
+        PQfinish(conn);
+        throw std::runtime_error("Database connection failed: " + error);
+    }
+    try {
+        setStatementTimeout(conn);
+        prepareStatements(conn);
+    } catch (...) {
+        PQfinish(conn);
+        throw;
+    }
+    return conn;
+}
+
+void ConnectionPool::setStatementTimeout(PGconn* conn) const {
+    if (config_.statementTimeout.count() <= 0) return;
+    std::string sql = "SET statement_timeout = " + std::to_string(config_.statementTimeout.count()) + ";";
+    PGresult* res = PQexec(conn, sql.c_str());
+    bool ok = PQresultStatus(res) == PGRES_COMMAND_OK;
+    PQclear(res);
+    if (!ok) throw std::runtime_error("Failed to set statement_timeout: " + std::string(PQerrorMessage(conn)));
+}
+
+// Prepared statements are per-session, so every new or reopened connection
+// gets the full set before it is handed out.
+void ConnectionPool::prepareStatements(PGconn* conn) const {
+    for (const auto& statement : config_.statements) {
+        PGresult* res = PQprepare(conn, statement.name, statement.sql, statement.nParams, nullptr);
+        bool ok = PQresultStatus(res) == PGRES_COMMAND_OK;
+        PQclear(res);
+        if (!ok) {
+            throw std::runtime_error("Failed to prepare statement '" + std::string(statement.name) +
+                                     "': " + PQerrorMessage(conn));
+        }
+    }
+}
+
+PGconn* ConnectionPool::connectTracked() {
+    try {
+        PGconn* conn = connect();
+        recordSuccess();
+        return conn;
+    } catch (...) {
+        recordFailure();
+        throw;
+    }
+}
+
+void ConnectionPool::recordFailure() {
+    if (consecutiveFailures_.fetch_add(1, std::memory_order_acq_rel) + 1 >= config_.breakerThreshold) {
+        breakerOpen_.store(true, std::memory_order_release);
+        available_.notify_all();  // waiters re-check and fail fast
+    }
+}
+
+void ConnectionPool::recordSuccess() {
+    consecutiveFailures_.store(0, std::memory_order_release);
+    breakerOpen_.store(false, std::memory_order_release);
+}
+
+// Cheap status check for recently used connections; a round-trip ping for
+// ones that sat idle long enough for the server or a proxy to drop them.
+bool ConnectionPool::isHealthy(PGconn* conn, std::chrono::steady_clock::time_point lastUsed) const {
+    if (PQstatus(conn) != CONNECTION_OK) return false;
+    if (std::chrono::steady_clock::now() - lastUsed < config_.healthCheckAfter) return true;
+    PGresult* res = PQexec(conn, "SELECT 1;");
+    bool ok = PQresultStatus(res) == PGRES_TUPLES_OK;
+    PQclear(res);
+    return ok;
+}
+
+PooledConnection ConnectionPool::checkout() {
+    auto start = std::chrono::steady_clock::now();
+    PooledConnection conn = acquire(true);
+    checkoutWait_.recordSince(start);
+    return conn;
+}
+
+PooledConnection ConnectionPool::tryCheckout() {
+    return acquire(false);
+}
+
+PooledConnection ConnectionPool::tryCheckoutIdle() {
+    return acquire(false, false);
+}
+
+// A request deadline earlier than checkoutTimeout cuts the wait short.
+PooledConnection ConnectionPool::acquire(bool wait, bool open) {
+    auto timeout = std::chrono::steady_clock::now() + config_.checkoutTimeout;
+    auto deadline = std::min(timeout, Deadline::get());
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        if (!idle_.empty()) {
+            PGconn* candidate = idle_.back().conn;
+            idle_.pop_back();
+            if (PQstatus(candidate) == CONNECTION_OK) {
+                return PooledConnection(this, candidate);
+            }
+            lock.unlock();
+            discard(candidate);
+            lock.lock();
+            continue;
+        }
+
+        // Idle connections are still handed out while the breaker is open;
+        // only dialing, and waiting for one to free up, are not.
+        if (!available()) throw DatabaseUnavailable();
+
+        if (open && total_ < config_.maxSize) {
+            total_++;
+            lock.unlock();
+            try {
+                return PooledConnection(this, connectTracked());
+            } catch (...) {
+                lock.lock();
+                total_--;
+                available_.notify_one();
+                throw;
+            }
+        }
+
+        if (!wait) return PooledConnection();
+        if (available_.wait_until(lock, deadline) == std::cv_status::timeout && idle_.empty() &&
+            total_ >= config_.maxSize) {
+            lock.unlock();
+            checkoutTimeouts_.inc();  // may take the metrics registry lock
+            if (deadline < timeout) throw DeadlineExceeded();
+            throw std::runtime_error("Timed out waiting for a database connection");
+        }
+    }
+}
+
+// A full pool has no slot for the connection, but the caller may be
+// probing an open breaker, so it is still dialed and then closed.
+bool ConnectionPool::addConnection() {
+    bool full;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        full = total_ >= config_.maxSize;
+        if (!full) total_++;
+    }
+    if (full) {
+        try {
+            PQfinish(connectTracked());
+            return true;
+        } catch (...) {
+            return false;
+        }
+    }
+    PGconn* conn = nullptr;
+    try {
+        conn = connectTracked();
+    } catch (...) {
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!conn) {
+        total_--;
+        return false;
+    }
+    idle_.push_back({conn, std::chrono::steady_clock::now()});
+    available_.notify_one();
+    return true;
+}
+
+void ConnectionPool::pingIdle() {
+    auto cutoff = std::chrono::steady_clock::now() - config_.healthCheckAfter;
+    std::vector<IdleConnection> stale;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto fresh = std::partition(idle_.begin(), idle_.end(),
+                                    [&](const IdleConnection& c) { return c.lastUsed >= cutoff; });
+        stale.assign(fresh, idle_.end());
+        idle_.erase(fresh, idle_.end());
+    }
+    for (const auto& c : stale) {
+        if (isHealthy(c.conn, c.lastUsed)) {
+            giveBack(c.conn);
+        } else {
+            recordFailure();
+            discard(c.conn);
+        }
+    }
+}
+
+void ConnectionPool::reapDraining() {
+    auto cutoff = std::chrono::steady_clock::now() - DrainTimeout;
+    std::vector<IdleConnection> draining;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        draining.swap(draining_);
+    }
+    std::vector<IdleConnection> pending;
+    for (const auto& c : draining) {
+        if (drained(c.conn)) {
+            giveBack(c.conn);
+        } else if (PQstatus(c.conn) != CONNECTION_OK || c.lastUsed < cutoff) {
+            discard(c.conn);
+        } else {
+            pending.push_back(c);
+        }
+    }
+    if (pending.empty()) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    draining_.insert(draining_.end(), pending.begin(), pending.end());
+}
+
+void ConnectionPool::discard(PGconn* conn) {
+    PQfinish(conn);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        total_--;
+        available_.notify_one();
+    }
+    if (onRelease_) onRelease_();
+}
+
+// A connection that was lost, left mid-transaction or left in pipeline mode
+// is not safe to hand to another request, so it is closed and the slot is
+// reopened later. A lost connection also counts toward the breaker. One
+// with a (cancelled) query still running is parked until it winds down.
+void ConnectionPool::giveBack(PGconn* conn, bool broken) {
+    if (PQstatus(conn) != CONNECTION_OK) recordFailure();
+    if (broken) {
+        discard(conn);
+        return;
+    }
+    if (PQstatus(conn) == CONNECTION_OK && PQtransactionStatus(conn) == PQTRANS_ACTIVE) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        draining_.push_back({conn, std::chrono::steady_clock::now()});
+        return;
+    }
+    bool reusable = PQstatus(conn) == CONNECTION_OK && PQtransactionStatus(conn) == PQTRANS_IDLE;
+#ifdef LIBPQ_HAS_PIPELINING
+    reusable = reusable && PQpipelineStatus(conn) == PQ_PIPELINE_OFF;
+#endif
+    if (!reusable) {
+        discard(conn);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        idle_.push_back({conn, std::chrono::steady_clock::now()});
+        available_.notify_one();
+    }
+    if (onRelease_) onRelease_();
+}
+
+size_t ConnectionPool::size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return total_;
+}
+
+size_t ConnectionPool::idleCount() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return idle_.size();
+}
+
+size_t ConnectionPool::busyCount() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return total_ - idle_.size();
+}
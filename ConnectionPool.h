@@ -0,0 +1,205 @@
+#ifndef CONNECTION_POOL_H
+#define CONNECTION_POOL_H
+
+#include "Deadline.h"
+#include "Metrics.h"
+#include <postgresql/libpq-fe.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// A fixed statement the pool prepares on every connection it opens, so
+// callers can run it with PQexecPrepared instead of resending the SQL.
+struct PreparedStatement {
+    const char* name;
+    const char* sql;
+    int nParams;
+};
+
+// Sizing and timing knobs for a ConnectionPool.
+struct ConnectionPoolConfig {
+    std::string conninfo;
+    std::vector<PreparedStatement> statements;
+    size_t minSize = 2;
+    size_t maxSize = 8;
+    // How long a checkout waits for a connection once maxSize are in use.
+    std::chrono::milliseconds checkoutTimeout{2000};
+    // Idle connections older than this are pinged by pingIdle().
+    std::chrono::milliseconds healthCheckAfter{30000};
+    // Passed to libpq as connect_timeout, so a dead host cannot hold a
+    // connect attempt for the OS TCP timeout.
+    int connectTimeoutSeconds = 5;
+    // Consecutive connection failures that open the circuit breaker.
+    int breakerThreshold = 3;
+    // statement_timeout set on every connection, as a server-side backstop
+    // for queries nothing on this side is waiting on any more. 0 keeps the
+    // server's setting.
+    std::chrono::milliseconds statementTimeout{0};
+};
+
+// Thrown by checkout() while the circuit breaker is open and no idle
+// connection is left. Callers map it to 503 instead of waiting on a
+// database that is known to be down.
+class DatabaseUnavailable : public std::runtime_error {
+public:
+    DatabaseUnavailable() : std::runtime_error("Database unavailable") {}
+};
+
+class ConnectionPool;
+
+// How an execPreparedHedged call went. firstElapsed is the first attempt's
+// latency when it answered (or no hedge was sent), and how long it had run
+// when the hedge beat it otherwise: a lower bound, never the hedge's time.
+struct HedgeOutcome {
+    bool hedged = false;
+    std::chrono::nanoseconds firstElapsed{0};
+};
+
+// RAII lease on a pooled connection. The connection belongs to the holding
+// thread until the lease is destroyed, at which point it goes back to the pool
+// (or is closed, if it was left in a bad state).
+class PooledConnection {
+private:
+    ConnectionPool* pool_ = nullptr;
+    PGconn* conn_ = nullptr;
+    mutable bool broken_ = false;  // closed on release whatever its status says
+    PooledConnection(ConnectionPool* pool, PGconn* conn) : pool_(pool), conn_(conn) {}
+    // Cancels the query in flight and marks the connection broken, then
+    // throws: its socket can no longer be waited on.
+    [[noreturn]] void lost(const char* what, int error) const;
+    friend class ConnectionPool;
+
+public:
+    PooledConnection() = default;
+    ~PooledConnection() { release(); }
+    PooledConnection(PooledConnection&& other) noexcept
+        : pool_(other.pool_), conn_(other.conn_), broken_(other.broken_) {
+        other.pool_ = nullptr;
+        other.conn_ = nullptr;
+        other.broken_ = false;
+    }
+    PooledConnection& operator=(PooledConnection&& other) noexcept;
+    PooledConnection(const PooledConnection&) = delete;
+    PooledConnection& operator=(const PooledConnection&) = delete;
+
+    PGconn* get() const { return conn_; }
+    explicit operator bool() const { return conn_ != nullptr; }
+    void release();
+
+    // Runs a statement from the pool's prepared set; the caller owns the result.
+    // resultFormat 1 asks the server for binary column values. While a
+    // Deadline is open, a query still running when it passes is cancelled
+    // and DeadlineExceeded thrown; the connection is then closed on release
+    // unless the cancel wound the query down promptly.
+    PGresult* execPrepared(const PreparedStatement& statement, const char* const* paramValues,
+                           int resultFormat = 0) const;
+    // PQexecParams with text parameters, under the same deadline.
+    PGresult* execParams(const char* sql, int nParams, const char* const* paramValues, int resultFormat = 0) const;
+    // execPrepared for idempotent reads: if no result has arrived after
+    // hedgeAfter, the statement is sent again on an idle connection from
+    // the pool (when there is one) and the first result to arrive is
+    // returned. The slower attempt is cancelled, not waited on; its
+    // connection goes back to the pool once the server has stopped it.
+    PGresult* execPreparedHedged(const PreparedStatement& statement, const char* const* paramValues,
+                                 int resultFormat, std::chrono::nanoseconds hedgeAfter,
+                                 HedgeOutcome* outcome = nullptr) const;
+    // For callers that read results themselves (PQgetResult): returns once a
+    // result can be read without blocking, or cancels the query and throws
+    // DeadlineExceeded when the deadline passes first. No-op without one.
+    // If the socket cannot be polled, the query is cancelled and the
+    // connection closed on release, and std::runtime_error thrown.
+    void awaitResult() const;
+};
+
+// Thread-safe pool of libpq connections shared by the Crow worker threads.
+// Connections are opened lazily up to maxSize; checkout blocks for at most
+// checkoutTimeout when the pool is exhausted and then throws.
+//
+// A circuit breaker opens after breakerThreshold consecutive connection
+// failures. While open, checkout() still hands out idle connections but
+// otherwise fails immediately instead of dialing or waiting, and only
+// addConnection() (called by ConnectionSupervisor) dials the database; its
+// first success closes the breaker again.
+class ConnectionPool {
+private:
+    struct IdleConnection {
+        PGconn* conn;
+        std::chrono::steady_clock::time_point lastUsed;
+    };
+
+    ConnectionPoolConfig config_;
+    std::mutex mutex_;
+    std::condition_variable available_;
+    std::vector<IdleConnection> idle_;  // LIFO, so the warmest connection is reused first
+    std::vector<IdleConnection> draining_;  // released with a cancelled query still running
+    size_t total_ = 0;                  // open connections plus ones being opened
+
+    std::atomic<bool> breakerOpen_{false};
+    std::atomic<int> consecutiveFailures_{0};
+    std::function<void()> onRelease_;
+
+    std::unordered_map<std::string_view, Metrics::Histogram> statementLatency_;  // fixed after construction
+    Metrics::Histogram checkoutWait_{"db_pool_checkout_wait_seconds", "Time to obtain a pooled connection"};
+    Metrics::Counter checkoutTimeouts_{"db_pool_checkout_timeouts_total", "Checkouts that gave up waiting"};
+
+    PGconn* connect() const;
+    PGconn* connectTracked();
+    PooledConnection acquire(bool wait, bool open = true);
+    void setStatementTimeout(PGconn* conn) const;
+    void prepareStatements(PGconn* conn) const;
+    bool isHealthy(PGconn* conn, std::chrono::steady_clock::time_point lastUsed) const;
+    void recordFailure();
+    void recordSuccess();
+    void discard(PGconn* conn);
+    void giveBack(PGconn* conn, bool broken = false);
+    friend class PooledConnection;
+
+public:
+    // Does not connect; the first checkout or addConnection() does.
+    explicit ConnectionPool(ConnectionPoolConfig config);
+    ~ConnectionPool();
+    ConnectionPool(const ConnectionPool&) = delete;
+    ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+    PooledConnection checkout();
+    // Like checkout(), but returns an empty lease instead of waiting when
+    // every connection is in use. Still connects inline below maxSize.
+    PooledConnection tryCheckout();
+    // An idle connection, or an empty lease; never waits or connects.
+    PooledConnection tryCheckoutIdle();
+    // Called after a connection is returned or closed, i.e. whenever a
+    // tryCheckout() that came back empty might now succeed. Set it before
+    // the pool is shared between threads.
+    void setReleaseListener(std::function<void()> listener) { onRelease_ = std::move(listener); }
+
+    // Opens one more idle connection if below maxSize; at maxSize, dials one
+    // and closes it again. Returns whether the connect succeeded. Never throws.
+    bool addConnection();
+    // Pings idle connections unused for healthCheckAfter and closes the ones
+    // that do not answer.
+    void pingIdle();
+    // Returns released connections whose cancelled query has finished to
+    // the idle set, and closes ones that are taking too long.
+    void reapDraining();
+
+    // False while the circuit breaker is open.
+    bool available() const { return !breakerOpen_.load(std::memory_order_acquire); }
+
+    size_t size();
+    size_t idleCount();
+    // Connections checked out (or being opened) right now.
+    size_t busyCount();
+    const ConnectionPoolConfig& config() const { return config_; }
+    // Latency histogram of one of config().statements, or nullptr.
+    const Metrics::Histogram* statementLatency(const PreparedStatement& statement) const;
+};
+
+#endif
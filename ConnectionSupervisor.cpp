@@ -0,0 +1,78 @@
+#include "ConnectionSupervisor.h"
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+ConnectionSupervisor::ConnectionSupervisor(std::shared_ptr<ConnectionPool> pool, ConnectionSupervisorConfig config)
+    : pool_(std::move(pool)), config_(config), backoff_(config.initialBackoff) {
+    if (!pool_) {
+        throw std::runtime_error("Invalid connection pool provided to ConnectionSupervisor.");
+    }
+}
+
+ConnectionSupervisor::~ConnectionSupervisor() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    if (worker_.joinable()) worker_.join();
+}
+
+bool ConnectionSupervisor::start() {
+    maintain();
+    logTransition();
+    worker_ = std::thread(&ConnectionSupervisor::run, this);
+    return pool_->available();
+}
+
+// While the breaker is open a single addConnection() is the probe; once it
+// succeeds the breaker closes and the pool is filled normally.
+bool ConnectionSupervisor::maintain() {
+    if (!pool_->available()) {
+        if (!pool_->addConnection()) return false;
+    }
+    pool_->reapDraining();
+    pool_->pingIdle();
+    while (pool_->size() < pool_->config().minSize) {
+        if (!pool_->addConnection()) return false;
+    }
+    return true;
+}
+
+// Full jitter on the backoff keeps several instances that lost the same
+// database from reconnecting in lockstep.
+std::chrono::milliseconds ConnectionSupervisor::nextDelay(bool healthy) {
+    if (healthy) {
+        backoff_ = config_.initialBackoff;
+        return config_.interval;
+    }
+    std::uniform_int_distribution<long long> jitter(backoff_.count() / 2, backoff_.count());
+    std::chrono::milliseconds delay(jitter(rng_));
+    backoff_ = std::min(backoff_ * 2, config_.maxBackoff);
+    return delay;
+}
+
+void ConnectionSupervisor::logTransition() {
+    bool available = pool_->available();
+    if (available == wasAvailable_) return;
+    wasAvailable_ = available;
+    if (available) {
+        std::cout << "[DB] Connection restored" << std::endl;
+    } else {
+        std::cerr << "[DB] Database unreachable, failing requests fast until it recovers" << std::endl;
+    }
+}
+
+void ConnectionSupervisor::run() {
+    bool healthy = pool_->available();
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        wake_.wait_for(lock, nextDelay(healthy), [this] { return stopping_; });
+        if (stopping_) break;
+        lock.unlock();
+        healthy = maintain();
+        logTransition();
+        lock.lock();
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef CONNECTION_SUPERVISOR_H
+#define CONNECTION_SUPERVISOR_H
+
+#include "ConnectionPool.h"
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+
+struct ConnectionSupervisorConfig {
+    // How often idle connections are pinged and the pool topped up to minSize.
+    std::chrono::milliseconds interval{1000};
+    // Retry delay after a failed connect, doubled per failure up to maxBackoff.
+    std::chrono::milliseconds initialBackoff{250};
+    std::chrono::milliseconds maxBackoff{30000};
+};
+
+// Keeps a ConnectionPool healthy from a background thread so request
+// handlers never connect or retry themselves: it pings idle connections,
+// opens new ones up to minSize, and while the pool's circuit breaker is open
+// probes the database with jittered exponential backoff until it answers.
+class ConnectionSupervisor {
+private:
+    std::shared_ptr<ConnectionPool> pool_;
+    ConnectionSupervisorConfig config_;
+    std::chrono::milliseconds backoff_;
+    bool wasAvailable_ = true;
+    std::mt19937 rng_{std::random_device{}()};
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    std::thread worker_;
+
+    // One maintenance pass. Returns false if a connect attempt failed.
+    bool maintain();
+    std::chrono::milliseconds nextDelay(bool healthy);
+    void logTransition();
+    void run();
+
+public:
+    ConnectionSupervisor(std::shared_ptr<ConnectionPool> pool, ConnectionSupervisorConfig config = {});
+    ~ConnectionSupervisor();
+    ConnectionSupervisor(const ConnectionSupervisor&) = delete;
+    ConnectionSupervisor& operator=(const ConnectionSupervisor&) = delete;
+
+    // Runs one pass synchronously so startup knows whether the database is
+    // reachable, then hands over to the background thread. Returns the
+    // pool's availability after that first pass.
+    bool start();
+};
+
+#endif
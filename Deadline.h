@@ -0,0 +1,49 @@
+#ifndef DEADLINE_H
+#define DEADLINE_H
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+// Per-thread deadline for the request being handled. Database calls made
+// while a Scope is open give up (and cancel the query server-side) once it
+// passes; with no Scope open there is no deadline, so background threads
+// keep their blocking behaviour.
+class Deadline {
+public:
+    using Clock = std::chrono::steady_clock;
+
+private:
+    static Clock::time_point& current() {
+        thread_local Clock::time_point deadline = Clock::time_point::max();
+        return deadline;
+    }
+
+public:
+    // Clock::time_point::max() when there is none.
+    static Clock::time_point get() { return current(); }
+    static bool active() { return current() != Clock::time_point::max(); }
+
+    // Sets the deadline `budget` from now for the scope's lifetime; a zero
+    // budget opens no deadline. Nested scopes only ever tighten it.
+    class Scope {
+    private:
+        Clock::time_point previous_;
+
+    public:
+        explicit Scope(std::chrono::milliseconds budget) : previous_(current()) {
+            if (budget.count() > 0) current() = std::min(previous_, Clock::now() + budget);
+        }
+        ~Scope() { current() = previous_; }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+};
+
+// Thrown by a database call whose request deadline passed first.
+class DeadlineExceeded : public std::runtime_error {
+public:
+    DeadlineExceeded() : std::runtime_error("Deadline exceeded") {}
+};
+
+#endif
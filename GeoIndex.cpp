@@ -0,0 +1,129 @@
+#include "GeoIndex.h"
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <utility>
+
+namespace {
+
+constexpr double EarthRadiusKm = 6371.0088;
+constexpr double Pi = 3.14159265358979323846;
+constexpr double KmPerDegree = EarthRadiusKm * Pi / 180.0;
+
+double radians(double degrees) { return degrees * Pi / 180.0; }
+
+bool validPoint(double latitude, double longitude) {
+    return latitude >= -90.0 && latitude <= 90.0 && longitude >= -180.0 && longitude <= 180.0;
+}
+
+}
+
+double GeoIndex::distanceKm(double lat1, double lon1, double lat2, double lon2) {
+    double dLat = radians(lat2 - lat1), dLon = radians(lon2 - lon1);
+    double a = std::sin(dLat / 2) * std::sin(dLat / 2) +
+               std::cos(radians(lat1)) * std::cos(radians(lat2)) * std::sin(dLon / 2) * std::sin(dLon / 2);
+    return 2 * EarthRadiusKm * std::asin(std::min(1.0, std::sqrt(a)));
+}
+
+int GeoIndex::rowOf(double latitude) const {
+    return std::clamp(static_cast<int>(std::floor((latitude + 90.0) / cellDegrees_)), 0, rows_ - 1);
+}
+
+int GeoIndex::colOf(double longitude) const {
+    return std::clamp(static_cast<int>(std::floor((longitude + 180.0) / cellDegrees_)), 0, cols_ - 1);
+}
+
+GeoIndex::GeoIndex(const LocationSnapshot& snapshot) {
+    std::vector<uint32_t> points;
+    for (uint32_t row = 0; row < snapshot.size(); row++) {
+        if (validPoint(snapshot.latitude(row), snapshot.longitude(row))) points.push_back(row);
+    }
+
+    // About two points per cell if they were spread evenly; clustered data
+    // just leaves most cells empty, which costs 4 bytes each.
+    double cells = std::max<double>(1.0, points.size() / 2.0);
+    cellDegrees_ = std::clamp(std::sqrt(360.0 * 180.0 / cells), 0.05, 30.0);
+    cols_ = static_cast<int>(std::ceil(360.0 / cellDegrees_));
+    rows_ = static_cast<int>(std::ceil(180.0 / cellDegrees_));
+
+    std::vector<uint32_t> cellOf(points.size());
+    cellStart_.assign(static_cast<size_t>(cols_) * rows_ + 1, 0);
+    for (size_t i = 0; i < points.size(); i++) {
+        uint32_t row = points[i];
+        cellOf[i] = rowOf(snapshot.latitude(row)) * cols_ + colOf(snapshot.longitude(row));
+        cellStart_[cellOf[i] + 1]++;
+    }
+    for (size_t c = 1; c < cellStart_.size(); c++) cellStart_[c] += cellStart_[c - 1];
+
+    std::vector<uint32_t> fill(cellStart_.begin(), cellStart_.end() - 1);
+    pointRows_.resize(points.size());
+    latitudes_.resize(points.size());
+    longitudes_.resize(points.size());
+    for (size_t i = 0; i < points.size(); i++) {
+        uint32_t slot = fill[cellOf[i]]++;
+        pointRows_[slot] = points[i];
+        latitudes_[slot] = snapshot.latitude(points[i]);
+        longitudes_[slot] = snapshot.longitude(points[i]);
+    }
+}
+
+// Ring r holds the cells at Chebyshev distance r from the query's cell.
+// Column offsets are limited to [lo, hi] so that, with longitude wrapping,
+// every column is visited exactly once. After ring r, an unvisited point is
+// either at least r * cellDegrees away in latitude, or at least that far in
+// longitude. For the latter the closest it can be is the cross-track
+// distance to the meridian that far over, or the distance to the nearer
+// pole for meridians more than 90 degrees away.
+std::vector<uint32_t> GeoIndex::nearest(double latitude, double longitude, size_t k, double maxKm) const {
+    std::vector<uint32_t> result;
+    if (k == 0 || pointRows_.empty() || !validPoint(latitude, longitude)) return result;
+
+    using Candidate = std::pair<double, uint32_t>;  // distance, point slot
+    std::priority_queue<Candidate> best;            // worst of the best on top
+    int cy = rowOf(latitude), cx = colOf(longitude);
+    int lo = -((cols_ - 1) / 2), hi = cols_ / 2;
+    int maxRing = std::max({cy, rows_ - 1 - cy, hi, -lo});
+
+    auto visit = [&](int row, int dx) {
+        int col = ((cx + dx) % cols_ + cols_) % cols_;
+        size_t cell = static_cast<size_t>(row) * cols_ + col;
+        for (uint32_t slot = cellStart_[cell]; slot < cellStart_[cell + 1]; slot++) {
+            double d = distanceKm(latitude, longitude, latitudes_[slot], longitudes_[slot]);
+            if (d > maxKm) continue;
+            if (best.size() < k) {
+                best.emplace(d, slot);
+            } else if (d < best.top().first) {
+                best.pop();
+                best.emplace(d, slot);
+            }
+        }
+    };
+
+    for (int r = 0; r <= maxRing; r++) {
+        for (int dy = -r; dy <= r; dy++) {
+            int row = cy + dy;
+            if (row < 0 || row >= rows_) continue;
+            if (dy == -r || dy == r) {
+                for (int dx = std::max(-r, lo); dx <= std::min(r, hi); dx++) visit(row, dx);
+            } else {
+                if (-r >= lo) visit(row, -r);
+                if (r != 0 && r <= hi) visit(row, r);
+            }
+        }
+
+        double offset = r * cellDegrees_;
+        double bound = offset * KmPerDegree;
+        if (r < std::max(hi, -lo)) {
+            double poleKm = (90.0 - std::abs(latitude)) * KmPerDegree;
+            double crossKm = offset < 90.0 ? EarthRadiusKm * std::asin(std::cos(radians(latitude)) *
+                                                                       std::sin(radians(offset)))
+                                           : poleKm;
+            bound = std::min({bound, crossKm, poleKm});
+        }
+        if (bound > maxKm || (best.size() == k && best.top().first <= bound)) break;
+    }
+
+    result.resize(best.size());
+    for (size_t i = best.size(); i-- > 0; best.pop()) result[i] = pointRows_[best.top().second];
+    return result;
+}
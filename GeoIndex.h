@@ -0,0 +1,40 @@
+#ifndef GEO_INDEX_H
+#define GEO_INDEX_H
+
+#include "LocationSnapshot.h"
+#include <cstdint>
+#include <vector>
+
+// Fixed-grid spatial index over the snapshot rows that have coordinates.
+// Cells are square in degrees and sized from the row count so an average
+// cell holds a few points; points are stored contiguously per cell.
+// nearest() walks rings of cells outward from the query point and stops as
+// soon as no unvisited cell can beat the k-th best distance, so its cost
+// depends on k and local density, not on the table size.
+class GeoIndex {
+private:
+    double cellDegrees_;
+    int cols_;
+    int rows_;
+    std::vector<uint32_t> cellStart_;  // per cell, offset into the point arrays; one extra at the end
+    std::vector<uint32_t> pointRows_;  // snapshot row of each point, grouped by cell
+    std::vector<double> latitudes_;
+    std::vector<double> longitudes_;
+
+    int rowOf(double latitude) const;
+    int colOf(double longitude) const;
+
+public:
+    explicit GeoIndex(const LocationSnapshot& snapshot);
+
+    // Great-circle distance on a spherical Earth.
+    static double distanceKm(double lat1, double lon1, double lat2, double lon2);
+
+    // Snapshot rows of the k locations nearest to (latitude, longitude) and
+    // no further than maxKm, nearest first.
+    std::vector<uint32_t> nearest(double latitude, double longitude, size_t k, double maxKm) const;
+
+    size_t size() const { return pointRows_.size(); }
+};
+
+#endif
@@ -0,0 +1,224 @@
+#include "JsonWriter.h"
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+
+namespace {
+
+bool isContinuation(unsigned char c) { return (c & 0xC0) == 0x80; }
+
+// Length of the well-formed UTF-8 sequence starting at s[i], or 0.
+size_t utf8SequenceLength(std::string_view s, size_t i) {
+    auto at = [&](size_t k) -> unsigned char { return i + k < s.size() ? s[i + k] : 0; };
+    unsigned char c = at(0);
+    if (c >= 0xC2 && c <= 0xDF) return isContinuation(at(1)) ? 2 : 0;
+    if (c >= 0xE0 && c <= 0xEF) {
+        unsigned char lo = c == 0xE0 ? 0xA0 : 0x80, hi = c == 0xED ? 0x9F : 0xBF;
+        return at(1) >= lo && at(1) <= hi && isContinuation(at(2)) ? 3 : 0;
+    }
+    if (c >= 0xF0 && c <= 0xF4) {
+        unsigned char lo = c == 0xF0 ? 0x90 : 0x80, hi = c == 0xF4 ? 0x8F : 0xBF;
+        return at(1) >= lo && at(1) <= hi && isContinuation(at(2)) && isContinuation(at(3)) ? 4 : 0;
+    }
+    return 0;
+}
+
+void appendExponent(std::string& out, int e) {
+    out += e < 0 ? '-' : '+';
+    e = std::abs(e);
+    if (e < 10) out += '0';
+    char buf[4];
+    auto res = std::to_chars(buf, buf + sizeof(buf), e);
+    out.append(buf, res.ptr);
+}
+
+size_t estimateSize(const LocationView& loc) {
+    return 96 + loc.id.size() + loc.name.size() + loc.country.size() + loc.state.size() +
+           loc.description.size() + loc.svg_link.size();
+}
+
+template <typename Rows, typename ToView>
+void appendRows(std::string& out, const Rows& rows, FieldMask fields, ToView toView) {
+    size_t estimate = 2;
+    for (const auto& row : rows) estimate += estimateSize(toView(row));
+    out.reserve(out.size() + estimate);
+
+    out += '[';
+    bool first = true;
+    for (const auto& row : rows) {
+        if (!first) out += ',';
+        first = false;
+        JsonWriter::appendLocation(out, toView(row), fields);
+    }
+    out += ']';
+}
+
+}
+
+namespace JsonWriter {
+
+void appendString(std::string& out, std::string_view value) {
+    static const char hex[] = "0123456789abcdef";
+    out += '"';
+    size_t run = 0;
+    size_t i = 0;
+    while (i < value.size()) {
+        unsigned char c = value[i];
+        if (c >= 0x20 && c < 0x80 && c != '"' && c != '\\') {
+            i++;
+            continue;
+        }
+        if (c >= 0x80) {
+            if (size_t len = utf8SequenceLength(value, i)) {
+                i += len;
+                continue;
+            }
+        }
+        out.append(value.data() + run, i - run);
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    out += "\\u00";
+                    out += hex[c >> 4];
+                    out += hex[c & 0xF];
+                } else {
+                    out += "\xEF\xBF\xBD";
+                }
+        }
+        run = ++i;
+    }
+    out.append(value.data() + run, i - run);
+    out += '"';
+}
+
+// Shortest round-trip digits from to_chars, laid out the way nlohmann's
+// dtoa does: plain notation with a trailing ".0" for decimal exponents in
+// (-4, 15], scientific with a signed two-digit exponent otherwise.
+void appendDouble(std::string& out, double value) {
+    if (!std::isfinite(value)) {
+        out += "null";
+        return;
+    }
+    if (value == 0) {
+        out += std::signbit(value) ? "-0.0" : "0.0";
+        return;
+    }
+
+    char buf[32];
+    auto res = std::to_chars(buf, buf + sizeof(buf), value, std::chars_format::scientific);
+    std::string_view sci(buf, res.ptr - buf);
+    if (sci.front() == '-') {
+        out += '-';
+        sci.remove_prefix(1);
+    }
+    size_t ePos = sci.find('e');
+    int exponent = 0;
+    std::from_chars(sci.data() + ePos + (sci[ePos + 1] == '+' ? 2 : 1), sci.data() + sci.size(), exponent);
+
+    char digits[24];
+    int k = 0;
+    for (size_t i = 0; i < ePos; i++) {
+        if (sci[i] != '.') digits[k++] = sci[i];
+    }
+    int n = exponent + 1;  // position of the decimal point relative to the digits
+
+    if (k <= n && n <= 15) {
+        out.append(digits, k);
+        out.append(n - k, '0');
+        out += ".0";
+    } else if (0 < n && n <= 15) {
+        out.append(digits, n);
+        out += '.';
+        out.append(digits + n, k - n);
+    } else if (-4 < n && n <= 0) {
+        out += "0.";
+        out.append(-n, '0');
+        out.append(digits, k);
+    } else {
+        out += digits[0];
+        if (k > 1) {
+            out += '.';
+            out.append(digits + 1, k - 1);
+        }
+        out += 'e';
+        appendExponent(out, n - 1);
+    }
+}
+
+void appendLocation(std::string& out, const LocationView& loc, FieldMask fields) {
+    // Keys in the order nlohmann's sorted object map emits them. id is
+    // always written, so the keys before it carry their own commas.
+    out += '{';
+    if (fields & LocationFields::Country) {
+        out += "\"country\":";
+        appendString(out, loc.country);
+        out += ',';
+    }
+    if (fields & LocationFields::Description) {
+        out += "\"description\":";
+        appendString(out, loc.description);
+        out += ',';
+    }
+    out += "\"id\":";
+    appendString(out, loc.id);
+    if ((fields & LocationFields::Coordinates) && loc.hasCoordinates()) {
+        out += ",\"latitude\":";
+        appendDouble(out, loc.latitude);
+        out += ",\"longitude\":";
+        appendDouble(out, loc.longitude);
+    }
+    if (fields & LocationFields::Name) {
+        out += ",\"name\":";
+        appendString(out, loc.name);
+    }
+    if (fields & LocationFields::Rating) {
+        out += ",\"rating\":";
+        appendDouble(out, loc.rating);
+    }
+    if (fields & LocationFields::State) {
+        out += ",\"state\":";
+        appendString(out, loc.state);
+    }
+    if (fields & LocationFields::SvgLink) {
+        out += ",\"svg_link\":";
+        appendString(out, loc.svg_link);
+    }
+    out += '}';
+}
+
+void appendLocation(std::string& out, const Location& loc, FieldMask fields) {
+    appendLocation(out, LocationView::of(loc), fields);
+}
+
+void appendLocations(std::string& out, const std::vector<Location>& locations, FieldMask fields) {
+    appendRows(out, locations, fields, [](const Location& loc) { return LocationView::of(loc); });
+}
+
+void appendLocations(std::string& out, const LocationRows& rows, FieldMask fields) {
+    appendRows(out, rows, fields, [](const LocationView& loc) -> const LocationView& { return loc; });
+}
+
+void appendLocations(std::string& out, const std::vector<std::shared_ptr<const Location>>& locations,
+                     FieldMask fields) {
+    out += '[';
+    for (size_t i = 0; i < locations.size(); i++) {
+        if (i) out += ',';
+        if (locations[i]) appendLocation(out, *locations[i], fields);
+        else out += "null";
+    }
+    out += ']';
+}
+
+void appendLocations(std::string& out, const SnapshotRows& rows, FieldMask fields) {
+    const LocationSnapshot& snapshot = *rows.snapshot;
+    appendRows(out, rows.rows, fields, [&](uint32_t row) { return snapshot.view(row); });
+}
+
+}
@@ -0,0 +1,33 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include "LocationService.h"
+#include "LocationSnapshot.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Serializes straight into a caller-owned buffer, with the same layout
+// nlohmann::json::dump() gives for the equivalent tree: sorted keys, no
+// whitespace, the same escaping and number notation. Doubles use the
+// shortest round-trip digits, which is occasionally one digit shorter than
+// nlohmann's grisu2 output for the same value. Invalid UTF-8 is replaced with
+// U+FFFD instead of throwing. latitude/longitude are only written when the
+// location has both. Locations are written with only the keys in `fields`
+// (id is always written).
+namespace JsonWriter {
+    void appendString(std::string& out, std::string_view value);
+    void appendDouble(std::string& out, double value);
+
+    void appendLocation(std::string& out, const LocationView& loc, FieldMask fields = LocationFields::All);
+    void appendLocation(std::string& out, const Location& loc, FieldMask fields = LocationFields::All);
+    void appendLocations(std::string& out, const std::vector<Location>& locations,
+                         FieldMask fields = LocationFields::All);
+    void appendLocations(std::string& out, const LocationRows& rows, FieldMask fields = LocationFields::All);
+    // Missing entries (nullptr) are written as null.
+    void appendLocations(std::string& out, const std::vector<std::shared_ptr<const Location>>& locations,
+                         FieldMask fields = LocationFields::All);
+    void appendLocations(std::string& out, const SnapshotRows& rows, FieldMask fields = LocationFields::All);
+}
+
+#endif
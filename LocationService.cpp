@@ -1,90 +1,509 @@
 
 #include "LocationService.h"
+#include "LocationSnapshot.h"
+#include "LocationStore.h"
+#include "SearchIndex.h"
+#include "GeoIndex.h"
 #include <algorithm>
+#include <charconv>
+#include <unordered_map>
+#include <cstring>
+#include <optional>
 #include <stdexcept>
 
-LocationService::LocationService(PGconn* connection) : conn(connection) {
-    if (!conn) {
-        throw std::runtime_error("Invalid database connection provided to LocationService.");
+// Everything published with one snapshot, swapped in as a unit.
+struct SnapshotIndexes {
+    SearchIndex search;
+    GeoIndex geo;
+
+    explicit SnapshotIndexes(std::shared_ptr<const LocationSnapshot> snapshot)
+        : search(snapshot), geo(*snapshot) {}
+};
+
+LocationService::LocationService(std::shared_ptr<LocationStore> store, LocationServiceConfig config)
+    : store_(std::move(store)),
+      config_(config),
+      topLocationsCache_(config.cache),
+      locationByIdCache_(config.cache) {
+    if (!store_) {
+        throw std::runtime_error("Invalid location store provided to LocationService.");
     }
 }
 
 LocationService::~LocationService() {}
 
-// Helper to sanitize strings before database use.
-std::string LocationService::sanitizeString(const std::string& input) const {
-    std::string sanitized = input;
-    sanitized.erase(std::remove_if(sanitized.begin(), sanitized.end(),
-        [](unsigned char c) { return c < 32 && c != '\t' && c != '\n' && c != '\r'; }),
-        sanitized.end());
-    return sanitized;
+namespace {
+
+// Type OIDs from pg_type that location columns may come back as.
+constexpr Oid BOOLOID = 16, INT8OID = 20, INT2OID = 21, INT4OID = 23, FLOAT4OID = 700, FLOAT8OID = 701,
+              NUMERICOID = 1700, UUIDOID = 2950;
+
+bool needsSanitizing(std::string_view value) {
+    for (unsigned char c : value) {
+        if (c < 32 && c != '\t' && c != '\n' && c != '\r') return true;
+    }
+    return false;
+}
+
+double parseDouble(std::string_view value) {
+    double result = 0.0;
+    std::from_chars(value.data(), value.data() + value.size(), result);
+    return result;
+}
+
+// Binary values arrive in network byte order.
+uint64_t readBigEndian(const char* data, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) value = (value << 8) | static_cast<unsigned char>(data[i]);
+    return value;
 }
 
-// Helper to convert a database row into a Location struct.
-Location LocationService::rowToLocation(const PGResultWrapper& res, int i) const {
-    return Location{
-        .id = sanitizeString(PQgetvalue(res.get(), i, 0) ? PQgetvalue(res.get(), i, 0) : ""),
-        .name = sanitizeString(PQgetvalue(res.get(), i, 1) ? PQgetvalue(res.get(), i, 1) : ""),
-        .country = sanitizeString(PQgetvalue(res.get(), i, 2) ? PQgetvalue(res.get(), i, 2) : ""),
-        .state = sanitizeString(PQgetvalue(res.get(), i, 3) ? PQgetvalue(res.get(), i, 3) : ""),
-        .description = sanitizeString(PQgetvalue(res.get(), i, 4) ? PQgetvalue(res.get(), i, 4) : ""),
-        .svg_link = sanitizeString(PQgetvalue(res.get(), i, 5) ? PQgetvalue(res.get(), i, 5) : ""),
-        .rating = PQgetvalue(res.get(), i, 6) ? std::stod(PQgetvalue(res.get(), i, 6)) : 0.0
-    };
+int64_t readInteger(const char* data, int length) {
+    switch (length) {
+        case 2: return static_cast<int16_t>(readBigEndian(data, 2));
+        case 4: return static_cast<int32_t>(readBigEndian(data, 4));
+        case 8: return static_cast<int64_t>(readBigEndian(data, 8));
+        default: throw std::runtime_error("Unexpected binary integer width");
+    }
 }
 
-std::vector<Location> LocationService::getTopLocations(int limit) {
-    std::lock_guard<std::mutex> lock(db_mutex_);
-    std::string query = "SELECT * FROM get_top_locations($1);";
-    std::string limitStr = std::to_string(limit);
-    const char* paramValues[1] = {limitStr.c_str()};
+// numeric's binary form: int16 ndigits, int16 weight, uint16 sign,
+// int16 dscale, then ndigits base-10000 digits. Rendered as
+// "<digits>e<exponent>" and parsed, so rounding matches the text path.
+double readNumeric(const char* data, int length) {
+    if (length < 8) throw std::runtime_error("Malformed binary numeric");
+    int ndigits = static_cast<int16_t>(readBigEndian(data, 2));
+    int weight = static_cast<int16_t>(readBigEndian(data + 2, 2));
+    uint16_t sign = static_cast<uint16_t>(readBigEndian(data + 4, 2));
+    if (sign == 0xC000 || length < 8 + ndigits * 2) return 0.0;  // NaN or truncated
+    if (ndigits == 0) return 0.0;
 
-    PGResultWrapper res(PQexecParams(conn, query.c_str(), 1, nullptr, paramValues, nullptr, nullptr, 0));
-    if (PQresultStatus(res.get()) != PGRES_TUPLES_OK) {
-        throw std::runtime_error("Query failed: " + std::string(PQerrorMessage(conn)));
+    std::string text = sign == 0x4000 ? "-" : "";
+    for (int i = 0; i < ndigits; i++) {
+        char group[5];
+        int digit = static_cast<int>(readBigEndian(data + 8 + i * 2, 2));
+        for (int d = 3; d >= 0; d--) {
+            group[d] = static_cast<char>('0' + digit % 10);
+            digit /= 10;
+        }
+        text.append(group, 4);
     }
+    text += 'e';
+    text += std::to_string((weight - ndigits + 1) * 4);
+    return parseDouble(text);
+}
 
-    std::vector<Location> locations;
-    int rows = PQntuples(res.get());
-    locations.reserve(rows);
+std::string formatUuid(const char* data) {
+    static const char hex[] = "0123456789abcdef";
+    std::string out;
+    out.reserve(36);
+    for (int i = 0; i < 16; i++) {
+        if (i == 4 || i == 6 || i == 8 || i == 10) out += '-';
+        out += hex[static_cast<unsigned char>(data[i]) >> 4];
+        out += hex[static_cast<unsigned char>(data[i]) & 0xF];
+    }
+    return out;
+}
+
+struct FieldName {
+    const char* key;  // JSON key, and column name for the single-column fields
+    FieldMask field;
+};
+
+constexpr FieldName FieldNames[] = {
+    {"id", LocationFields::Id},
+    {"name", LocationFields::Name},
+    {"country", LocationFields::Country},
+    {"state", LocationFields::State},
+    {"description", LocationFields::Description},
+    {"svg_link", LocationFields::SvgLink},
+    {"rating", LocationFields::Rating},
+    {"latitude", LocationFields::Coordinates},
+    {"longitude", LocationFields::Coordinates},
+};
+
+}
+
+namespace LocationFields {
+
+FieldMask parse(const std::vector<std::string>& names) {
+    FieldMask fields = Id;
+    for (const auto& name : names) {
+        auto known = std::find_if(std::begin(FieldNames), std::end(FieldNames),
+                                  [&](const FieldName& f) { return name == f.key; });
+        if (known == std::end(FieldNames)) throw std::invalid_argument("Unknown field '" + name + "'");
+        fields |= known->field;
+    }
+    return fields;
+}
+
+std::string columns(FieldMask fields) {
+    fields |= Id;
+    if (fields == All || (fields & Coordinates)) return "*";
+    std::string list;
+    for (const auto& f : FieldNames) {
+        if (!(fields & f.field)) continue;
+        if (!list.empty()) list += ", ";
+        list += f.key;
+    }
+    return list;
+}
+
+}
+
+LocationRows::LocationRows(std::unique_ptr<PGResultWrapper> result) : result_(std::move(result)) {
+    const Column id = findColumn("id"), name = findColumn("name"), country = findColumn("country"),
+                 state = findColumn("state"), description = findColumn("description"),
+                 svgLink = findColumn("svg_link"), rating = findColumn("rating");
+    Column latitude = findColumn("latitude"), longitude = findColumn("longitude");
+    if (latitude.index < 0) latitude = findColumn("lat");
+    if (longitude.index < 0) longitude = findColumn("lon");
+    if (longitude.index < 0) longitude = findColumn("lng");
+
+    int rows = PQntuples(result_->get());
+    rows_.reserve(rows);
     for (int i = 0; i < rows; i++) {
-        locations.push_back(rowToLocation(res, i));
+        rows_.push_back(LocationView{
+            .id = textColumn(i, id),
+            .name = textColumn(i, name),
+            .country = textColumn(i, country),
+            .state = textColumn(i, state),
+            .description = textColumn(i, description),
+            .svg_link = textColumn(i, svgLink),
+            .rating = numberColumn(i, rating),
+            .latitude = numberColumn(i, latitude, NoCoordinate),
+            .longitude = numberColumn(i, longitude, NoCoordinate)
+        });
+    }
+}
+
+LocationRows::Column LocationRows::findColumn(const char* name) const {
+    Column col;
+    col.index = PQfnumber(result_->get(), name);
+    if (col.index >= 0) {
+        col.type = PQftype(result_->get(), col.index);
+        col.binary = PQfformat(result_->get(), col.index) == 1;
+    }
+    return col;
+}
+
+// Text values (and binary text types, which are the same bytes) point
+// straight at libpq's copy; only values containing control bytes are
+// copied, with those bytes removed. Binary uuids and integers are rendered
+// to their text form.
+std::string_view LocationRows::textColumn(int row, const Column& col) {
+    if (col.index < 0 || PQgetisnull(result_->get(), row, col.index)) return {};
+    const char* data = PQgetvalue(result_->get(), row, col.index);
+    int length = PQgetlength(result_->get(), row, col.index);
+
+    if (col.binary) {
+        switch (col.type) {
+            case UUIDOID:
+                if (length != 16) throw std::runtime_error("Malformed binary uuid");
+                return storage_.emplace_back(formatUuid(data));
+            case INT2OID:
+            case INT4OID:
+            case INT8OID:
+                return storage_.emplace_back(std::to_string(readInteger(data, length)));
+            case BOOLOID:
+            case FLOAT4OID:
+            case FLOAT8OID:
+            case NUMERICOID:
+                throw std::runtime_error("Unsupported binary type for a text location column");
+            default:
+                break;  // text, varchar, bpchar, name: raw bytes
+        }
+    }
+
+    std::string_view value(data, static_cast<size_t>(length));
+    if (!needsSanitizing(value)) return value;
+    std::string& copy = storage_.emplace_back(value);
+    copy.erase(std::remove_if(copy.begin(), copy.end(),
+        [](unsigned char c) { return c < 32 && c != '\t' && c != '\n' && c != '\r'; }),
+        copy.end());
+    return copy;
+}
+
+double LocationRows::numberColumn(int row, const Column& col, double missing) const {
+    if (col.index < 0 || PQgetisnull(result_->get(), row, col.index)) return missing;
+    const char* data = PQgetvalue(result_->get(), row, col.index);
+    int length = PQgetlength(result_->get(), row, col.index);
+    if (!col.binary) return parseDouble(std::string_view(data, static_cast<size_t>(length)));
+
+    switch (col.type) {
+        case FLOAT8OID: {
+            uint64_t bits = readBigEndian(data, 8);
+            double value;
+            std::memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+        case FLOAT4OID: {
+            uint32_t bits = static_cast<uint32_t>(readBigEndian(data, 4));
+            float value;
+            std::memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+        case NUMERICOID: return readNumeric(data, length);
+        case INT2OID:
+        case INT4OID:
+        case INT8OID: return static_cast<double>(readInteger(data, length));
+        default: throw std::runtime_error("Unsupported binary type for a numeric location column");
     }
+}
+
+LocationRows::LocationRows(std::vector<Location> locations) : owned_(std::move(locations)) {
+    rows_.reserve(owned_.size());
+    for (const auto& loc : owned_) rows_.push_back(LocationView::of(loc));
+}
+
+LocationRows::LocationRows(std::shared_ptr<const std::vector<Location>> locations) : shared_(std::move(locations)) {
+    rows_.reserve(shared_->size());
+    for (const auto& loc : *shared_) rows_.push_back(LocationView::of(loc));
+}
+
+std::vector<Location> LocationRows::toLocations() const {
+    std::vector<Location> locations;
+    locations.reserve(rows_.size());
+    for (const auto& row : rows_) locations.push_back(row.toLocation());
     return locations;
 }
 
-Location LocationService::getLocationById(const std::string& id) {
-    std::lock_guard<std::mutex> lock(db_mutex_);
-    std::string sanitizedId = sanitizeString(id);
-    std::string query = "SELECT * FROM get_location_by_id($1);";
-    const char* paramValues[1] = {sanitizedId.c_str()};
+std::shared_ptr<const std::vector<Location>> LocationService::getTopLocations(int limit) {
+    if (!config_.cacheEnabled) {
+        return std::make_shared<const std::vector<Location>>(queryTopLocations(limit));
+    }
+    return topLocationsCache_.getOrLoad(limit, [&] { return queryTopLocations(limit); });
+}
 
-    PGResultWrapper res(PQexecParams(conn, query.c_str(), 1, nullptr, paramValues, nullptr, nullptr, 0));
-    if (PQresultStatus(res.get()) != PGRES_TUPLES_OK) {
-        throw std::runtime_error("Query failed: " + std::string(PQerrorMessage(conn)));
+std::shared_ptr<const Location> LocationService::getLocationById(const std::string& id) {
+    if (!config_.cacheEnabled) {
+        return std::make_shared<const Location>(queryLocationById(id));
     }
-    if (PQntuples(res.get()) == 0) {
-        throw std::runtime_error("Location not found");
+    return locationByIdCache_.getOrLoad(id, [&] { return queryLocationById(id); });
+}
+
+std::vector<std::shared_ptr<const Location>> LocationService::getLocationsByIds(const std::vector<std::string>& ids,
+                                                                              std::vector<std::exception_ptr>* errors) {
+    std::vector<std::shared_ptr<const Location>> found(ids.size());
+    if (errors) errors->assign(ids.size(), nullptr);
+    std::vector<std::string> missing;
+    std::unordered_map<std::string, std::vector<size_t>> slots;  // missing id -> positions in `found`
+    for (size_t i = 0; i < ids.size(); i++) {
+        if (config_.cacheEnabled && (found[i] = locationByIdCache_.get(ids[i]))) continue;
+        auto& positions = slots[ids[i]];
+        if (positions.empty()) missing.push_back(ids[i]);
+        positions.push_back(i);
+    }
+    if (missing.empty()) return found;
+
+    std::vector<std::exception_ptr> fetchErrors;
+    auto fetched = store_->locationsByIds(missing, errors ? &fetchErrors : nullptr);
+    for (size_t m = 0; m < missing.size(); m++) {
+        if (errors && fetchErrors[m]) {
+            for (size_t i : slots[missing[m]]) (*errors)[i] = fetchErrors[m];
+        }
+        if (!fetched[m]) continue;
+        if (config_.cacheEnabled) locationByIdCache_.put(missing[m], fetched[m]);
+        for (size_t i : slots[missing[m]]) found[i] = fetched[m];
     }
-    return rowToLocation(res, 0);
+    return found;
+}
+
+uint64_t LocationService::invalidateCache() {
+    topLocationsCache_.clear();
+    locationByIdCache_.clear();
+    return dataVersion_.fetch_add(1, std::memory_order_acq_rel) + 1;
+}
+
+void LocationService::invalidateLocations(const std::vector<std::string>& ids) {
+    for (const auto& id : ids) locationByIdCache_.invalidate(id);
+    topLocationsCache_.clear();
+}
+
+// Tagged with the version read before the query: an invalidation during the
+// query then leaves the snapshot looking stale, which is the safe side.
+std::shared_ptr<const LocationSnapshot> LocationService::loadSnapshot() {
+    uint64_t version = dataVersion();
+    return std::make_shared<const LocationSnapshot>(
+        store_->snapshotTopLocations(static_cast<int>(config_.snapshotMaxRows)), version);
+}
+
+std::vector<std::shared_ptr<const Location>> LocationService::fetchLocationsByIds(const std::vector<std::string>& ids) {
+    return store_->snapshotLocationsByIds(ids);
+}
+
+void LocationService::publishSnapshot(std::shared_ptr<const LocationSnapshot> snapshot, bool synced) {
+    auto indexes = std::make_shared<const SnapshotIndexes>(std::move(snapshot));
+    if (!synced) snapshotSyncedAt_.store(0, std::memory_order_release);
+    std::atomic_store(&indexes_, std::shared_ptr<const SnapshotIndexes>(std::move(indexes)));
+    snapshotGeneration_.fetch_add(1, std::memory_order_acq_rel);
+    if (synced) markSnapshotSynced();
 }
 
-std::vector<Location> LocationService::searchLocations(const std::string& queryStr) {
-    std::lock_guard<std::mutex> lock(db_mutex_);
-    std::string sanitizedQuery = sanitizeString(queryStr);
-    std::string sqlQuery = "SELECT * FROM search_locations($1);";
-    const char* paramValues[1] = {sanitizedQuery.c_str()};
+void LocationService::markSnapshotSynced() {
+    snapshotSyncedAt_.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_release);
+}
+
+std::shared_ptr<const LocationSnapshot> LocationService::currentSnapshot() const {
+    auto indexes = std::atomic_load(&indexes_);
+    return indexes ? indexes->search.snapshot() : nullptr;
+}
 
-    PGResultWrapper res(PQexecParams(conn, sqlQuery.c_str(), 1, nullptr, paramValues, nullptr, nullptr, 0));
-    if (PQresultStatus(res.get()) != PGRES_TUPLES_OK) {
-        throw std::runtime_error("Query failed: " + std::string(PQerrorMessage(conn)));
+std::shared_ptr<const SnapshotIndexes> LocationService::freshIndex() const {
+    if (!config_.snapshotEnabled) return nullptr;
+    std::shared_ptr<const SnapshotIndexes> index = std::atomic_load(&indexes_);
+    auto synced = snapshotSyncedAt_.load(std::memory_order_acquire);
+    std::chrono::steady_clock::time_point syncedAt{std::chrono::steady_clock::duration(synced)};
+    if (!index || synced == 0 || index->search.dataVersion() != dataVersion() ||
+        std::chrono::steady_clock::now() - syncedAt > config_.snapshotMaxStaleness) {
+        return nullptr;
     }
+    return index;
+}
 
-    std::vector<Location> locations;
-    int rows = PQntuples(res.get());
-    locations.reserve(rows);
-    for (int i = 0; i < rows; i++) {
-        locations.push_back(rowToLocation(res, i));
+// A snapshot holding fewer than snapshotMaxRows rows is all get_top_locations
+// returns, so it can also answer limits past its size. It is the whole
+// table, and can answer ids it does not contain (with LocationNotFound),
+// only if snapshotComplete says that function hides no rows.
+std::optional<SnapshotRows> LocationService::topLocal(int limit) const {
+    auto index = freshIndex();
+    if (!index || limit < 0) return std::nullopt;
+    const auto& snapshot = index->search.snapshot();
+    if (static_cast<size_t>(limit) > snapshot->size() && snapshot->size() >= config_.snapshotMaxRows) {
+        return std::nullopt;
     }
-    return locations;
+    return SnapshotRows{snapshot, snapshot->top(static_cast<size_t>(limit))};
+}
+
+std::optional<SnapshotRows> LocationService::topPageLocal(double afterRating, const std::string& afterId,
+                                                          int limit) const {
+    auto index = freshIndex();
+    if (!index || limit < 0) return std::nullopt;
+    const auto& snapshot = index->search.snapshot();
+    size_t begin = snapshot->rankAfter(afterRating, afterId);
+    size_t end = begin + static_cast<size_t>(limit);
+    if (end > snapshot->size() && snapshot->size() >= config_.snapshotMaxRows) return std::nullopt;
+    SnapshotRows page{snapshot, {}};
+    for (size_t rank = begin; rank < std::min(end, snapshot->size()); rank++) {
+        page.rows.push_back(snapshot->rankedRow(rank));
+    }
+    return page;
+}
+
+std::optional<SnapshotRows> LocationService::locationByIdLocal(const std::string& id) const {
+    auto index = freshIndex();
+    if (!index) return std::nullopt;
+    const auto& snapshot = index->search.snapshot();
+    auto row = snapshot->find(id);
+    if (row) return SnapshotRows{snapshot, {*row}};
+    if (config_.snapshotComplete && snapshot->size() < config_.snapshotMaxRows) throw LocationNotFound();
+    return std::nullopt;
+}
+
+std::optional<SnapshotRows> LocationService::searchLocal(const std::string& query) const {
+    auto index = freshIndex();
+    if (!index || !SearchIndex::hasTokens(query)) return std::nullopt;
+    return SnapshotRows{index->search.snapshot(), index->search.search(query, config_.searchResultLimit)};
+}
+
+std::optional<SnapshotRows> LocationService::nearbyLocal(double latitude, double longitude, size_t limit,
+                                                         double maxKm) const {
+    auto index = freshIndex();
+    if (!index) return std::nullopt;
+    const auto& snapshot = index->search.snapshot();
+    if (snapshot->size() >= config_.snapshotMaxRows) return std::nullopt;
+    return SnapshotRows{snapshot, index->geo.nearest(latitude, longitude, limit, maxKm)};
+}
+
+std::vector<Location> LocationService::queryTopLocations(int limit) {
+    return store_->topLocations(limit).toLocations();
+}
+
+Location LocationService::queryLocationById(const std::string& id) {
+    LocationRows rows = store_->locationById(id);
+    if (rows.empty()) {
+        throw LocationNotFound();
+    }
+    return rows[0].toLocation();
+}
+
+LocationRows LocationService::searchLocations(const std::string& queryStr, FieldMask fields) {
+    return store_->searchLocations(queryStr, fields);
+}
+
+LocationRows LocationService::getTopLocations(int limit, FieldMask fields) {
+    return store_->topLocations(limit, fields);
+}
+
+LocationRows LocationService::getLocationById(const std::string& id, FieldMask fields) {
+    LocationRows rows = store_->locationById(id, fields);
+    if (rows.empty()) {
+        throw LocationNotFound();
+    }
+    return rows;
+}
+
+LocationRows LocationService::getTopLocationsAfter(double afterRating, const std::string& afterId, int limit) {
+    return store_->topLocationsAfter(afterRating, afterId, limit);
+}
+
+bool LocationService::hasAsync() const { return store_->hasAsync(); }
+
+void LocationService::topLocationsAsync(int limit, RowsCallback done) {
+    if (!config_.cacheEnabled) {
+        store_->topLocationsAsync(limit, std::move(done));
+        return;
+    }
+    using Cache = decltype(topLocationsCache_);
+    topLocationsCache_.getOrLoadAsync(limit,
+        [this, limit](Cache::Callback complete) {
+            store_->topLocationsAsync(limit, [complete](const LocationRows* rows, std::exception_ptr error) {
+                if (error) {
+                    complete(nullptr, error);
+                    return;
+                }
+                complete(std::make_shared<const std::vector<Location>>(rows->toLocations()), nullptr);
+            });
+        },
+        [done = std::move(done)](Cache::Value locations, std::exception_ptr error) {
+            if (error) {
+                done(nullptr, error);
+                return;
+            }
+            LocationRows rows(std::move(locations));
+            done(&rows, nullptr);
+        });
+}
+
+// Like getLocationById, a missing id fails the load with LocationNotFound
+// and is not cached.
+void LocationService::locationByIdAsync(const std::string& id, RowsCallback done) {
+    if (!config_.cacheEnabled) {
+        store_->locationByIdAsync(id, std::move(done));
+        return;
+    }
+    using Cache = decltype(locationByIdCache_);
+    locationByIdCache_.getOrLoadAsync(id,
+        [this, id](Cache::Callback complete) {
+            store_->locationByIdAsync(id, [complete](const LocationRows* rows, std::exception_ptr error) {
+                if (!error && rows->empty()) error = std::make_exception_ptr(LocationNotFound());
+                if (error) {
+                    complete(nullptr, error);
+                    return;
+                }
+                complete(std::make_shared<const Location>((*rows)[0].toLocation()), nullptr);
+            });
+        },
+        [done = std::move(done)](Cache::Value location, std::exception_ptr error) {
+            if (error) {
+                done(nullptr, error);
+                return;
+            }
+            LocationRows rows(std::vector<Location>{*location});
+            done(&rows, nullptr);
+        });
+}
+
+void LocationService::searchLocationsAsync(const std::string& queryStr, RowsCallback done) {
+    store_->searchLocationsAsync(queryStr, std::move(done));
 }
\ No newline at end of file
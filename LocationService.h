@@ -2,14 +2,35 @@
 #ifndef LOCATION_SERVICE_H
 #define LOCATION_SERVICE_H
 
+#include "LruCache.h"
 #include <postgresql/libpq-fe.h>
 #include <string>
+#include <string_view>
 #include <vector>
+#include <deque>
 #include <stdexcept>
 #include <memory>
-#include <mutex>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <optional>
+
+class LocationStore;
+class LocationSnapshot;
+class SearchIndex;
+class GeoIndex;
+struct SnapshotIndexes;
+
+// Stands in for a missing coordinate.
+constexpr double NoCoordinate = std::numeric_limits<double>::quiet_NaN();
 
 // The data structure for a location, matching the database schema.
+// latitude/longitude come from optional columns and are NoCoordinate when
+// the table does not have them or the row leaves them null.
 struct Location {
     std::string id;
     std::string name;
@@ -18,8 +39,35 @@ struct Location {
     std::string description;
     std::string svg_link;
     double rating;
+    double latitude = NoCoordinate;
+    double longitude = NoCoordinate;
 };
 
+// A set of Location members, for reads that only need some of them (the
+// `fields` RPC param). id is always in it; latitude and longitude are one
+// field, as they are only ever written together.
+using FieldMask = uint16_t;
+
+namespace LocationFields {
+    constexpr FieldMask Id = 1 << 0;
+    constexpr FieldMask Name = 1 << 1;
+    constexpr FieldMask Country = 1 << 2;
+    constexpr FieldMask State = 1 << 3;
+    constexpr FieldMask Description = 1 << 4;
+    constexpr FieldMask SvgLink = 1 << 5;
+    constexpr FieldMask Rating = 1 << 6;
+    constexpr FieldMask Coordinates = 1 << 7;
+    constexpr FieldMask All = (1 << 8) - 1;
+
+    // The mask naming these JSON keys (plus id). Throws std::invalid_argument
+    // for a name that is not a location key.
+    FieldMask parse(const std::vector<std::string>& names);
+    // Column list selecting these fields from one of the location functions,
+    // or "*" when that is all of them or the optional coordinate columns
+    // are wanted (they go by several names).
+    std::string columns(FieldMask fields);
+}
+
 // RAII wrapper for PGresult to ensure memory is always freed.
 class PGResultWrapper {
 private:
@@ -34,22 +82,212 @@ public:
     PGresult* get() const { return result_; }
 };
 
-// Service class to interact with the database.
+// Non-owning view of one location row. The strings point into the PGresult
+// of the LocationRows that produced it, or into its side storage for the
+// rare value that needed sanitizing.
+struct LocationView {
+    std::string_view id;
+    std::string_view name;
+    std::string_view country;
+    std::string_view state;
+    std::string_view description;
+    std::string_view svg_link;
+    double rating;
+    double latitude = NoCoordinate;
+    double longitude = NoCoordinate;
+
+    bool hasCoordinates() const { return !std::isnan(latitude) && !std::isnan(longitude); }
+
+    static LocationView of(const Location& loc) {
+        return {loc.id, loc.name, loc.country, loc.state, loc.description, loc.svg_link, loc.rating,
+                loc.latitude, loc.longitude};
+    }
+    Location toLocation() const {
+        return Location{std::string(id), std::string(name), std::string(country), std::string(state),
+                        std::string(description), std::string(svg_link), rating, latitude, longitude};
+    }
+};
+
+// The rows of a location query result, viewed in place. Owns the PGresult
+// (or, for results built in memory, the Locations), so views stay valid for
+// as long as this object (or a moved-to one) lives. Columns are found by
+// name, so the column order of SELECT * does not matter, and may be in
+// text or binary format.
+class LocationRows {
+private:
+    struct Column {
+        int index = -1;  // -1 when the result has no such column
+        Oid type = 0;
+        bool binary = false;
+    };
+
+    std::unique_ptr<PGResultWrapper> result_;
+    std::vector<LocationView> rows_;
+    // Sanitized copies and text renderings of binary values. A deque, so
+    // moving it keeps element addresses (and the views into them) valid.
+    std::deque<std::string> storage_;
+    // Rows not read from a PGresult. Moving a vector keeps its elements
+    // where they are, so the views into them survive it too.
+    std::vector<Location> owned_;
+    // Or rows held by a cache, shared rather than copied.
+    std::shared_ptr<const std::vector<Location>> shared_;
+
+    Column findColumn(const char* name) const;
+    std::string_view textColumn(int row, const Column& col);
+    double numberColumn(int row, const Column& col, double missing = 0.0) const;
+
+public:
+    explicit LocationRows(std::unique_ptr<PGResultWrapper> result);
+    explicit LocationRows(std::vector<Location> locations);
+    explicit LocationRows(std::shared_ptr<const std::vector<Location>> locations);
+
+    size_t size() const { return rows_.size(); }
+    bool empty() const { return rows_.empty(); }
+    const LocationView& operator[](size_t i) const { return rows_[i]; }
+    std::vector<LocationView>::const_iterator begin() const { return rows_.begin(); }
+    std::vector<LocationView>::const_iterator end() const { return rows_.end(); }
+
+    std::vector<Location> toLocations() const;
+};
+
+struct LocationServiceConfig {
+    bool cacheEnabled = true;
+    LruCacheConfig cache;
+    // Answer reads from a resident snapshot of the table (plus a search
+    // index over it) kept current by a SnapshotRefresher. Reads fall back to
+    // SQL while the snapshot is missing, has not been confirmed in sync for
+    // snapshotMaxStaleness, or predates the last invalidateCache().
+    bool snapshotEnabled = false;
+    std::chrono::milliseconds snapshotMaxStaleness{120000};
+    size_t snapshotMaxRows = 100000;  // the snapshot is get_top_locations(snapshotMaxRows)
+    // Set only if get_top_locations returns every row get_location_by_id can
+    // find (it hides none, e.g. unrated ones). An id missing from a snapshot
+    // of fewer than snapshotMaxRows rows is then answered LocationNotFound
+    // without a query; otherwise a miss is looked up in SQL.
+    bool snapshotComplete = false;
+    size_t searchResultLimit = 50;
+};
+
+// Thrown by getLocationById for an id no location has, so callers can tell
+// it from a failed query.
+class LocationNotFound : public std::runtime_error {
+public:
+    LocationNotFound() : std::runtime_error("Location not found") {}
+};
+
+// Rows of a resident snapshot answering a read. Holds the snapshot, so the
+// rows stay readable even if a rebuild replaces it meanwhile.
+struct SnapshotRows {
+    std::shared_ptr<const LocationSnapshot> snapshot;
+    std::vector<uint32_t> rows;
+};
+
+// Receives the rows of an async query, or the error it failed with (rows is
+// then null). The rows are only valid during the call.
+using RowsCallback = std::function<void(const LocationRows* rows, std::exception_ptr error)>;
+
+// Service class for reading locations. Queries go to a LocationStore (the
+// database, normally); top-N lists and by-id lookups are read through an
+// in-process cache, and a resident snapshot can answer most reads outright.
 class LocationService {
 private:
-    PGconn* conn;
-    mutable std::mutex db_mutex_;
-    std::string sanitizeString(const std::string& input) const;
-    Location rowToLocation(const PGResultWrapper& res, int row) const;
+    std::shared_ptr<LocationStore> store_;
+    LocationServiceConfig config_;
+    ShardedLruCache<int, std::vector<Location>> topLocationsCache_;
+    ShardedLruCache<std::string, Location> locationByIdCache_;
+    std::atomic<uint64_t> dataVersion_{1};
+
+    std::shared_ptr<const SnapshotIndexes> indexes_;  // owns the snapshot; std::atomic_load/store
+    std::atomic<std::chrono::steady_clock::rep> snapshotSyncedAt_{0};
+    std::atomic<uint64_t> snapshotGeneration_{0};
+
+    std::vector<Location> queryTopLocations(int limit);
+    Location queryLocationById(const std::string& id);
+    std::shared_ptr<const SnapshotIndexes> freshIndex() const;
 
 public:
-    LocationService(PGconn* connection);
+    explicit LocationService(std::shared_ptr<LocationStore> store, LocationServiceConfig config = {});
     ~LocationService();
 
     // Location methods
-    std::vector<Location> getTopLocations(int limit);
-    Location getLocationById(const std::string& id);
-    std::vector<Location> searchLocations(const std::string& query);
+    std::shared_ptr<const std::vector<Location>> getTopLocations(int limit);
+    std::shared_ptr<const Location> getLocationById(const std::string& id);
+    // One entry per requested id, in order; nullptr where no location matched.
+    // Cache misses are fetched together in a single round-trip. `errors` is
+    // as for LocationStore::locationsByIds.
+    std::vector<std::shared_ptr<const Location>> getLocationsByIds(const std::vector<std::string>& ids,
+                                                                   std::vector<std::exception_ptr>* errors = nullptr);
+    LocationRows searchLocations(const std::string& query, FieldMask fields = LocationFields::All);
+    // Projected forms: the store is asked for `fields` only, so members
+    // outside them may be empty. Not cached here, as the full-row caches
+    // cannot answer them; cache the serialized response instead. The
+    // by-id form throws LocationNotFound rather than return no rows.
+    LocationRows getTopLocations(int limit, FieldMask fields);
+    LocationRows getLocationById(const std::string& id, FieldMask fields);
+    // Keyset pagination over the top list: the `limit` locations after the
+    // one with (afterRating, afterId), best rating first and ties by id. Not
+    // cached; the snapshot answers it when it can (topPageLocal).
+    LocationRows getTopLocationsAfter(double afterRating, const std::string& afterId, int limit);
+    // Answers from the resident snapshot, or nullopt if the caller should
+    // ask SQL (snapshot disabled or stale, or it cannot be sure of the
+    // answer, e.g. an id missing from a truncated snapshot). The by-id form
+    // throws LocationNotFound for an id a complete snapshot does not have
+    // (see snapshotComplete).
+    std::optional<SnapshotRows> topLocal(int limit) const;
+    std::optional<SnapshotRows> locationByIdLocal(const std::string& id) const;
+    std::optional<SnapshotRows> searchLocal(const std::string& query) const;
+    std::optional<SnapshotRows> topPageLocal(double afterRating, const std::string& afterId, int limit) const;
+    // The `limit` located rows nearest to the point and within maxKm,
+    // nearest first. There is no SQL form, so nullopt means the nearby
+    // search is unavailable (the snapshot is also nullopt when truncated).
+    std::optional<SnapshotRows> nearbyLocal(double latitude, double longitude, size_t limit, double maxKm) const;
+
+    // Snapshot maintenance, driven by SnapshotRefresher.
+    // Reads the whole table into a new (unpublished) snapshot. Both reads
+    // go to the primary when the store has replicas.
+    std::shared_ptr<const LocationSnapshot> loadSnapshot();
+    // Current rows for these ids straight from the store, nullptr for
+    // ids that no longer exist. Bypasses the caches.
+    std::vector<std::shared_ptr<const Location>> fetchLocationsByIds(const std::vector<std::string>& ids);
+    // Builds the search and geo indexes over `snapshot` and swaps them in atomically;
+    // readers keep whatever version they already loaded. Unless `synced`,
+    // it answers no reads until markSnapshotSynced(), e.g. a snapshot read
+    // back from a file, which the database has not confirmed.
+    void publishSnapshot(std::shared_ptr<const LocationSnapshot> snapshot, bool synced = true);
+    // Records that the published snapshot is known to match the database.
+    void markSnapshotSynced();
+    // True while the snapshot can answer reads.
+    bool snapshotFresh() const { return freshIndex() != nullptr; }
+    // The published snapshot, fresh or not; nullptr before the first one.
+    std::shared_ptr<const LocationSnapshot> currentSnapshot() const;
+    // Incremented by every publishSnapshot(). With dataVersion() it names
+    // the data a fresh snapshot answers with, e.g. for HTTP validators.
+    uint64_t snapshotGeneration() const { return snapshotGeneration_.load(std::memory_order_acquire); }
+
+    // Non-blocking forms of the reads above, if the store has them. The
+    // top-N and by-id forms go through the same coalesced caches as the
+    // blocking ones, so done runs on the calling thread for a hit and on
+    // the store's executor thread otherwise. Search is not cached.
+    bool hasAsync() const;
+    void topLocationsAsync(int limit, RowsCallback done);
+    void locationByIdAsync(const std::string& id, RowsCallback done);
+    void searchLocationsAsync(const std::string& query, RowsCallback done);
+
+    // Drops every cached result; the next read of each key goes to the
+    // database. The snapshot is bypassed until one built at the new version
+    // is published. Returns the new data version.
+    uint64_t invalidateCache();
+    // Drops only what a change to these ids can affect: their by-id entries
+    // and the top-N lists. The data version stays, so a snapshot built at it
+    // remains usable; response bodies turn over with its generation.
+    void invalidateLocations(const std::vector<std::string>& ids);
+    // Incremented by invalidateCache(), so caches layered on top of this
+    // service can tell their entries are from an older view of the data.
+    uint64_t dataVersion() const { return dataVersion_.load(std::memory_order_acquire); }
+
+    // Lookups answered and missed by the top-N and by-id caches together.
+    uint64_t cacheHits() const { return topLocationsCache_.hits() + locationByIdCache_.hits(); }
+    uint64_t cacheMisses() const { return topLocationsCache_.misses() + locationByIdCache_.misses(); }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,290 @@
+#include "LocationSnapshot.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+#include <stdexcept>
+#include <unordered_set>
+
+LocationSnapshot::LocationSnapshot(const LocationRows& rows, uint64_t dataVersion) : dataVersion_(dataVersion) {
+    build(std::vector<LocationView>(rows.begin(), rows.end()));
+}
+
+LocationSnapshot::LocationSnapshot(const std::vector<Location>& locations, uint64_t dataVersion)
+    : dataVersion_(dataVersion) {
+    std::vector<LocationView> rows;
+    rows.reserve(locations.size());
+    for (const auto& loc : locations) rows.push_back(LocationView::of(loc));
+    build(rows);
+}
+
+LocationSnapshot::LocationSnapshot(const LocationSnapshot& base, const std::vector<Location>& upserts,
+                                   const std::vector<std::string>& removed, uint64_t dataVersion)
+    : dataVersion_(dataVersion) {
+    std::unordered_set<std::string_view> dropped(removed.begin(), removed.end());
+    for (const auto& loc : upserts) dropped.insert(loc.id);
+
+    std::vector<LocationView> rows;
+    rows.reserve(base.size() + upserts.size());
+    for (uint32_t row = 0; row < base.size(); row++) {
+        LocationView view = base.view(row);
+        if (!dropped.count(view.id)) rows.push_back(view);
+    }
+    for (const auto& loc : upserts) rows.push_back(LocationView::of(loc));
+    build(rows);
+}
+
+// Sizes the arena first so it is allocated once. Spans are 32-bit, which
+// caps a snapshot at 4 GiB of text.
+void LocationSnapshot::build(const std::vector<LocationView>& rows) {
+    std::unordered_map<std::string_view, uint32_t> codes;  // keys point into rows, not the arena
+    size_t bytes = 0;
+    for (const auto& row : rows) {
+        bytes += row.id.size() + row.name.size() + row.description.size() + row.svg_link.size();
+        for (std::string_view value : {row.country, row.state}) {
+            if (codes.emplace(value, 0).second) bytes += value.size();
+        }
+    }
+    if (bytes > UINT32_MAX) throw std::runtime_error("Location snapshot too large");
+    codes.clear();
+    ownedArena_.reserve(bytes);
+
+    auto append = [this](std::string_view value) {
+        Span span{static_cast<uint32_t>(ownedArena_.size()), static_cast<uint32_t>(value.size())};
+        ownedArena_.append(value);
+        return span;
+    };
+    auto intern = [&](std::string_view value) {
+        auto [it, inserted] = codes.emplace(value, static_cast<uint32_t>(dictionary_.size()));
+        if (inserted) dictionary_.push_back(append(value));
+        return it->second;
+    };
+
+    size_t n = rows.size();
+    ids_.reserve(n);
+    names_.reserve(n);
+    descriptions_.reserve(n);
+    svgLinks_.reserve(n);
+    countries_.reserve(n);
+    states_.reserve(n);
+    ratings_.reserve(n);
+    latitudes_.reserve(n);
+    longitudes_.reserve(n);
+    for (const auto& row : rows) {
+        ids_.push_back(append(row.id));
+        names_.push_back(append(row.name));
+        descriptions_.push_back(append(row.description));
+        svgLinks_.push_back(append(row.svg_link));
+        countries_.push_back(intern(row.country));
+        states_.push_back(intern(row.state));
+        ratings_.push_back(row.rating);
+        latitudes_.push_back(row.latitude);
+        longitudes_.push_back(row.longitude);
+    }
+
+    arena_ = ownedArena_;
+    byRating_.resize(n);
+    std::iota(byRating_.begin(), byRating_.end(), 0);
+    // NaN ratings (a text result can carry one) go last, so the order stays
+    // a strict weak one.
+    std::stable_sort(byRating_.begin(), byRating_.end(), [this](uint32_t a, uint32_t b) {
+        bool nanA = std::isnan(ratings_[a]), nanB = std::isnan(ratings_[b]);
+        if (nanA != nanB) return nanB;
+        if (!nanA && ratings_[a] != ratings_[b]) return ratings_[a] > ratings_[b];
+        return text(ids_[a]) < text(ids_[b]);
+    });
+    indexIds();
+}
+
+void LocationSnapshot::indexIds() {
+    rowById_.reserve(ids_.size());
+    for (uint32_t row = 0; row < ids_.size(); row++) rowById_.emplace(text(ids_[row]), row);
+}
+
+LocationView LocationSnapshot::view(uint32_t row) const {
+    return {text(ids_[row]),
+            text(names_[row]),
+            text(dictionary_[countries_[row]]),
+            text(dictionary_[states_[row]]),
+            text(descriptions_[row]),
+            text(svgLinks_[row]),
+            ratings_[row],
+            latitudes_[row],
+            longitudes_[row]};
+}
+
+std::optional<uint32_t> LocationSnapshot::find(std::string_view id) const {
+    auto it = rowById_.find(id);
+    if (it == rowById_.end()) return std::nullopt;
+    return it->second;
+}
+
+std::vector<uint32_t> LocationSnapshot::top(size_t limit) const {
+    return std::vector<uint32_t>(byRating_.begin(), byRating_.begin() + std::min(limit, byRating_.size()));
+}
+
+size_t LocationSnapshot::rankAfter(double rating, std::string_view id) const {
+    bool nanRating = std::isnan(rating);
+    auto it = std::partition_point(byRating_.begin(), byRating_.end(), [&](uint32_t row) {
+        if (nanRating) return !std::isnan(ratings_[row]) || text(ids_[row]) <= id;
+        return ratings_[row] > rating || (ratings_[row] == rating && text(ids_[row]) <= id);
+    });
+    return it - byRating_.begin();
+}
+
+size_t LocationSnapshot::memoryUsage() const {
+    return ownedArena_.capacity() +
+           (ids_.capacity() + names_.capacity() + descriptions_.capacity() + svgLinks_.capacity() +
+            dictionary_.capacity()) * sizeof(Span) +
+           (countries_.capacity() + states_.capacity() + byRating_.capacity()) * sizeof(uint32_t) +
+           (ratings_.capacity() + latitudes_.capacity() + longitudes_.capacity()) * sizeof(double) +
+           rowById_.size() * (sizeof(std::string_view) + sizeof(uint32_t) + 2 * sizeof(void*));
+}
+
+namespace {
+
+// On-disk layout: this header, the columns in declaration order below, then
+// the arena. Native byte order; the file is a cache for the same binary on
+// the same host, not an interchange format.
+struct FileHeader {
+    char magic[8];
+    uint32_t format;
+    uint32_t rows;
+    uint32_t dictionary;
+    uint32_t reserved;
+    uint64_t arenaBytes;
+};
+
+constexpr char FileMagic[8] = {'L', 'O', 'C', 'S', 'N', 'A', 'P', '\0'};
+constexpr uint32_t FileFormat = 3;
+
+template <typename T>
+void writeColumn(std::ofstream& out, const std::vector<T>& column) {
+    out.write(reinterpret_cast<const char*>(column.data()), column.size() * sizeof(T));
+}
+
+// Bounds-checked reader over the mapped bytes.
+class Cursor {
+private:
+    const char* data_;
+    size_t size_;
+    size_t offset_ = 0;
+
+public:
+    Cursor(const char* data, size_t size) : data_(data), size_(size) {}
+
+    const char* take(size_t bytes) {
+        if (bytes > size_ - offset_) throw std::runtime_error("Snapshot file is truncated");
+        const char* at = data_ + offset_;
+        offset_ += bytes;
+        return at;
+    }
+
+    template <typename T>
+    void column(std::vector<T>& out, size_t count) {
+        out.resize(count);
+        std::memcpy(out.data(), take(count * sizeof(T)), count * sizeof(T));
+    }
+
+    bool atEnd() const { return offset_ == size_; }
+};
+
+}
+
+void LocationSnapshot::writeTo(const std::string& path) const {
+    std::string temp = path + ".tmp";
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        if (!out) throw std::runtime_error("Cannot write " + temp + ": " + std::strerror(errno));
+        FileHeader header{};
+        std::memcpy(header.magic, FileMagic, sizeof(FileMagic));
+        header.format = FileFormat;
+        header.rows = static_cast<uint32_t>(size());
+        header.dictionary = static_cast<uint32_t>(dictionary_.size());
+        header.arenaBytes = arena_.size();
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        writeColumn(out, ratings_);
+        writeColumn(out, latitudes_);
+        writeColumn(out, longitudes_);
+        writeColumn(out, ids_);
+        writeColumn(out, names_);
+        writeColumn(out, descriptions_);
+        writeColumn(out, svgLinks_);
+        writeColumn(out, countries_);
+        writeColumn(out, states_);
+        writeColumn(out, byRating_);
+        writeColumn(out, dictionary_);
+        out.write(arena_.data(), arena_.size());
+        out.flush();
+        if (!out) throw std::runtime_error("Cannot write " + temp + ": " + std::strerror(errno));
+    }
+    if (std::rename(temp.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error("Cannot replace " + path + ": " + std::strerror(errno));
+    }
+}
+
+std::shared_ptr<const LocationSnapshot> LocationSnapshot::mapFrom(const std::string& path, uint64_t dataVersion) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) throw std::runtime_error("Cannot open " + path + ": " + std::strerror(errno));
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(FileHeader))) {
+        ::close(fd);
+        throw std::runtime_error("Snapshot file is truncated");
+    }
+    size_t length = static_cast<size_t>(info.st_size);
+    void* addr = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) throw std::runtime_error("Cannot map " + path + ": " + std::strerror(errno));
+    std::shared_ptr<const void> mapping(addr, [length](const void* p) { ::munmap(const_cast<void*>(p), length); });
+
+    Cursor cursor(static_cast<const char*>(addr), length);
+    FileHeader header;
+    std::memcpy(&header, cursor.take(sizeof(header)), sizeof(header));
+    if (std::memcmp(header.magic, FileMagic, sizeof(FileMagic)) != 0 || header.format != FileFormat) {
+        throw std::runtime_error("Not a location snapshot file: " + path);
+    }
+
+    std::shared_ptr<LocationSnapshot> snapshot(new LocationSnapshot(dataVersion));
+    size_t n = header.rows;
+    cursor.column(snapshot->ratings_, n);
+    cursor.column(snapshot->latitudes_, n);
+    cursor.column(snapshot->longitudes_, n);
+    cursor.column(snapshot->ids_, n);
+    cursor.column(snapshot->names_, n);
+    cursor.column(snapshot->descriptions_, n);
+    cursor.column(snapshot->svgLinks_, n);
+    cursor.column(snapshot->countries_, n);
+    cursor.column(snapshot->states_, n);
+    cursor.column(snapshot->byRating_, n);
+    cursor.column(snapshot->dictionary_, header.dictionary);
+    snapshot->arena_ = std::string_view(cursor.take(header.arenaBytes), header.arenaBytes);
+    if (!cursor.atEnd()) throw std::runtime_error("Snapshot file has trailing bytes");
+
+    // Everything indexes into something else; check it all once here so
+    // reads never have to.
+    auto spanOk = [&](const Span& span) {
+        return span.offset <= header.arenaBytes && span.length <= header.arenaBytes - span.offset;
+    };
+    for (const auto* column : {&snapshot->ids_, &snapshot->names_, &snapshot->descriptions_, &snapshot->svgLinks_,
+                               &snapshot->dictionary_}) {
+        if (!std::all_of(column->begin(), column->end(), spanOk)) throw std::runtime_error("Snapshot file is corrupt");
+    }
+    auto codeOk = [&](uint32_t code) { return code < header.dictionary; };
+    auto rowOk = [&](uint32_t row) { return row < n; };
+    if (!std::all_of(snapshot->countries_.begin(), snapshot->countries_.end(), codeOk) ||
+        !std::all_of(snapshot->states_.begin(), snapshot->states_.end(), codeOk) ||
+        !std::all_of(snapshot->byRating_.begin(), snapshot->byRating_.end(), rowOk)) {
+        throw std::runtime_error("Snapshot file is corrupt");
+    }
+
+    snapshot->mapping_ = std::move(mapping);
+    snapshot->indexIds();
+    return snapshot;
+}
@@ -0,0 +1,89 @@
+#ifndef LOCATION_SNAPSHOT_H
+#define LOCATION_SNAPSHOT_H
+
+#include "LocationService.h"
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Read-only, columnar copy of the locations table. All string bytes live in
+// one arena; country and state are dictionary-coded, since a handful of
+// values repeat across every row; rating is a plain double column; and a
+// rating-sorted permutation (ties by id) is computed once so top-N is a
+// prefix.
+//
+// Rows are addressed by index. view() returns string_views into the arena,
+// valid for the snapshot's lifetime. Held through shared_ptr and never
+// moved, so those views (and the id index built on them) stay put.
+class LocationSnapshot {
+private:
+    struct Span {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    std::string ownedArena_;
+    std::shared_ptr<const void> mapping_;  // set when the arena is a mapped file
+    std::string_view arena_;               // ownedArena_ or part of mapping_
+    std::vector<Span> ids_;
+    std::vector<Span> names_;
+    std::vector<Span> descriptions_;
+    std::vector<Span> svgLinks_;
+    std::vector<uint32_t> countries_;  // codes into dictionary_
+    std::vector<uint32_t> states_;
+    std::vector<double> ratings_;
+    std::vector<double> latitudes_;   // NoCoordinate where unknown
+    std::vector<double> longitudes_;
+    std::vector<Span> dictionary_;
+    std::vector<uint32_t> byRating_;  // row indices, best rating first, then by id
+    std::unordered_map<std::string_view, uint32_t> rowById_;
+    uint64_t dataVersion_;
+
+    std::string_view text(Span span) const { return {arena_.data() + span.offset, span.length}; }
+    explicit LocationSnapshot(uint64_t dataVersion) : dataVersion_(dataVersion) {}
+    void build(const std::vector<LocationView>& rows);
+    void indexIds();
+
+public:
+    LocationSnapshot(const LocationRows& rows, uint64_t dataVersion);
+    LocationSnapshot(const std::vector<Location>& locations, uint64_t dataVersion);
+    // Copy-on-write update: base's rows minus `removed` ids, with `upserts`
+    // replacing or adding rows by id. base is left untouched.
+    LocationSnapshot(const LocationSnapshot& base, const std::vector<Location>& upserts,
+                     const std::vector<std::string>& removed, uint64_t dataVersion);
+    LocationSnapshot(const LocationSnapshot&) = delete;
+    LocationSnapshot& operator=(const LocationSnapshot&) = delete;
+
+    size_t size() const { return ratings_.size(); }
+    LocationView view(uint32_t row) const;
+    double rating(uint32_t row) const { return ratings_[row]; }
+    double latitude(uint32_t row) const { return latitudes_[row]; }
+    double longitude(uint32_t row) const { return longitudes_[row]; }
+    std::optional<uint32_t> find(std::string_view id) const;
+
+    // Row indices of the best `limit` locations, best first. The whole range
+    // of byRating order is available as rankedRow(0 .. size()-1).
+    std::vector<uint32_t> top(size_t limit) const;
+    uint32_t rankedRow(size_t rank) const { return byRating_[rank]; }
+    // Rank of the first row ordered after (rating, id), for keyset paging.
+    size_t rankAfter(double rating, std::string_view id) const;
+
+    uint64_t dataVersion() const { return dataVersion_; }
+    // Heap bytes held by the columns, for logging. A mapped arena is not
+    // counted.
+    size_t memoryUsage() const;
+
+    // Writes the snapshot to `path` (via a temporary file and rename, so a
+    // crash never leaves a torn file). Throws on I/O errors.
+    void writeTo(const std::string& path) const;
+    // Maps a file written by writeTo(). The string arena is used in place
+    // from the mapping; the fixed-size columns are copied out. Throws if
+    // the file is missing, truncated or not a snapshot.
+    static std::shared_ptr<const LocationSnapshot> mapFrom(const std::string& path, uint64_t dataVersion);
+};
+
+#endif
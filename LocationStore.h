@@ -0,0 +1,53 @@
+#ifndef LOCATION_STORE_H
+#define LOCATION_STORE_H
+
+#include "LocationService.h"
+#include <exception>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Where LocationService reads locations from: the database
+// (PgLocationStore) or a list held in memory (MemoryLocationStore). The
+// service layers its caches and the resident snapshot on top, so a store
+// only answers queries. Orders match get_top_locations: best rating
+// first, ties by id. `fields` lets a store read fewer columns; rows may
+// still carry more than were asked for, and id is always filled in.
+class LocationStore {
+public:
+    virtual ~LocationStore() = default;
+
+    // The best `limit` locations.
+    virtual LocationRows topLocations(int limit, FieldMask fields = LocationFields::All) = 0;
+    // The location with this id, or no rows.
+    virtual LocationRows locationById(const std::string& id, FieldMask fields = LocationFields::All) = 0;
+    // One entry per requested id, in order; nullptr where no location
+    // matched. Meant to cost a single round-trip. With `errors`, a lookup
+    // that fails on its own (a malformed id, say) leaves its entry null and
+    // its error in (*errors)[i] (which gets one slot per id) instead of
+    // failing the rest; losing the database still throws.
+    virtual std::vector<std::shared_ptr<const Location>> locationsByIds(
+        const std::vector<std::string>& ids, std::vector<std::exception_ptr>* errors = nullptr) = 0;
+    virtual LocationRows searchLocations(const std::string& query, FieldMask fields = LocationFields::All) = 0;
+    // The `limit` locations ordered after the one with (afterRating, afterId).
+    virtual LocationRows topLocationsAfter(double afterRating, const std::string& afterId, int limit) = 0;
+
+    // topLocations and locationsByIds for the resident snapshot's full
+    // loads and deltas. These must see the authoritative copy, the one
+    // change notifications and poll watermarks come from, so a store with
+    // read replicas answers them from the primary.
+    virtual LocationRows snapshotTopLocations(int limit) { return topLocations(limit); }
+    virtual std::vector<std::shared_ptr<const Location>> snapshotLocationsByIds(const std::vector<std::string>& ids) {
+        return locationsByIds(ids);
+    }
+
+    // Non-blocking forms of the reads above, available when hasAsync().
+    // done may run on another thread, or before the call returns.
+    virtual bool hasAsync() const = 0;
+    virtual void topLocationsAsync(int limit, RowsCallback done) = 0;
+    virtual void locationByIdAsync(const std::string& id, RowsCallback done) = 0;
+    virtual void searchLocationsAsync(const std::string& query, RowsCallback done) = 0;
+};
+
+#endif
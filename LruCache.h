@@ -0,0 +1,238 @@
+#ifndef LRU_CACHE_H
+#define LRU_CACHE_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct LruCacheConfig {
+    size_t capacity = 1024;  // total entries across all shards
+    std::chrono::milliseconds ttl{30000};
+    size_t shards = 16;
+};
+
+// Sharded, size-bounded LRU cache with a TTL and request coalescing: while a
+// key is being loaded, concurrent getOrLoad (or getOrLoadAsync) calls for it
+// wait on the same load instead of each running the loader.
+template <typename Key, typename T, typename Hash = std::hash<Key>>
+class ShardedLruCache {
+public:
+    using Value = std::shared_ptr<const T>;
+    // Receives a loaded value, or the error its load failed with.
+    using Callback = std::function<void(Value value, std::exception_ptr error)>;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        Key key;
+        Value value;
+        Clock::time_point expires;
+    };
+
+    // A load in flight: blocking callers wait on the future, async ones
+    // leave a callback.
+    struct Loading {
+        std::promise<Value> promise;
+        std::shared_future<Value> future;
+        std::vector<Callback> waiters;
+    };
+
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        std::list<Entry> lru;  // most recently used at the front
+        std::unordered_map<Key, typename std::list<Entry>::iterator, Hash> index;
+        std::unordered_map<Key, Loading, Hash> loading;
+        uint64_t generation = 0;  // bumped on invalidation so in-flight loads are not stored
+    };
+
+    LruCacheConfig config_;
+    std::unique_ptr<Shard[]> shards_;
+    size_t shardMask_;
+    size_t shardCapacity_;
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+
+    Shard& shardFor(const Key& key) const { return shards_[Hash{}(key) & shardMask_]; }
+
+    // Caller holds the shard lock.
+    Value lookup(Shard& shard, const Key& key) {
+        auto it = shard.index.find(key);
+        if (it == shard.index.end()) return nullptr;
+        if (Clock::now() >= it->second->expires) {
+            shard.lru.erase(it->second);
+            shard.index.erase(it);
+            return nullptr;
+        }
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        return it->second->value;
+    }
+
+    // Caller holds the shard lock.
+    void store(Shard& shard, const Key& key, Value value) {
+        auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            shard.lru.erase(it->second);
+            shard.index.erase(it);
+        }
+        shard.lru.push_front(Entry{key, std::move(value), Clock::now() + config_.ttl});
+        shard.index.emplace(key, shard.lru.begin());
+        while (shard.lru.size() > shardCapacity_) {
+            shard.index.erase(shard.lru.back().key);
+            shard.lru.pop_back();
+        }
+    }
+
+    // Hands the outcome of the load of `key` to everyone waiting on it.
+    // The value is only stored if no invalidation ran meanwhile.
+    void finish(Shard& shard, const Key& key, uint64_t generation, Value value, std::exception_ptr error) {
+        Loading loading;
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.loading.find(key);
+            loading = std::move(it->second);
+            shard.loading.erase(it);
+            if (!error && shard.generation == generation) store(shard, key, value);
+        }
+        if (error) {
+            loading.promise.set_exception(error);
+        } else {
+            loading.promise.set_value(value);
+        }
+        for (auto& waiter : loading.waiters) waiter(value, error);
+    }
+
+    // Caller holds the shard lock and has checked no load of `key` is in flight.
+    Loading& startLoad(Shard& shard, const Key& key) {
+        Loading& loading = shard.loading[key];
+        loading.future = loading.promise.get_future().share();
+        return loading;
+    }
+
+public:
+    explicit ShardedLruCache(LruCacheConfig config = {}) : config_(config) {
+        size_t shards = 1;
+        while (shards < std::max<size_t>(config_.shards, 1)) shards <<= 1;
+        shards_ = std::make_unique<Shard[]>(shards);
+        shardMask_ = shards - 1;
+        shardCapacity_ = std::max<size_t>(1, (config_.capacity + shards - 1) / shards);
+    }
+
+    Value get(const Key& key) {
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        Value value = lookup(shard, key);
+        (value ? hits_ : misses_).fetch_add(1, std::memory_order_relaxed);
+        return value;
+    }
+
+    void put(const Key& key, Value value) {
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        store(shard, key, std::move(value));
+    }
+
+    // Returns the cached value, or runs loader() once for all concurrent
+    // callers missing on the same key. Loader exceptions propagate to every
+    // waiter and nothing is cached.
+    template <typename Loader>
+    Value getOrLoad(const Key& key, Loader&& loader) {
+        Shard& shard = shardFor(key);
+        uint64_t generation;
+        {
+            std::unique_lock<std::mutex> lock(shard.mutex);
+            if (Value value = lookup(shard, key)) {
+                hits_.fetch_add(1, std::memory_order_relaxed);
+                return value;
+            }
+            misses_.fetch_add(1, std::memory_order_relaxed);
+            auto inflight = shard.loading.find(key);
+            if (inflight != shard.loading.end()) {
+                std::shared_future<Value> pending = inflight->second.future;
+                lock.unlock();
+                return pending.get();
+            }
+            startLoad(shard, key);
+            generation = shard.generation;
+        }
+
+        Value value;
+        try {
+            value = std::make_shared<const T>(loader());
+        } catch (...) {
+            finish(shard, key, generation, nullptr, std::current_exception());
+            throw;
+        }
+        finish(shard, key, generation, value, nullptr);
+        return value;
+    }
+
+    // Non-blocking getOrLoad: `done` runs on this thread for a hit, and
+    // wherever the load completes otherwise. loader(complete) starts the
+    // load and must either call complete(value, error) once, from any
+    // thread, or throw without calling it.
+    template <typename Loader>
+    void getOrLoadAsync(const Key& key, Loader&& loader, Callback done) {
+        Shard& shard = shardFor(key);
+        uint64_t generation;
+        {
+            std::unique_lock<std::mutex> lock(shard.mutex);
+            if (Value value = lookup(shard, key)) {
+                hits_.fetch_add(1, std::memory_order_relaxed);
+                lock.unlock();
+                done(std::move(value), nullptr);
+                return;
+            }
+            misses_.fetch_add(1, std::memory_order_relaxed);
+            auto inflight = shard.loading.find(key);
+            if (inflight != shard.loading.end()) {
+                inflight->second.waiters.push_back(std::move(done));
+                return;
+            }
+            startLoad(shard, key).waiters.push_back(std::move(done));
+            generation = shard.generation;
+        }
+
+        try {
+            loader([this, &shard, key, generation](Value value, std::exception_ptr error) {
+                finish(shard, key, generation, std::move(value), error);
+            });
+        } catch (...) {
+            finish(shard, key, generation, nullptr, std::current_exception());
+        }
+    }
+
+    void invalidate(const Key& key) {
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(key);
+        shard.generation++;
+        if (it == shard.index.end()) return;
+        shard.lru.erase(it->second);
+        shard.index.erase(it);
+    }
+
+    void clear() {
+        for (size_t i = 0; i <= shardMask_; i++) {
+            std::lock_guard<std::mutex> lock(shards_[i].mutex);
+            shards_[i].lru.clear();
+            shards_[i].index.clear();
+            shards_[i].generation++;
+        }
+    }
+
+    uint64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+    uint64_t misses() const { return misses_.load(std::memory_order_relaxed); }
+};
+
+#endif
@@ -0,0 +1,138 @@
+#include "MemoryLocationStore.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <string_view>
+
+namespace {
+
+// The snapshot's order: NaN ratings last.
+bool rankedBefore(const Location& a, const Location& b) {
+    bool nanA = std::isnan(a.rating), nanB = std::isnan(b.rating);
+    if (nanA != nanB) return nanB;
+    if (!nanA && a.rating != b.rating) return a.rating > b.rating;
+    return a.id < b.id;
+}
+
+bool containsFolded(std::string_view text, std::string_view needle) {
+    auto equal = [](char a, char b) {
+        return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+    };
+    return std::search(text.begin(), text.end(), needle.begin(), needle.end(), equal) != text.end();
+}
+
+template <typename Query>
+void runInline(Query&& query, const RowsCallback& done) {
+    std::optional<LocationRows> rows;
+    std::exception_ptr error;
+    try {
+        rows.emplace(query());
+    } catch (...) {
+        error = std::current_exception();
+    }
+    done(rows ? &*rows : nullptr, error);
+}
+
+}
+
+MemoryLocationStore::MemoryLocationStore(std::vector<Location> locations) : byRating_(std::move(locations)) {
+    std::sort(byRating_.begin(), byRating_.end(), rankedBefore);
+    reindex();
+}
+
+void MemoryLocationStore::reindex() {
+    rowById_.clear();
+    rowById_.reserve(byRating_.size());
+    for (size_t i = 0; i < byRating_.size(); i++) rowById_[byRating_[i].id] = i;
+}
+
+// Copies, so the rows stay valid after the lock is released.
+LocationRows MemoryLocationStore::rows(size_t begin, size_t end) const {
+    end = std::min(end, byRating_.size());
+    begin = std::min(begin, end);
+    return LocationRows(std::vector<Location>(byRating_.begin() + begin, byRating_.begin() + end));
+}
+
+size_t MemoryLocationStore::size() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return byRating_.size();
+}
+
+void MemoryLocationStore::upsert(Location location) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    auto it = rowById_.find(location.id);
+    if (it != rowById_.end()) byRating_.erase(byRating_.begin() + it->second);
+    byRating_.insert(std::upper_bound(byRating_.begin(), byRating_.end(), location, rankedBefore), std::move(location));
+    reindex();
+}
+
+bool MemoryLocationStore::remove(const std::string& id) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    auto it = rowById_.find(id);
+    if (it == rowById_.end()) return false;
+    byRating_.erase(byRating_.begin() + it->second);
+    reindex();
+    return true;
+}
+
+LocationRows MemoryLocationStore::topLocations(int limit, FieldMask) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return rows(0, static_cast<size_t>(std::max(limit, 0)));
+}
+
+LocationRows MemoryLocationStore::locationById(const std::string& id, FieldMask) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto it = rowById_.find(id);
+    if (it == rowById_.end()) return LocationRows(std::vector<Location>{});
+    return rows(it->second, it->second + 1);
+}
+
+std::vector<std::shared_ptr<const Location>> MemoryLocationStore::locationsByIds(
+    const std::vector<std::string>& ids, std::vector<std::exception_ptr>* errors) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    if (errors) errors->assign(ids.size(), nullptr);
+    std::vector<std::shared_ptr<const Location>> locations(ids.size());
+    for (size_t i = 0; i < ids.size(); i++) {
+        auto it = rowById_.find(ids[i]);
+        if (it != rowById_.end()) locations[i] = std::make_shared<const Location>(byRating_[it->second]);
+    }
+    return locations;
+}
+
+LocationRows MemoryLocationStore::searchLocations(const std::string& query, FieldMask) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    std::vector<Location> matches;
+    for (const auto& loc : byRating_) {
+        if (containsFolded(loc.name, query) || containsFolded(loc.country, query) ||
+            containsFolded(loc.state, query) || containsFolded(loc.description, query)) {
+            matches.push_back(loc);
+        }
+    }
+    return LocationRows(std::move(matches));
+}
+
+LocationRows MemoryLocationStore::topLocationsAfter(double afterRating, const std::string& afterId, int limit) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    Location cursor;
+    cursor.id = afterId;
+    cursor.rating = afterRating;
+    auto begin = std::partition_point(byRating_.begin(), byRating_.end(),
+                                      [&](const Location& loc) { return !rankedBefore(cursor, loc); });
+    size_t first = static_cast<size_t>(begin - byRating_.begin());
+    return rows(first, first + static_cast<size_t>(std::max(limit, 0)));
+}
+
+void MemoryLocationStore::topLocationsAsync(int limit, RowsCallback done) {
+    runInline([&] { return topLocations(limit); }, done);
+}
+
+void MemoryLocationStore::locationByIdAsync(const std::string& id, RowsCallback done) {
+    runInline([&] { return locationById(id); }, done);
+}
+
+void MemoryLocationStore::searchLocationsAsync(const std::string& query, RowsCallback done) {
+    runInline([&] { return searchLocations(query); }, done);
+}
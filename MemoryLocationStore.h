@@ -0,0 +1,46 @@
+#ifndef MEMORY_LOCATION_STORE_H
+#define MEMORY_LOCATION_STORE_H
+
+#include "LocationStore.h"
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// LocationStore over a list held in memory, for benchmarks and for running
+// the server with no database. Search is an ASCII case-insensitive
+// substring match on name, country, state or description. Rows always
+// carry every field. The async forms run inline, calling done before they
+// return.
+class MemoryLocationStore : public LocationStore {
+private:
+    mutable std::shared_mutex mutex_;
+    std::vector<Location> byRating_;  // best rating first, then by id
+    std::unordered_map<std::string, size_t> rowById_;
+
+    void reindex();
+    LocationRows rows(size_t begin, size_t end) const;
+
+public:
+    explicit MemoryLocationStore(std::vector<Location> locations = {});
+
+    size_t size() const;
+    // Adds the location, or replaces the one with the same id.
+    void upsert(Location location);
+    // Returns false if no location had this id.
+    bool remove(const std::string& id);
+
+    LocationRows topLocations(int limit, FieldMask fields = LocationFields::All) override;
+    LocationRows locationById(const std::string& id, FieldMask fields = LocationFields::All) override;
+    std::vector<std::shared_ptr<const Location>> locationsByIds(
+        const std::vector<std::string>& ids, std::vector<std::exception_ptr>* errors = nullptr) override;
+    LocationRows searchLocations(const std::string& query, FieldMask fields = LocationFields::All) override;
+    LocationRows topLocationsAfter(double afterRating, const std::string& afterId, int limit) override;
+
+    bool hasAsync() const override { return true; }
+    void topLocationsAsync(int limit, RowsCallback done) override;
+    void locationByIdAsync(const std::string& id, RowsCallback done) override;
+    void searchLocationsAsync(const std::string& query, RowsCallback done) override;
+};
+
+#endif
@@ -0,0 +1,223 @@
+#include "Metrics.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+constexpr size_t MaxCounters = 256;
+constexpr size_t MaxHistograms = 48;
+constexpr int SubBucketBits = 3;  // 8 buckets per power of two
+constexpr size_t Buckets = 273;   // the last one takes everything from 2^36ns (~68s) up
+constexpr int FirstExportedPower = 10;  // ~1us
+constexpr int LastExportedPower = 36;
+
+size_t bucketOf(uint64_t ns) {
+    if (ns < (2u << SubBucketBits)) return ns;
+    int msb = 63 - __builtin_clzll(ns);
+    int shift = msb - SubBucketBits;
+    size_t bucket = (shift + 1) * (1u << SubBucketBits) + ((ns >> shift) & ((1u << SubBucketBits) - 1));
+    return std::min(bucket, Buckets - 1);
+}
+
+// First bucket holding values of at least 2^power ns.
+size_t firstBucketOfPower(int power) { return (power - SubBucketBits + 1) * (1u << SubBucketBits); }
+
+// Slots written by a single thread. Zero-initialized through new Block().
+struct Block {
+    std::atomic<uint64_t> counters[MaxCounters];
+    struct {
+        std::atomic<uint64_t> buckets[Buckets];
+        std::atomic<uint64_t> sumNs;
+    } histograms[MaxHistograms];
+};
+
+// Only the owning thread writes, so a relaxed load and store is enough.
+void bump(std::atomic<uint64_t>& slot, uint64_t n) {
+    slot.store(slot.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+enum class Kind { Counter, Histogram, Observed };
+
+struct Series {
+    std::string name;
+    std::string help;
+    std::string labels;
+    Kind kind;
+    size_t slot;
+    bool counter = true;  // Observed only: exported as a counter rather than a gauge
+    std::function<double()> read;
+};
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<Series> series;
+    size_t counters = 0;
+    size_t histograms = 0;
+    std::vector<Block*> live;
+    Block retired{};  // totals of threads that have exited
+
+    size_t add(const std::string& name, const std::string& help, const std::string& labels, Kind kind) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& s : series) {
+            if (s.name == name && s.labels == labels && s.kind == kind) return s.slot;
+        }
+        size_t& used = kind == Kind::Counter ? counters : histograms;
+        if (used == (kind == Kind::Counter ? MaxCounters : MaxHistograms)) {
+            throw std::runtime_error("Too many metrics registered; raise the limit in Metrics.cpp");
+        }
+        series.push_back(Series{name, help, labels, kind, used, true, nullptr});
+        return used++;
+    }
+};
+
+Registry& registry() {
+    static Registry* instance = new Registry;  // never destroyed: threads may still record at exit
+    return *instance;
+}
+
+void mergeInto(Block& into, const Block& from) {
+    for (size_t i = 0; i < MaxCounters; i++) bump(into.counters[i], from.counters[i].load(std::memory_order_relaxed));
+    for (size_t h = 0; h < MaxHistograms; h++) {
+        for (size_t b = 0; b < Buckets; b++) {
+            bump(into.histograms[h].buckets[b], from.histograms[h].buckets[b].load(std::memory_order_relaxed));
+        }
+        bump(into.histograms[h].sumNs, from.histograms[h].sumNs.load(std::memory_order_relaxed));
+    }
+}
+
+struct ThreadBlock {
+    Block* block = new Block();
+
+    ThreadBlock() {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        r.live.push_back(block);
+    }
+
+    ~ThreadBlock() {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        mergeInto(r.retired, *block);
+        r.live.erase(std::find(r.live.begin(), r.live.end(), block));
+        delete block;
+    }
+};
+
+Block& localBlock() {
+    thread_local ThreadBlock local;
+    return *local.block;
+}
+
+void appendNumber(std::string& out, double value, int digits = 17) {
+    char buf[32];
+    int n = std::snprintf(buf, sizeof(buf), "%.*g", digits, value);
+    out.append(buf, n);
+}
+
+void appendSample(std::string& out, const std::string& name, const char* suffix, const std::string& labels,
+                  const std::string& extraLabel, double value) {
+    out += name;
+    out += suffix;
+    if (!labels.empty() || !extraLabel.empty()) {
+        out += '{';
+        out += labels;
+        if (!labels.empty() && !extraLabel.empty()) out += ',';
+        out += extraLabel;
+        out += '}';
+    }
+    out += ' ';
+    appendNumber(out, value);
+    out += '\n';
+}
+
+}
+
+namespace Metrics {
+
+Counter::Counter(const std::string& name, const std::string& help, const std::string& labels)
+    : slot_(registry().add(name, help, labels, Kind::Counter)) {}
+
+void Counter::inc(uint64_t n) const { bump(localBlock().counters[slot_], n); }
+
+Histogram::Histogram(const std::string& name, const std::string& help, const std::string& labels)
+    : slot_(registry().add(name, help, labels, Kind::Histogram)) {}
+
+void Histogram::record(std::chrono::nanoseconds elapsed) const {
+    uint64_t ns = elapsed.count() > 0 ? static_cast<uint64_t>(elapsed.count()) : 0;
+    auto& histogram = localBlock().histograms[slot_];
+    bump(histogram.buckets[bucketOf(ns)], 1);
+    bump(histogram.sumNs, ns);
+}
+
+void observe(const std::string& name, const std::string& help, const std::string& labels, bool counter,
+             std::function<double()> read) {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.series.push_back(Series{name, help, labels, Kind::Observed, 0, counter, std::move(read)});
+}
+
+// Observed values are read after the registry lock is dropped: a reader may
+// take a lock of its own (a pool's, say) whose holder can be waiting on the
+// registry to register a recording thread.
+std::string render() {
+    Registry& r = registry();
+    auto totals = std::make_unique<Block>();
+    std::vector<Series> series;
+    {
+        std::lock_guard<std::mutex> lock(r.mutex);
+        mergeInto(*totals, r.retired);
+        for (const Block* block : r.live) mergeInto(*totals, *block);
+        series = r.series;
+    }
+    std::vector<double> observed(series.size());
+    for (size_t i = 0; i < series.size(); i++) {
+        if (series[i].kind == Kind::Observed) observed[i] = series[i].read();
+    }
+
+    std::string out;
+    std::vector<bool> written(series.size(), false);
+    for (size_t i = 0; i < series.size(); i++) {
+        if (written[i]) continue;
+        const Series& first = series[i];
+        const char* type = first.kind == Kind::Histogram ? "histogram"
+                           : first.kind == Kind::Counter || first.counter ? "counter"
+                                                                          : "gauge";
+        out += "# HELP " + first.name + ' ' + first.help + '\n';
+        out += "# TYPE " + first.name + ' ' + type + '\n';
+
+        for (size_t j = i; j < series.size(); j++) {
+            const Series& s = series[j];
+            if (written[j] || s.name != first.name) continue;
+            written[j] = true;
+            if (s.kind == Kind::Counter) {
+                appendSample(out, s.name, "", s.labels, "", totals->counters[s.slot].load(std::memory_order_relaxed));
+            } else if (s.kind == Kind::Observed) {
+                appendSample(out, s.name, "", s.labels, "", observed[j]);
+            } else {
+                const auto& histogram = totals->histograms[s.slot];
+                uint64_t cumulative = 0;
+                size_t bucket = 0;
+                for (int power = FirstExportedPower; power <= LastExportedPower; power++) {
+                    for (size_t end = firstBucketOfPower(power); bucket < end; bucket++) {
+                        cumulative += histogram.buckets[bucket].load(std::memory_order_relaxed);
+                    }
+                    std::string le = "le=\"";
+                    appendNumber(le, static_cast<double>(uint64_t{1} << power) / 1e9, 6);
+                    appendSample(out, s.name, "_bucket", s.labels, le + '"', cumulative);
+                }
+                for (; bucket < Buckets; bucket++) cumulative += histogram.buckets[bucket].load(std::memory_order_relaxed);
+                appendSample(out, s.name, "_bucket", s.labels, "le=\"+Inf\"", cumulative);
+                appendSample(out, s.name, "_sum", s.labels, "", histogram.sumNs.load(std::memory_order_relaxed) / 1e9);
+                appendSample(out, s.name, "_count", s.labels, "", cumulative);
+            }
+        }
+    }
+    return out;
+}
+
+}
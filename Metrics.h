@@ -0,0 +1,68 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// Process-wide counters and latency histograms, rendered in the Prometheus
+// text format by render().
+//
+// Every recording thread writes to its own block of slots, so recording is
+// a plain load and store on a cache line no other thread writes: no lock,
+// no contended atomic. render() sums the blocks of live threads plus what
+// exited threads left behind. Metrics are registered up front; each one is
+// a small handle holding its slot index, and registering the same name and
+// labels twice returns the same slot.
+//
+// Histograms are log-linear over nanoseconds, eight buckets per power of
+// two (so within 12.5% of the true value) from 1ns up to about 68s, and are
+// exported with one cumulative bucket per power of two.
+namespace Metrics {
+    class Counter {
+    private:
+        size_t slot_;
+
+    public:
+        // labels is the inside of the braces, e.g. `method="getTopLocations"`.
+        Counter(const std::string& name, const std::string& help, const std::string& labels = "");
+        void inc(uint64_t n = 1) const;
+    };
+
+    class Histogram {
+    private:
+        size_t slot_;
+
+    public:
+        Histogram(const std::string& name, const std::string& help, const std::string& labels = "");
+        void record(std::chrono::nanoseconds elapsed) const;
+        void recordSince(std::chrono::steady_clock::time_point start) const {
+            record(std::chrono::steady_clock::now() - start);
+        }
+    };
+
+    // Records the time from construction to destruction.
+    class Timer {
+    private:
+        const Histogram& histogram_;
+        std::chrono::steady_clock::time_point start_ = std::chrono::steady_clock::now();
+
+    public:
+        explicit Timer(const Histogram& histogram) : histogram_(histogram) {}
+        ~Timer() { histogram_.recordSince(start_); }
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+    };
+
+    // Values read at scrape time, for numbers something else already keeps
+    // (pool sizes, cache hit counts). `counter` picks the exported type.
+    // read() runs outside the registry lock, so it may take other locks.
+    void observe(const std::string& name, const std::string& help, const std::string& labels, bool counter,
+                 std::function<double()> read);
+
+    std::string render();
+}
+
+#endif
@@ -0,0 +1,339 @@
+#include "PgLocationStore.h"
+#include "AsyncQueryExecutor.h"
+#include "ReplicaRouter.h"
+#include "Statements.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+
+namespace {
+
+// Statements that do not go through PooledConnection::execPrepared, timed
+// under the same metric.
+const Metrics::Histogram pipelinedByIdLatency{"db_statement_duration_seconds", "Prepared statement round-trip time",
+                                              "statement=\"location_by_id_pipeline\""};
+const Metrics::Histogram topPageLatency{"db_statement_duration_seconds", "Prepared statement round-trip time",
+                                        "statement=\"top_locations_after\""};
+const Metrics::Histogram projectedLatency{"db_statement_duration_seconds", "Prepared statement round-trip time",
+                                          "statement=\"projected\""};
+
+// Only counted when there are replicas to choose from.
+const char* const ReadsHelp = "Location reads by the server that answered them";
+const Metrics::Counter replicaReads{"db_location_reads_total", ReadsHelp, "target=\"replica\""};
+const Metrics::Counter primaryReads{"db_location_reads_total", ReadsHelp, "target=\"primary\""};
+
+std::runtime_error queryFailed(const PooledConnection& conn, const PGResultWrapper& res) {
+    // A hedged read's result may come from another connection than `conn`.
+    const char* message = res.get() ? PQresultErrorMessage(res.get()) : PQerrorMessage(conn.get());
+    return std::runtime_error("Query failed: " + std::string(message));
+}
+
+// The statement's query with its SELECT * narrowed to `columns`.
+std::string projectedSql(const PreparedStatement& statement, const std::string& columns) {
+    std::string sql = statement.sql;
+    sql.replace(sql.find('*'), 1, columns);
+    return sql;
+}
+
+}
+
+// Rolling estimate of one percentile of a statement's recent latencies: the
+// last Samples are kept in a ring and re-ranked every RankEvery records.
+// Also keeps the share of recent reads that were hedged, halving both
+// counts every Window reads, so hedging can be held to a budget.
+class LatencyQuantile {
+private:
+    static constexpr size_t Samples = 256;
+    static constexpr size_t RankEvery = 32;
+    static constexpr int64_t Window = 1024;
+
+    const double fraction_;
+    const int64_t maxHedgePercent_;
+    std::mutex mutex_;
+    std::array<int64_t, Samples> ring_{};
+    size_t recorded_ = 0;
+    std::atomic<int64_t> estimate_{0};
+    std::atomic<int64_t> reads_{0};
+    std::atomic<int64_t> hedges_{0};
+
+public:
+    LatencyQuantile(int percentile, int maxHedgePercent)
+        : fraction_(percentile / 100.0), maxHedgePercent_(maxHedgePercent) {}
+
+    // `elapsed` is the first attempt's latency only: the estimate is what
+    // hedging is measured against, so a hedge's faster answer must not pull
+    // it down.
+    void record(std::chrono::nanoseconds elapsed, bool hedged) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        int64_t reads = reads_.load(std::memory_order_relaxed) + 1;
+        int64_t hedges = hedges_.load(std::memory_order_relaxed) + (hedged ? 1 : 0);
+        if (reads >= Window) {
+            reads /= 2;
+            hedges /= 2;
+        }
+        reads_.store(reads, std::memory_order_relaxed);
+        hedges_.store(hedges, std::memory_order_relaxed);
+
+        ring_[recorded_++ % Samples] = elapsed.count();
+        if (recorded_ % RankEvery != 0) return;
+        size_t n = std::min(recorded_, Samples);
+        std::array<int64_t, Samples> ranked = ring_;
+        auto nth = ranked.begin() + static_cast<size_t>(fraction_ * static_cast<double>(n - 1));
+        std::nth_element(ranked.begin(), nth, ranked.begin() + n);
+        estimate_.store(*nth, std::memory_order_relaxed);
+    }
+
+    // Zero until the first RankEvery samples are in.
+    std::chrono::nanoseconds value() const {
+        return std::chrono::nanoseconds(estimate_.load(std::memory_order_relaxed));
+    }
+
+    // False while more than maxHedgePercent of recent reads were hedged, e.g.
+    // when the whole database is slow and a second copy only adds load.
+    bool mayHedge() const {
+        return hedges_.load(std::memory_order_relaxed) * 100 <
+               maxHedgePercent_ * reads_.load(std::memory_order_relaxed);
+    }
+};
+
+PgLocationStore::PgLocationStore(std::shared_ptr<ConnectionPool> pool, PgLocationStoreConfig config,
+                                 std::shared_ptr<AsyncQueryExecutor> async, std::shared_ptr<ReplicaRouter> replicas)
+    : pool_(std::move(pool)), async_(std::move(async)), replicas_(std::move(replicas)), config_(std::move(config)) {
+    if (!pool_) {
+        throw std::runtime_error("Invalid connection pool provided to PgLocationStore.");
+    }
+    if (config_.hedgePercentile > 0) {
+        int percentile = std::min(config_.hedgePercentile, 99);
+        topLatency_ = std::make_unique<LatencyQuantile>(percentile, config_.hedgeMaxPercent);
+        byIdLatency_ = std::make_unique<LatencyQuantile>(percentile, config_.hedgeMaxPercent);
+    }
+}
+
+PgLocationStore::~PgLocationStore() = default;
+
+PooledConnection PgLocationStore::readConnection(bool primary) {
+    if (!replicas_ || primary) return pool_->checkout();
+    if (ReplicaRouter::Replica* replica = replicas_->pick()) {
+        try {
+            PooledConnection conn = replica->pool().checkout();
+            replicaReads.inc();
+            return conn;
+        } catch (const DatabaseUnavailable&) {
+        }
+    }
+    primaryReads.inc();
+    return pool_->checkout();
+}
+
+AsyncQueryExecutor* PgLocationStore::readExecutor() {
+    if (!replicas_) return async_.get();
+    ReplicaRouter::Replica* replica = replicas_->pick();
+    if (replica && replica->async()) {
+        replicaReads.inc();
+        return replica->async();
+    }
+    primaryReads.inc();
+    return async_.get();
+}
+
+// Helper to sanitize strings before database use.
+std::string PgLocationStore::sanitizeString(const std::string& input) const {
+    std::string sanitized = input;
+    sanitized.erase(std::remove_if(sanitized.begin(), sanitized.end(),
+        [](unsigned char c) { return c < 32 && c != '\t' && c != '\n' && c != '\r'; }),
+        sanitized.end());
+    return sanitized;
+}
+
+// A prepared statement's column list is fixed, so a projection is sent
+// unprepared; planning a single function call costs far less than the
+// columns it leaves behind. With `hedge`, full-row reads are hedged once
+// it has a latency estimate and budget, and each first attempt's latency is
+// fed back into it.
+LocationRows PgLocationStore::runLocationQuery(const PreparedStatement& statement, const char* param,
+                                               FieldMask fields, LatencyQuantile* hedge, bool primary) {
+    PooledConnection conn = readConnection(primary);
+    const char* paramValues[1] = {param};
+    int format = config_.binaryResults ? 1 : 0;
+
+    std::unique_ptr<PGResultWrapper> res;
+    std::string columns = LocationFields::columns(fields);
+    if (columns != "*") {
+        std::string sql = projectedSql(statement, columns);
+        Metrics::Timer timer(projectedLatency);
+        res = std::make_unique<PGResultWrapper>(conn.execParams(sql.c_str(), 1, paramValues, format));
+    } else if (hedge) {
+        std::chrono::nanoseconds hedgeAfter = hedge->value();
+        if (hedgeAfter.count() > 0 && hedge->mayHedge()) {
+            hedgeAfter = std::max<std::chrono::nanoseconds>(hedgeAfter, config_.hedgeMinDelay);
+            HedgeOutcome outcome;
+            res = std::make_unique<PGResultWrapper>(
+                conn.execPreparedHedged(statement, paramValues, format, hedgeAfter, &outcome));
+            hedge->record(outcome.firstElapsed, outcome.hedged);
+        } else {
+            auto start = std::chrono::steady_clock::now();
+            res = std::make_unique<PGResultWrapper>(conn.execPrepared(statement, paramValues, format));
+            hedge->record(std::chrono::steady_clock::now() - start, false);
+        }
+    } else {
+        res = std::make_unique<PGResultWrapper>(conn.execPrepared(statement, paramValues, format));
+    }
+    if (PQresultStatus(res->get()) != PGRES_TUPLES_OK) throw queryFailed(conn, *res);
+    return LocationRows(std::move(res));
+}
+
+void PgLocationStore::runLocationQueryAsync(const PreparedStatement& statement, std::string param,
+                                            RowsCallback done) {
+    if (!async_) throw std::runtime_error("Async queries are not enabled");
+    readExecutor()->execPrepared(statement, {std::move(param)}, config_.binaryResults ? 1 : 0,
+                         [done = std::move(done)](std::unique_ptr<PGResultWrapper> result, std::exception_ptr error) {
+        std::optional<LocationRows> rows;
+        if (!error) {
+            try {
+                rows.emplace(std::move(result));
+            } catch (...) {
+                error = std::current_exception();
+            }
+        }
+        done(rows ? &*rows : nullptr, error);
+    });
+}
+
+LocationRows PgLocationStore::topLocations(int limit, FieldMask fields) {
+    char limitStr[16];
+    *std::to_chars(limitStr, limitStr + sizeof(limitStr) - 1, limit).ptr = '\0';
+    return runLocationQuery(Statements::TopLocations, limitStr, fields, topLatency_.get());
+}
+
+LocationRows PgLocationStore::locationById(const std::string& id, FieldMask fields) {
+    std::string sanitizedId = sanitizeString(id);
+    return runLocationQuery(Statements::LocationById, sanitizedId.c_str(), fields, byIdLatency_.get());
+}
+
+std::vector<std::shared_ptr<const Location>> PgLocationStore::locationsByIds(
+    const std::vector<std::string>& ids, std::vector<std::exception_ptr>* errors) {
+    return fetchByIds(ids, false, errors);
+}
+
+LocationRows PgLocationStore::snapshotTopLocations(int limit) {
+    char limitStr[16];
+    *std::to_chars(limitStr, limitStr + sizeof(limitStr) - 1, limit).ptr = '\0';
+    return runLocationQuery(Statements::TopLocations, limitStr, LocationFields::All, nullptr, true);
+}
+
+std::vector<std::shared_ptr<const Location>> PgLocationStore::snapshotLocationsByIds(
+    const std::vector<std::string>& ids) {
+    return fetchByIds(ids, true, nullptr);
+}
+
+// N ids cost one round-trip. A lookup that fails aborts the rest of its
+// pipeline; those are sent again after the sync, so each round settles at
+// least one more id. A failure of the connection itself leaves it in
+// pipeline mode, which makes the pool close it rather than reuse it.
+std::vector<std::shared_ptr<const Location>> PgLocationStore::fetchByIds(const std::vector<std::string>& ids,
+                                                                        bool primary,
+                                                                        std::vector<std::exception_ptr>* errors) {
+    std::vector<std::shared_ptr<const Location>> locations(ids.size());
+    if (errors) errors->assign(ids.size(), nullptr);
+    std::vector<std::string> sanitized;
+    sanitized.reserve(ids.size());
+    for (const auto& id : ids) sanitized.push_back(sanitizeString(id));
+
+#ifdef LIBPQ_HAS_PIPELINING
+    PooledConnection conn = readConnection(primary);
+    Metrics::Timer timer(pipelinedByIdLatency);
+    PGconn* pg = conn.get();
+    int format = config_.binaryResults ? 1 : 0;
+    std::vector<size_t> pending(ids.size());
+    for (size_t i = 0; i < pending.size(); i++) pending[i] = i;
+
+    while (!pending.empty()) {
+        if (!PQenterPipelineMode(pg)) {
+            throw std::runtime_error("Query failed: " + std::string(PQerrorMessage(pg)));
+        }
+        for (size_t i : pending) {
+            const char* paramValues[1] = {sanitized[i].c_str()};
+            if (!PQsendQueryPrepared(pg, Statements::LocationById.name, 1, paramValues, nullptr, nullptr, format)) {
+                throw std::runtime_error("Query failed: " + std::string(PQerrorMessage(pg)));
+            }
+        }
+        if (!PQpipelineSync(pg)) {
+            throw std::runtime_error("Query failed: " + std::string(PQerrorMessage(pg)));
+        }
+
+        std::vector<size_t> aborted;
+        for (size_t i : pending) {
+            conn.awaitResult();
+            auto res = std::make_unique<PGResultWrapper>(PQgetResult(pg));
+            ExecStatusType status = PQresultStatus(res->get());
+            PGResultWrapper end(PQgetResult(pg));  // each query's results end with a NULL
+            if (status == PGRES_PIPELINE_ABORTED) {
+                aborted.push_back(i);
+            } else if (status != PGRES_TUPLES_OK) {
+                std::runtime_error error("Query failed: " + std::string(PQresultErrorMessage(res->get())));
+                if (!errors || PQstatus(pg) != CONNECTION_OK) throw error;
+                (*errors)[i] = std::make_exception_ptr(error);
+            } else {
+                LocationRows rows(std::move(res));
+                if (!rows.empty()) locations[i] = std::make_shared<const Location>(rows[0].toLocation());
+            }
+        }
+        conn.awaitResult();
+        PGResultWrapper sync(PQgetResult(pg));
+        if (PQresultStatus(sync.get()) != PGRES_PIPELINE_SYNC || !PQexitPipelineMode(pg)) {
+            throw std::runtime_error("Query failed: " + std::string(PQerrorMessage(pg)));
+        }
+        pending = std::move(aborted);
+    }
+#else
+    for (size_t i = 0; i < sanitized.size(); i++) {
+        try {
+            LocationRows rows = runLocationQuery(Statements::LocationById, sanitized[i].c_str(),
+                                                 LocationFields::All, nullptr, primary);
+            if (!rows.empty()) locations[i] = std::make_shared<const Location>(rows[0].toLocation());
+        } catch (const DatabaseUnavailable&) {
+            throw;
+        } catch (const std::exception&) {
+            if (!errors) throw;
+            (*errors)[i] = std::current_exception();
+        }
+    }
+#endif
+    return locations;
+}
+
+LocationRows PgLocationStore::searchLocations(const std::string& queryStr, FieldMask fields) {
+    std::string sanitizedQuery = sanitizeString(queryStr);
+    return runLocationQuery(Statements::SearchLocations, sanitizedQuery.c_str(), fields);
+}
+
+LocationRows PgLocationStore::topLocationsAfter(double afterRating, const std::string& afterId, int limit) {
+    char ratingStr[32];
+    *std::to_chars(ratingStr, ratingStr + sizeof(ratingStr) - 1, afterRating).ptr = '\0';
+    std::string limitStr = std::to_string(limit);
+    std::string sanitizedId = sanitizeString(afterId);
+    const char* paramValues[3] = {ratingStr, sanitizedId.c_str(), limitStr.c_str()};
+
+    PooledConnection conn = readConnection();
+    Metrics::Timer timer(topPageLatency);
+    auto res = std::make_unique<PGResultWrapper>(
+        conn.execParams(config_.topPageQuery.c_str(), 3, paramValues, config_.binaryResults ? 1 : 0));
+    if (PQresultStatus(res->get()) != PGRES_TUPLES_OK) throw queryFailed(conn, *res);
+    return LocationRows(std::move(res));
+}
+
+void PgLocationStore::topLocationsAsync(int limit, RowsCallback done) {
+    runLocationQueryAsync(Statements::TopLocations, std::to_string(limit), std::move(done));
+}
+
+void PgLocationStore::locationByIdAsync(const std::string& id, RowsCallback done) {
+    runLocationQueryAsync(Statements::LocationById, sanitizeString(id), std::move(done));
+}
+
+void PgLocationStore::searchLocationsAsync(const std::string& queryStr, RowsCallback done) {
+    runLocationQueryAsync(Statements::SearchLocations, sanitizeString(queryStr), std::move(done));
+}
\ No newline at end of file
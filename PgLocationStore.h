@@ -0,0 +1,98 @@
+#ifndef PG_LOCATION_STORE_H
+#define PG_LOCATION_STORE_H
+
+#include "ConnectionPool.h"
+#include "LocationStore.h"
+#include <chrono>
+#include <memory>
+#include <string>
+
+class AsyncQueryExecutor;
+class LatencyQuantile;
+class ReplicaRouter;
+
+struct PgLocationStoreConfig {
+    // Fetch location rows in binary format: fewer bytes on the wire and no
+    // text-to-number parsing for rating.
+    bool binaryResults = false;
+    // Keyset page of the top list: rows ordered after ($1 rating, $2 id) in
+    // rating DESC, id ASC order (ids compared bytewise, COLLATE "C"), at most
+    // $3 of them. The default filters get_top_locations, the one function
+    // every schema has, so each page still reads the whole list server-side;
+    // with an index on (rating DESC, id COLLATE "C"), point this at the
+    // table. Run unprepared, so a broken query only fails paging.
+    std::string topPageQuery =
+        "SELECT * FROM get_top_locations(2147483647) AS l "
+        "WHERE l.rating::float8 < $1::float8 "
+        "OR (l.rating::float8 = $1::float8 AND l.id::text COLLATE \"C\" > $2::text COLLATE \"C\") "
+        "ORDER BY l.rating::float8 DESC, l.id::text COLLATE \"C\" "
+        "LIMIT $3::int;";
+    // Hedged reads for topLocations and locationById: a query still running
+    // at this percentile of its statement's recent latencies (and at least
+    // hedgeMinDelay in) is sent again on an idle connection, and the first
+    // answer wins. 0 disables hedging.
+    int hedgePercentile = 0;
+    std::chrono::milliseconds hedgeMinDelay{2};
+    // At most this percentage of recent reads are hedged; past it, reads
+    // run once until the share drops again.
+    int hedgeMaxPercent = 5;
+};
+
+// LocationStore over the Supabase functions, through the statements in
+// Statements.h. Each call borrows its own connection from the pool, so
+// concurrent requests do not serialize. Parameters are stripped of
+// control characters before they are sent. Blocking calls honour the
+// calling thread's Deadline (DeadlineExceeded). With a ReplicaRouter, the
+// top, page, by-id and search reads go to a replica when one is healthy;
+// the snapshot* reads stay on the primary, which is where snapshot change
+// feeds come from.
+class PgLocationStore : public LocationStore {
+private:
+    std::shared_ptr<ConnectionPool> pool_;
+    std::shared_ptr<AsyncQueryExecutor> async_;
+    std::shared_ptr<ReplicaRouter> replicas_;
+    PgLocationStoreConfig config_;
+    std::unique_ptr<LatencyQuantile> topLatency_;  // null unless hedging
+    std::unique_ptr<LatencyQuantile> byIdLatency_;
+
+    std::string sanitizeString(const std::string& input) const;
+    // From the replica pick() chooses, else from the primary; also when
+    // that replica's breaker opened since it was picked.
+    // `primary` skips the replicas.
+    PooledConnection readConnection(bool primary = false);
+    AsyncQueryExecutor* readExecutor();
+    LocationRows runLocationQuery(const PreparedStatement& statement, const char* param,
+                                  FieldMask fields = LocationFields::All, LatencyQuantile* hedge = nullptr,
+                                  bool primary = false);
+    std::vector<std::shared_ptr<const Location>> fetchByIds(const std::vector<std::string>& ids, bool primary,
+                                                            std::vector<std::exception_ptr>* errors);
+    void runLocationQueryAsync(const PreparedStatement& statement, std::string param, RowsCallback done);
+
+public:
+    // Without an executor the *Async methods are unavailable (hasAsync()).
+    // `pool` is the primary's.
+    explicit PgLocationStore(std::shared_ptr<ConnectionPool> pool, PgLocationStoreConfig config = {},
+                             std::shared_ptr<AsyncQueryExecutor> async = nullptr,
+                             std::shared_ptr<ReplicaRouter> replicas = nullptr);
+    ~PgLocationStore() override;
+
+    LocationRows topLocations(int limit, FieldMask fields = LocationFields::All) override;
+    LocationRows locationById(const std::string& id, FieldMask fields = LocationFields::All) override;
+    // Sends every lookup before reading any result (libpq pipeline mode).
+    std::vector<std::shared_ptr<const Location>> locationsByIds(
+        const std::vector<std::string>& ids, std::vector<std::exception_ptr>* errors = nullptr) override;
+    LocationRows searchLocations(const std::string& query, FieldMask fields = LocationFields::All) override;
+    LocationRows topLocationsAfter(double afterRating, const std::string& afterId, int limit) override;
+    // Never hedged: a full load is not the latency-sensitive read the
+    // estimate is kept for.
+    LocationRows snapshotTopLocations(int limit) override;
+    std::vector<std::shared_ptr<const Location>> snapshotLocationsByIds(const std::vector<std::string>& ids) override;
+
+    // done runs on an executor thread.
+    bool hasAsync() const override { return async_ != nullptr; }
+    void topLocationsAsync(int limit, RowsCallback done) override;
+    void locationByIdAsync(const std::string& id, RowsCallback done) override;
+    void searchLocationsAsync(const std::string& query, RowsCallback done) override;
+};
+
+#endif
@@ -1,24 +1,369 @@
 
 
 #pragma once
+#include <cstdint>
+#include <exception>
 #include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 #include <nlohmann/json.hpp>
+#include "ConnectionPool.h"
+#include "Metrics.h"
+#include "RpcRequest.h"
 
 using json = nlohmann::json;
 
+// A complete, already serialized response body. Shared and immutable so a
+// cached body can be handed to any number of concurrent responses. Bodies
+// kept by the response cache also carry their gzip encoding, so a hot
+// response is compressed once rather than per request.
+struct ResponseBody {
+    std::string text;
+    std::string gzip;  // empty unless precompressed
+    std::string etag;  // entityTag(text), for cached bodies
+    // HTTP status when this is the whole response: 503 for a call that
+    // needed the database while it was unavailable. A batch answers 200
+    // and leaves such errors in their slots.
+    int status = 200;
+
+    static std::shared_ptr<const ResponseBody> of(std::string text) {
+        return std::make_shared<const ResponseBody>(ResponseBody{std::move(text), {}, {}});
+    }
+
+    // Quoted strong entity tag naming exactly these bytes (64-bit FNV-1a),
+    // so equal bodies get equal tags in every worker and across restarts,
+    // and different bodies practically never share one.
+    static std::string entityTag(std::string_view text) {
+        uint64_t hash = 14695981039346656037ull;
+        for (unsigned char c : text) hash = (hash ^ c) * 1099511628211ull;
+        static const char digits[] = "0123456789abcdef";
+        std::string tag(18, '"');
+        for (int i = 16; i >= 1; i--, hash >>= 4) tag[i] = digits[hash & 15];
+        return tag;
+    }
+};
+
+using SerializedBody = std::shared_ptr<const ResponseBody>;
+
 class PlainRpcDispatcher {
 public:
     using MethodHandler = std::function<json(const json&)>;
+    // Handlers that produce the response body themselves, e.g. from a cache.
+    using BodyHandler = std::function<SerializedBody(const json&)>;
+    // Handlers that take pre-decoded params, so requests parsed by
+    // parseRpcRequest never need a json tree.
+    using TypedHandler = std::function<SerializedBody(const RpcParams&)>;
+    // What a typed handler registered as a plain function decays to.
+    using TypedFunction = SerializedBody (*)(const RpcParams&);
+    // Vectorized form of a typed method: one call answers every use of the
+    // method within a batch, so the method can combine the underlying queries.
+    using BatchHandler = std::function<std::vector<SerializedBody>(const std::vector<RpcParams>&)>;
+    // Completes an async call with its body, or with the error it failed with.
+    using AsyncReply = std::function<void(SerializedBody body, std::exception_ptr error)>;
+    // Non-blocking form of a typed method: returns at once and calls reply
+    // exactly once, possibly later and from another thread.
+    using AsyncHandler = std::function<void(const RpcParams&, AsyncReply reply)>;
+
+    static constexpr size_t MaxBatchSize = 100;
     
     void registerMethod(const std::string& method, MethodHandler handler) {
+        checkNotFrozen();
         if (methods_.find(method) != methods_.end()) {
             throw std::runtime_error("Method '" + method + "' already registered");
         }
-        methods_[method] = handler;
+        methods_[method].handler = handler;
+    }
+
+    void registerBodyMethod(const std::string& method, BodyHandler handler) {
+        checkNotFrozen();
+        if (methods_.find(method) != methods_.end()) {
+            throw std::runtime_error("Method '" + method + "' already registered");
+        }
+        methods_[method].bodyHandler = handler;
+    }
+
+    void registerTypedMethod(const std::string& method, TypedHandler handler) {
+        checkNotFrozen();
+        if (methods_.find(method) != methods_.end()) {
+            throw std::runtime_error("Method '" + method + "' already registered");
+        }
+        Method& entry = methods_[method];
+        entry.typedHandler = handler;
+        // Handlers registered as plain functions are called through the pointer.
+        if (const TypedFunction* function = handler.target<TypedFunction>()) entry.typedFunction = *function;
+    }
+
+    void registerBatchHandler(const std::string& method, BatchHandler handler) {
+        checkNotFrozen();
+        auto it = methods_.find(method);
+        if (it == methods_.end() || !it->second.typedHandler) {
+            throw std::runtime_error("Batch handler for '" + method + "' needs a typed method");
+        }
+        it->second.batchHandler = handler;
+    }
+
+    void registerAsyncHandler(const std::string& method, AsyncHandler handler) {
+        checkNotFrozen();
+        auto it = methods_.find(method);
+        if (it == methods_.end() || !it->second.typedHandler) {
+            throw std::runtime_error("Async handler for '" + method + "' needs a typed method");
+        }
+        it->second.asyncHandler = handler;
+    }
+
+    // Ends registration and compiles the method names into a perfect-hash
+    // table: one hash of the name, one slot, one compare, no allocation.
+    // Call once every method is registered; lookups before that go through
+    // the map. Also starts timing each method under
+    // rpc_method_duration_seconds.
+    void freeze() {
+        checkNotFrozen();
+        for (auto& [name, method] : methods_) {
+            method.latency = std::make_unique<Metrics::Histogram>(
+                "rpc_method_duration_seconds", "Time spent in each RPC method", "method=\"" + name + '"');
+        }
+        size_t size = 1;
+        while (size < 2 * methods_.size()) size <<= 1;
+        for (uint64_t seed = 0;; seed++) {
+            if (seed == 1024) {
+                size <<= 1;
+                seed = 0;
+            }
+            std::vector<Slot> table(size);
+            bool collided = false;
+            for (const auto& [name, method] : methods_) {
+                Slot& slot = table[hashName(name, seed) & (size - 1)];
+                if (slot.method) {
+                    collided = true;
+                    break;
+                }
+                slot = Slot{name, &method};
+            }
+            if (!collided) {
+                table_ = std::move(table);
+                seed_ = seed;
+                frozen_ = true;
+                return;
+            }
+        }
+    }
+
+    // True if dispatchBody(const RpcRequest&) can serve this method; other
+    // methods need the json request.
+    bool hasTypedMethod(std::string_view method) const {
+        const Method* m = lookup(method);
+        return m && m->typedHandler;
     }
     
+    bool hasAsyncMethod(std::string_view method) const {
+        const Method* m = lookup(method);
+        return m && m->asyncHandler;
+    }
+
     json dispatch(const json& request) {
+        const Method& method = findMethod(request);
+        MethodTimer timer(method);
+        const json& params = request["params"];
+        try {
+            if (method.typedHandler) return json::parse(method.typedHandler(RpcParams::fromJson(params))->text);
+            if (method.bodyHandler) return json::parse(method.bodyHandler(params)->text);
+            return method.handler(params);
+        } catch (const std::exception& e) {
+            return errorResponse(e);
+        }
+    }
+
+    // Same as dispatch, but returns the serialized body. Body handlers skip
+    // building a json tree entirely.
+    SerializedBody dispatchBody(const json& request) {
+        const Method& method = findMethod(request);
+        MethodTimer timer(method);
+        const json& params = request["params"];
+        try {
+            if (method.typedHandler) return method.typedHandler(RpcParams::fromJson(params));
+            if (method.bodyHandler) return method.bodyHandler(params);
+            return ResponseBody::of(method.handler(params).dump());
+        } catch (const std::exception& e) {
+            return errorBody(e);
+        }
+    }
+
+    // JSON-RPC style batch: an array of requests, answered by an array of
+    // responses in the same order. A bad entry gets an error response in its
+    // slot rather than failing the whole batch.
+    SerializedBody dispatchBatch(const json& batch) {
+        if (!batch.is_array() || batch.empty()) {
+            throw std::runtime_error("Invalid request: batch must be a non-empty array");
+        }
+        if (batch.size() > MaxBatchSize) {
+            throw std::runtime_error("Invalid request: batch exceeds " + std::to_string(MaxBatchSize) + " calls");
+        }
+
+        std::vector<SerializedBody> responses(batch.size());
+        std::unordered_map<const Method*, std::vector<std::pair<size_t, RpcParams>>> grouped;
+        for (size_t i = 0; i < batch.size(); i++) {
+            try {
+                const Method& method = findMethod(batch[i]);
+                if (method.batchHandler) {
+                    grouped[&method].emplace_back(i, RpcParams::fromJson(batch[i]["params"]));
+                } else {
+                    responses[i] = dispatchBody(batch[i]);
+                }
+            } catch (const std::exception& e) {
+                responses[i] = ResponseBody::of(errorResponse(e).dump());
+            }
+        }
+
+        for (const auto& [method, calls] : grouped) {
+            std::vector<RpcParams> params;
+            params.reserve(calls.size());
+            for (const auto& call : calls) params.push_back(call.second);
+            try {
+                MethodTimer timer(*method);  // one sample per batch handler call
+                std::vector<SerializedBody> results = method->batchHandler(params);
+                for (size_t k = 0; k < calls.size(); k++) responses[calls[k].first] = results.at(k);
+            } catch (const std::exception& e) {
+                auto error = ResponseBody::of(errorResponse(e).dump());
+                for (const auto& call : calls) responses[call.first] = error;
+            }
+        }
+
+        size_t total = 2;
+        for (const auto& response : responses) total += response->text.size() + 1;
+        std::string body;
+        body.reserve(total);
+        body += '[';
+        for (size_t i = 0; i < responses.size(); i++) {
+            if (i) body += ',';
+            body += responses[i]->text;
+        }
+        body += ']';
+        return ResponseBody::of(std::move(body));
+    }
+
+    // Fast path for requests decoded by parseRpcRequest. Only valid for
+    // methods where hasTypedMethod() is true.
+    SerializedBody dispatchBody(const RpcRequest& request) {
+        const Method* method = lookup(request.method);
+        if (!method || !method->typedHandler) {
+            throw std::runtime_error("Method '" + request.method + "' not found");
+        }
+        MethodTimer timer(*method);
+        try {
+            if (method->typedFunction) return method->typedFunction(request.params);
+            return method->typedHandler(request.params);
+        } catch (const std::exception& e) {
+            return errorBody(e);
+        }
+    }
+
+    // Async counterpart of dispatchBody(const RpcRequest&), for methods where
+    // hasAsyncMethod() is true. respond always gets a body; failures arrive
+    // as the usual error envelope.
+    void dispatchAsync(const RpcRequest& request, std::function<void(SerializedBody)> respond) {
+        const Method* method = lookup(request.method);
+        if (!method || !method->asyncHandler) {
+            throw std::runtime_error("Method '" + request.method + "' not found");
+        }
+        auto start = std::chrono::steady_clock::now();
+        try {
+            method->asyncHandler(request.params, [respond, method, start](SerializedBody body, std::exception_ptr error) {
+                if (method->latency) method->latency->recordSince(start);
+                respond(error ? errorBody(error) : body);
+            });
+        } catch (...) {
+            respond(errorBody(std::current_exception()));
+        }
+    }
+
+    // The error envelope for a failed call, with status 503 when it failed
+    // for want of the database.
+    static SerializedBody errorBody(const std::exception& e) {
+        ResponseBody body{errorResponse(e).dump(), {}, {}};
+        if (dynamic_cast<const DatabaseUnavailable*>(&e)) body.status = 503;
+        return std::make_shared<const ResponseBody>(std::move(body));
+    }
+
+    static SerializedBody errorBody(std::exception_ptr error) {
+        try {
+            std::rethrow_exception(error);
+        } catch (const std::exception& e) {
+            return errorBody(e);
+        } catch (...) {
+            return ResponseBody::of(errorResponse(std::runtime_error("Unknown error")).dump());
+        }
+    }
+    
+private:
+    struct Method {
+        MethodHandler handler;
+        BodyHandler bodyHandler;
+        TypedHandler typedHandler;
+        TypedFunction typedFunction = nullptr;
+        BatchHandler batchHandler;
+        AsyncHandler asyncHandler;
+        std::unique_ptr<Metrics::Histogram> latency;  // set by freeze()
+    };
+
+    class MethodTimer {
+    private:
+        const Method& method_;
+        std::chrono::steady_clock::time_point start_ = std::chrono::steady_clock::now();
+
+    public:
+        explicit MethodTimer(const Method& method) : method_(method) {}
+        ~MethodTimer() {
+            if (method_.latency) method_.latency->recordSince(start_);
+        }
+    };
+
+    struct Slot {
+        std::string_view name;  // points at the key in methods_
+        const Method* method = nullptr;
+    };
+
+    std::unordered_map<std::string, Method> methods_;
+    std::vector<Slot> table_;
+    uint64_t seed_ = 0;
+    bool frozen_ = false;
+
+    void checkNotFrozen() const {
+        if (frozen_) throw std::runtime_error("Methods cannot be registered after freeze()");
+    }
+
+    // FNV-1a, seeded so freeze() can search for a collision-free table.
+    static uint64_t hashName(std::string_view name, uint64_t seed) {
+        uint64_t hash = 14695981039346656037ull ^ (seed * 0x9E3779B97F4A7C15ull);
+        for (unsigned char c : name) {
+            hash ^= c;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    const Method* lookup(std::string_view name) const {
+        if (frozen_) {
+            const Slot& slot = table_[hashName(name, seed_) & (table_.size() - 1)];
+            return slot.method && slot.name == name ? slot.method : nullptr;
+        }
+        auto it = methods_.find(std::string(name));
+        return it == methods_.end() ? nullptr : &it->second;
+    }
+
+    static json errorResponse(const std::exception& e) {
+        // Wrap any exceptions in a JSON error response
+        return json{
+            {"success", false},
+            {"error", e.what()}
+        };
+    }
+
+    const Method& findMethod(const json& request) const {
         // Validate request structure
         if (!request.contains("method") || !request["method"].is_string()) {
             throw std::runtime_error("Invalid request: missing or invalid 'method' field");
@@ -28,27 +373,13 @@ public:
             throw std::runtime_error("Invalid request: missing or invalid 'params' field");
         }
 
-        std::string method = request["method"].get<std::string>();
-        const json& params = request["params"];
+        const std::string& method = request["method"].get_ref<const std::string&>();
 
-        // Find and execute the method
-        auto it = methods_.find(method);
-        if (it == methods_.end()) {
+        // Find the method
+        const Method* found = lookup(method);
+        if (!found) {
             throw std::runtime_error("Method '" + method + "' not found");
         }
-
-        try {
-            // Call the registered method handler
-            return it->second(params);
-        } catch (const std::exception& e) {
-            // Wrap any exceptions in a JSON error response
-            return json{
-                {"success", false},
-                {"error", e.what()}
-            };
-        }
+        return *found;
     }
-    
-private:
-    std::unordered_map<std::string, MethodHandler> methods_;
 };
\ No newline at end of file
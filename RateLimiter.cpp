@@ -0,0 +1,265 @@
+#include "RateLimiter.h"
+#include "LocationService.h"
+#include "Metrics.h"
+#include "Statements.h"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <iostream>
+
+namespace {
+
+const char* const DroppedHelp = "Log calls dropped because the write backlog was full";
+const Metrics::Counter droppedRequests{"rate_limiter_log_dropped_total", DroppedHelp, "call=\"request\""};
+const Metrics::Counter droppedResponses{"rate_limiter_log_dropped_total", DroppedHelp, "call=\"response\""};
+const Metrics::Counter writtenCalls{"rate_limiter_log_written_total", "Log calls written to the database"};
+
+// Builds a Postgres text[] literal, e.g. {"a","b\"c"}.
+std::string toTextArray(const std::vector<const std::string*>& values) {
+    std::string out = "{";
+    for (size_t i = 0; i < values.size(); i++) {
+        if (i) out += ',';
+        out += '"';
+        for (char c : *values[i]) {
+            if (c == '"' || c == '\\') out += '\\';
+            out += c;
+        }
+        out += '"';
+    }
+    out += '}';
+    return out;
+}
+
+void execArray(const PooledConnection& conn, const PreparedStatement& statement, const std::string& array) {
+    const char* param[1] = { array.c_str() };
+    PGResultWrapper res(conn.execPrepared(statement, param));
+    if (PQresultStatus(res.get()) != PGRES_TUPLES_OK) {
+        throw std::runtime_error("Query failed: " + std::string(PQerrorMessage(conn.get())));
+    }
+}
+
+void execCommand(const PooledConnection& conn, const char* sql) {
+    PGResultWrapper res(PQexec(conn.get(), sql));
+    if (PQresultStatus(res.get()) != PGRES_COMMAND_OK) {
+        throw std::runtime_error("Query failed: " + std::string(PQerrorMessage(conn.get())));
+    }
+}
+
+}
+
+RateLimiter::RateLimiter(std::shared_ptr<ConnectionPool> pool, RateLimiterConfig config)
+    : pool_(std::move(pool)), config_(config) {
+    if (!pool_) {
+        throw std::runtime_error("Invalid connection pool provided to RateLimiter.");
+    }
+    size_t shards = 1;
+    while (shards < std::max<size_t>(config_.shards, 1)) shards <<= 1;
+    shards_ = std::make_unique<Shard[]>(shards);
+    shardMask_ = shards - 1;
+    flusher_ = std::thread(&RateLimiter::flushLoop, this);
+}
+
+RateLimiter::~RateLimiter() {
+    {
+        std::lock_guard<std::mutex> lock(flushMutex_);
+        stopping_ = true;
+    }
+    flushWake_.notify_one();
+    flusher_.join();
+    try {
+        flush();
+    } catch (const std::exception& e) {
+        std::cerr << "[RateLimiter] Final flush failed: " << e.what() << std::endl;
+    }
+}
+
+RateLimiter::Shard& RateLimiter::shardFor(const std::string& userid) {
+    return shards_[std::hash<std::string>{}(userid) & shardMask_];
+}
+
+bool RateLimiter::tryAcquire(const std::string& userid) {
+    auto now = std::chrono::steady_clock::now();
+    Shard& shard = shardFor(userid);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto [it, inserted] = shard.users.try_emplace(userid);
+    UserState& user = it->second;
+    if (inserted) {
+        user.tokens = config_.burst;
+        user.lastRefill = now;
+    }
+    user.lastSeen = now;
+    // A database-side block rejects before the request is even logged,
+    // matching the first is_user_blocked check this replaces.
+    if (user.blockedByDb) return false;
+
+    std::chrono::duration<double> elapsed = now - user.lastRefill;
+    user.tokens = std::min(config_.burst, user.tokens + elapsed.count() * config_.requestsPerSecond);
+    user.lastRefill = now;
+    if (reserveLogCall()) user.pendingRequests++;
+    else droppedRequests.inc();
+
+    if (user.tokens < 1.0) return false;
+    user.tokens -= 1.0;
+    return true;
+}
+
+void RateLimiter::recordResponse(const std::string& userid) {
+    Shard& shard = shardFor(userid);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.users.find(userid);
+    if (it == shard.users.end()) return;
+    if (reserveLogCall()) it->second.pendingResponses++;
+    else droppedResponses.inc();
+}
+
+// Takes room for one more unwritten log call, or returns false when the
+// backlog is full. The check and the increment are one atomic step, so
+// concurrent callers cannot overshoot the cap.
+bool RateLimiter::reserveLogCall() {
+    if (pendingCalls_.fetch_add(1, std::memory_order_relaxed) < config_.maxPendingCalls) return true;
+    pendingCalls_.fetch_sub(1, std::memory_order_relaxed);
+    return false;
+}
+
+std::vector<RateLimiter::PendingCounts> RateLimiter::takePending() {
+    std::vector<PendingCounts> pending;
+    for (size_t i = 0; i <= shardMask_; i++) {
+        std::lock_guard<std::mutex> lock(shards_[i].mutex);
+        for (auto& [userid, user] : shards_[i].users) {
+            // A blocked user logs nothing, but still goes out with no counts
+            // so refreshBlocked() sees the database lift the block.
+            if (user.pendingRequests == 0 && user.pendingResponses == 0 && !user.blockedByDb) continue;
+            pending.push_back({userid, user.pendingRequests, user.pendingResponses});
+            user.pendingRequests = 0;
+            user.pendingResponses = 0;
+        }
+    }
+    return pending;
+}
+
+// Puts the counts from pending[from] on back after a failed flush, so they
+// go out with the next one.
+void RateLimiter::restorePending(const std::vector<PendingCounts>& pending, size_t from) {
+    for (size_t i = from; i < pending.size(); i++) {
+        const PendingCounts& p = pending[i];
+        Shard& shard = shardFor(p.userid);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.users.find(p.userid);
+        if (it == shard.users.end()) {
+            pendingCalls_.fetch_sub(p.requests + p.responses, std::memory_order_relaxed);
+            droppedRequests.inc(p.requests);
+            droppedResponses.inc(p.responses);
+            continue;
+        }
+        it->second.pendingRequests += p.requests;
+        it->second.pendingResponses += p.responses;
+    }
+}
+
+// One round-trip per function: the userid array repeats each user once per
+// logged call, so the database sees the same call count as before. Both
+// run in one transaction, so a batch that fails was not written at all and
+// can be put back whole.
+void RateLimiter::writePending(const PooledConnection& conn, const std::vector<PendingCounts>& pending,
+                               size_t begin, size_t end) {
+    std::vector<const std::string*> requests, responses;
+    for (size_t i = begin; i < end; i++) {
+        const PendingCounts& p = pending[i];
+        requests.insert(requests.end(), p.requests, &p.userid);
+        responses.insert(responses.end(), p.responses, &p.userid);
+    }
+    if (requests.empty() && responses.empty()) return;  // only blocked users, for the refresh
+    execCommand(conn, "BEGIN;");
+    try {
+        if (!requests.empty()) {
+            execArray(conn, Statements::LogUserRequests, toTextArray(requests));
+        }
+        if (!responses.empty()) {
+            execArray(conn, Statements::LogUserResponses, toTextArray(responses));
+        }
+        execCommand(conn, "COMMIT;");
+    } catch (...) {
+        PQclear(PQexec(conn.get(), "ROLLBACK;"));
+        throw;
+    }
+}
+
+void RateLimiter::refreshBlocked(const PooledConnection& conn, const std::vector<PendingCounts>& pending) {
+    std::vector<const std::string*> users;
+    users.reserve(pending.size());
+    for (const auto& p : pending) users.push_back(&p.userid);
+    std::string array = toTextArray(users);
+    const char* param[1] = { array.c_str() };
+
+    PGResultWrapper res(conn.execPrepared(Statements::UsersBlocked, param));
+    if (PQresultStatus(res.get()) != PGRES_TUPLES_OK) {
+        throw std::runtime_error("Query failed: " + std::string(PQerrorMessage(conn.get())));
+    }
+    int rows = PQntuples(res.get());
+    for (int i = 0; i < rows; i++) {
+        std::string userid = PQgetvalue(res.get(), i, 0);
+        bool blocked = strcmp(PQgetvalue(res.get(), i, 1), "t") == 0;
+        Shard& shard = shardFor(userid);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.users.find(userid);
+        if (it != shard.users.end()) it->second.blockedByDb = blocked;
+    }
+}
+
+void RateLimiter::evictIdle() {
+    auto cutoff = std::chrono::steady_clock::now() - config_.idleEviction;
+    for (size_t i = 0; i <= shardMask_; i++) {
+        std::lock_guard<std::mutex> lock(shards_[i].mutex);
+        auto& users = shards_[i].users;
+        for (auto it = users.begin(); it != users.end();) {
+            const UserState& user = it->second;
+            bool idle = user.lastSeen < cutoff && user.pendingRequests == 0 && user.pendingResponses == 0;
+            it = idle ? users.erase(it) : std::next(it);
+        }
+    }
+}
+
+// Users go out in batches of up to flushBatchSize calls (a user with more
+// is a batch of their own). A failure puts back only the batches not yet
+// written.
+void RateLimiter::flush() {
+    std::vector<PendingCounts> pending = takePending();
+    if (pending.empty()) return;
+    size_t written = 0;
+    try {
+        PooledConnection conn = pool_->checkout();
+        while (written < pending.size()) {
+            size_t end = written, calls = 0;
+            do {
+                calls += pending[end].requests + pending[end].responses;
+                end++;
+            } while (end < pending.size() &&
+                     calls + pending[end].requests + pending[end].responses <= config_.flushBatchSize);
+            writePending(conn, pending, written, end);
+            written = end;
+            pendingCalls_.fetch_sub(calls, std::memory_order_relaxed);
+            writtenCalls.inc(calls);
+        }
+        refreshBlocked(conn, pending);
+    } catch (...) {
+        restorePending(pending, written);
+        throw;
+    }
+}
+
+void RateLimiter::flushLoop() {
+    std::unique_lock<std::mutex> lock(flushMutex_);
+    while (!stopping_) {
+        flushWake_.wait_for(lock, config_.flushInterval, [this] { return stopping_; });
+        if (stopping_) break;
+        lock.unlock();
+        try {
+            flush();
+            evictIdle();
+        } catch (const std::exception& e) {
+            std::cerr << "[RateLimiter] Flush failed: " << e.what() << std::endl;
+        }
+        lock.lock();
+    }
+}
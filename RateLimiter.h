@@ -0,0 +1,102 @@
+#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+
+#include "ConnectionPool.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct RateLimiterConfig {
+    // Token bucket refill rate and capacity, per userid.
+    double requestsPerSecond = 5.0;
+    double burst = 20.0;
+    // How often pending counts are written to log_user_request/log_user_response
+    // and the database's is_user_blocked verdicts are refreshed.
+    std::chrono::milliseconds flushInterval{1000};
+    // Users with no calls (admitted or rejected) and nothing pending for
+    // this long are forgotten.
+    std::chrono::milliseconds idleEviction{600000};
+    size_t shards = 64;
+    // Log calls waiting to be written, across all users. The backlog grows
+    // while the database is unreachable; past this, new calls are dropped
+    // (rate_limiter_log_dropped_total) rather than held.
+    size_t maxPendingCalls = 1000000;
+    // Most log calls one flush statement carries, so a backlog drains in
+    // bounded pieces.
+    size_t flushBatchSize = 10000;
+};
+
+// In-memory, sharded token-bucket limiter keyed by userid. Admission is
+// decided locally; request/response counts are batched to Postgres by a
+// background thread, which also pulls back is_user_blocked so blocks issued
+// on the database side (and lifting them) take effect within one flush
+// interval.
+// Requests never wait on the database: logging one is a counter bump in the
+// user's shard, and the backlog of unwritten calls is capped.
+class RateLimiter {
+private:
+    struct UserState {
+        double tokens;
+        std::chrono::steady_clock::time_point lastRefill;
+        std::chrono::steady_clock::time_point lastSeen;  // last call, admitted or not
+        uint32_t pendingRequests = 0;
+        uint32_t pendingResponses = 0;
+        bool blockedByDb = false;
+    };
+
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        std::unordered_map<std::string, UserState> users;
+    };
+
+    struct PendingCounts {
+        std::string userid;
+        uint32_t requests;
+        uint32_t responses;
+    };
+
+    std::shared_ptr<ConnectionPool> pool_;
+    RateLimiterConfig config_;
+    std::unique_ptr<Shard[]> shards_;
+    size_t shardMask_;
+    std::atomic<size_t> pendingCalls_{0};  // counted until written, including in-flight flushes
+
+    std::mutex flushMutex_;
+    std::condition_variable flushWake_;
+    bool stopping_ = false;
+    std::thread flusher_;
+
+    Shard& shardFor(const std::string& userid);
+    bool reserveLogCall();
+    std::vector<PendingCounts> takePending();
+    void restorePending(const std::vector<PendingCounts>& pending, size_t from);
+    void writePending(const PooledConnection& conn, const std::vector<PendingCounts>& pending, size_t begin,
+                      size_t end);
+    void refreshBlocked(const PooledConnection& conn, const std::vector<PendingCounts>& pending);
+    void evictIdle();
+    void flushLoop();
+
+public:
+    RateLimiter(std::shared_ptr<ConnectionPool> pool, RateLimiterConfig config);
+    ~RateLimiter();
+    RateLimiter(const RateLimiter&) = delete;
+    RateLimiter& operator=(const RateLimiter&) = delete;
+
+    // Returns false when the request must be rejected with 429.
+    bool tryAcquire(const std::string& userid);
+    void recordResponse(const std::string& userid);
+
+    // Writes all pending counts now. Called periodically and on shutdown.
+    void flush();
+    // Log calls recorded but not yet written.
+    size_t pendingLogCalls() const { return pendingCalls_.load(std::memory_order_relaxed); }
+};
+
+#endif
@@ -0,0 +1,140 @@
+#include "ReplicaRouter.h"
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+// Seconds the replica's replayed state trails the primary, or NULL for a
+// standby with no WAL receiver (disconnected: it would never catch up). A
+// standby that has replayed up to $1, the primary's WAL position at the
+// start of the check, is current however old its last replayed commit is
+// (an idle primary). Without $1 (primary unreachable) the position it has
+// received stands in. A server that is not a standby at all reports 0.
+// status is only visible with pg_read_all_stats; without it, a running
+// receiver process has to do.
+const char* const LagQuery =
+    "SELECT CASE WHEN NOT pg_is_in_recovery() THEN 0 "
+    "WHEN NOT EXISTS (SELECT 1 FROM pg_stat_wal_receiver WHERE COALESCE(status, 'streaming') = 'streaming') "
+    "THEN NULL "
+    "WHEN pg_last_wal_replay_lsn() >= COALESCE($1::pg_lsn, pg_last_wal_receive_lsn()) THEN 0 "
+    "ELSE COALESCE(EXTRACT(EPOCH FROM now() - pg_last_xact_replay_timestamp())::float8, 'Infinity'::float8) "
+    "END::float8;";
+
+const char* const PrimaryPositionQuery = "SELECT pg_current_wal_lsn()::text;";
+
+}
+
+ReplicaRouter::ReplicaRouter(std::shared_ptr<ConnectionPool> primary, ReplicaRouterConfig config)
+    : primary_(std::move(primary)), config_(std::move(config)) {
+    if (!primary_) {
+        throw std::runtime_error("Invalid connection pool provided to ReplicaRouter.");
+    }
+    for (auto& poolConfig : config_.replicas) {
+        auto replica = std::make_unique<Replica>();
+        replica->pool_ = std::make_shared<ConnectionPool>(poolConfig);
+        if (config_.asyncThreads > 0) {
+            AsyncQueryConfig asyncConfig;
+            asyncConfig.threads = config_.asyncThreads;
+            replica->async_ = std::make_shared<AsyncQueryExecutor>(replica->pool_, asyncConfig);
+        }
+        replica->supervisor_ = std::make_unique<ConnectionSupervisor>(replica->pool_, config_.supervisor);
+        replicas_.push_back(std::move(replica));
+    }
+}
+
+ReplicaRouter::~ReplicaRouter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    if (worker_.joinable()) worker_.join();
+}
+
+size_t ReplicaRouter::start() {
+    for (auto& replica : replicas_) replica->supervisor_->start();
+    checkAll();
+    size_t healthy = 0;
+    for (auto& replica : replicas_) {
+        if (replica->healthy()) healthy++;
+    }
+    if (!replicas_.empty()) worker_ = std::thread(&ReplicaRouter::run, this);
+    return healthy;
+}
+
+// Empty when the primary cannot be asked.
+std::string ReplicaRouter::primaryPosition() {
+    try {
+        if (!primary_->available()) return std::string();
+        PooledConnection conn = primary_->checkout();
+        PGResultWrapper res(PQexec(conn.get(), PrimaryPositionQuery));
+        if (PQresultStatus(res.get()) == PGRES_TUPLES_OK && PQntuples(res.get()) == 1) {
+            return PQgetvalue(res.get(), 0, 0);
+        }
+    } catch (const std::exception&) {
+    }
+    return std::string();
+}
+
+void ReplicaRouter::checkAll() {
+    std::string position = primaryPosition();
+    for (auto& replica : replicas_) checkLag(*replica, position);
+}
+
+// A replica that cannot be asked is as unusable as one that is behind.
+void ReplicaRouter::checkLag(Replica& replica, const std::string& primaryPosition) {
+    bool healthy = false;
+    try {
+        PooledConnection conn = replica.pool_->checkout();
+        const char* params[1] = {primaryPosition.empty() ? nullptr : primaryPosition.c_str()};
+        PGResultWrapper res(PQexecParams(conn.get(), LagQuery, 1, nullptr, params, nullptr, nullptr, 0));
+        if (PQresultStatus(res.get()) == PGRES_TUPLES_OK && PQntuples(res.get()) == 1) {
+            // No WAL receiver: as far behind as it will ever get.
+            double lag = PQgetisnull(res.get(), 0, 0) ? HUGE_VAL : std::strtod(PQgetvalue(res.get(), 0, 0), nullptr);
+            replica.lagSeconds_.store(lag, std::memory_order_relaxed);
+            healthy = lag * 1000.0 <= static_cast<double>(config_.maxLag.count());
+        }
+    } catch (const std::exception&) {
+    }
+    bool wasHealthy = replica.healthy_.exchange(healthy, std::memory_order_acq_rel);
+    if (healthy == wasHealthy) return;
+    size_t index = 0;
+    while (replicas_[index].get() != &replica) index++;
+    if (healthy) {
+        std::cout << "[DB] Replica " << index << " is serving reads" << std::endl;
+    } else {
+        std::cerr << "[DB] Replica " << index << " is unreachable or more than " << config_.maxLag.count()
+                  << "ms behind; its reads go elsewhere" << std::endl;
+    }
+}
+
+void ReplicaRouter::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        wake_.wait_for(lock, config_.checkInterval, [this] { return stopping_; });
+        if (stopping_) break;
+        lock.unlock();
+        checkAll();
+        lock.lock();
+    }
+}
+
+ReplicaRouter::Replica* ReplicaRouter::pick() {
+    size_t count = replicas_.size();
+    if (count == 0) return nullptr;
+    size_t first = next_.fetch_add(1, std::memory_order_relaxed);
+    Replica* best = nullptr;
+    size_t bestBusy = 0;
+    for (size_t i = 0; i < count; i++) {
+        Replica& replica = *replicas_[(first + i) % count];
+        if (!replica.healthy() || !replica.pool_->available()) continue;
+        size_t busy = replica.pool_->busyCount();
+        if (!best || busy < bestBusy) {
+            best = &replica;
+            bestBusy = busy;
+        }
+    }
+    return best;
+}
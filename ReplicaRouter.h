@@ -0,0 +1,91 @@
+#ifndef REPLICA_ROUTER_H
+#define REPLICA_ROUTER_H
+
+#include "AsyncQueryExecutor.h"
+#include "ConnectionPool.h"
+#include "ConnectionSupervisor.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct ReplicaRouterConfig {
+    // One pool per replica, each kept filled by a supervisor of its own.
+    std::vector<ConnectionPoolConfig> replicas;
+    ConnectionSupervisorConfig supervisor;
+    // Event loop threads of each replica's AsyncQueryExecutor. 0 gives the
+    // replicas none, and the *Async reads stay on the primary.
+    size_t asyncThreads = 0;
+    // A replica replaying this far behind the primary gets no reads until
+    // it catches up.
+    std::chrono::milliseconds maxLag{5000};
+    // How often each replica's lag is measured.
+    std::chrono::milliseconds checkInterval{1000};
+};
+
+// Spreads location reads over read replicas. A background thread measures
+// each replica's replay lag against the primary's WAL position (a replica
+// whose WAL receiver is gone counts as unhealthy), and pick() returns the
+// healthy replica with the fewest connections checked out, i.e. the fewest
+// reads in flight. Writes never come here: they stay on the primary's pool.
+class ReplicaRouter {
+public:
+    class Replica {
+    private:
+        std::shared_ptr<ConnectionPool> pool_;
+        std::shared_ptr<AsyncQueryExecutor> async_;
+        std::unique_ptr<ConnectionSupervisor> supervisor_;
+        std::atomic<bool> healthy_{false};
+        std::atomic<double> lagSeconds_{0};
+        friend class ReplicaRouter;
+
+    public:
+        ConnectionPool& pool() const { return *pool_; }
+        AsyncQueryExecutor* async() const { return async_.get(); }
+        // Answered the last lag check, within maxLag.
+        bool healthy() const { return healthy_.load(std::memory_order_acquire); }
+        double lagSeconds() const { return lagSeconds_.load(std::memory_order_relaxed); }
+    };
+
+private:
+    std::shared_ptr<ConnectionPool> primary_;
+    ReplicaRouterConfig config_;
+    std::vector<std::unique_ptr<Replica>> replicas_;
+    std::atomic<size_t> next_{0};  // rotates the starting replica so ties spread
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    std::thread worker_;
+
+    std::string primaryPosition();
+    void checkAll();
+    void checkLag(Replica& replica, const std::string& primaryPosition);
+    void run();
+
+public:
+    // Does not connect; start() does. `primary` is only asked for its WAL
+    // position.
+    ReplicaRouter(std::shared_ptr<ConnectionPool> primary, ReplicaRouterConfig config);
+    ~ReplicaRouter();
+    ReplicaRouter(const ReplicaRouter&) = delete;
+    ReplicaRouter& operator=(const ReplicaRouter&) = delete;
+
+    // Starts every replica's supervisor and measures each one once, so
+    // reads are routed from the first request on. Then hands over to the
+    // background thread. Returns the number of healthy replicas.
+    size_t start();
+
+    // The healthy replica with the fewest reads in flight, or nullptr when
+    // there is none and the read should go to the primary.
+    Replica* pick();
+
+    size_t size() const { return replicas_.size(); }
+    const Replica& replica(size_t i) const { return *replicas_[i]; }
+};
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef RESPONSE_CACHE_H
+#define RESPONSE_CACHE_H
+
+#include "Compression.h"
+#include "LruCache.h"
+#include "PlainRpcDispatcher.h"
+#include <cstdint>
+#include <string>
+
+// Caches complete success bodies for read RPCs, so a hit is one lookup with
+// no json tree and no dump(). Keys carry the data version the body was built
+// from; bumping the version (cache invalidation) makes old bodies unreachable
+// and they age out of the LRU. Bodies past the compression threshold are
+// stored with their gzip form alongside, built once on the miss, and every
+// stored body with its entity tag.
+class ResponseCache {
+private:
+    bool enabled_;
+    CompressionConfig compression_;
+    ShardedLruCache<std::string, ResponseBody> bodies_;
+
+    ResponseBody encode(std::string text) const {
+        std::string gzip = Compression::encodeIfWorthIt(text, compression_);
+        std::string etag = ResponseBody::entityTag(text);
+        return ResponseBody{std::move(text), std::move(gzip), std::move(etag)};
+    }
+
+public:
+    explicit ResponseCache(bool enabled = true, LruCacheConfig config = {}, CompressionConfig compression = {})
+        : enabled_(enabled), compression_(compression), bodies_(config) {}
+
+    // Builds the envelope the json handlers produce around a data value that
+    // appendData(std::string&) writes in place. nlohmann orders object keys,
+    // hence "data" before "success".
+    template <typename Builder>
+    static std::string successBody(Builder&& appendData) {
+        std::string body = "{\"data\":";
+        appendData(body);
+        body += ",\"success\":true}";
+        return body;
+    }
+
+    // appendData is only called on a miss, and only once for concurrent
+    // misses on the same key.
+    template <typename Builder>
+    SerializedBody getOrBuild(uint64_t version, const std::string& key, Builder&& appendData) {
+        if (!enabled_) return ResponseBody::of(successBody(appendData));
+        return bodies_.getOrLoad(std::to_string(version) + ':' + key,
+                                 [&] { return encode(successBody(appendData)); });
+    }
+
+    // Split form of getOrBuild for callers that build the body later, e.g.
+    // from an async query. No coalescing: concurrent misses each build.
+    SerializedBody find(uint64_t version, const std::string& key) {
+        if (!enabled_) return nullptr;
+        return bodies_.get(std::to_string(version) + ':' + key);
+    }
+
+    SerializedBody store(uint64_t version, const std::string& key, std::string body) {
+        if (!enabled_) return ResponseBody::of(std::move(body));
+        auto shared = std::make_shared<const ResponseBody>(encode(std::move(body)));
+        bodies_.put(std::to_string(version) + ':' + key, shared);
+        return shared;
+    }
+
+    void clear() { bodies_.clear(); }
+
+    uint64_t hits() const { return bodies_.hits(); }
+    uint64_t misses() const { return bodies_.misses(); }
+};
+
+#endif
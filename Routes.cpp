@@ -0,0 +1,755 @@
+#include "Routes.h"
+#include "Deadline.h"
+#include "JsonWriter.h"
+#include "LocationSnapshot.h"
+#include "Metrics.h"
+#include "RateLimiter.h"
+#include "ReplicaRouter.h"
+#include "ResponseCache.h"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+
+using namespace std;
+
+namespace {
+
+// Set once by BuildRpcDispatcher, before any request.
+ServerContext context;
+
+// Where /rpc time goes, and why requests were turned away.
+namespace RpcMetrics {
+    const char* const PhaseHelp = "Time spent in each stage of /rpc handling";
+    const Metrics::Histogram parse{"rpc_phase_duration_seconds", PhaseHelp, "phase=\"parse\""};
+    const Metrics::Histogram rateLimit{"rpc_phase_duration_seconds", PhaseHelp, "phase=\"rate_limit\""};
+    const Metrics::Histogram dispatch{"rpc_phase_duration_seconds", PhaseHelp, "phase=\"dispatch\""};
+    const char* const RejectedHelp = "Requests answered with an error status before dispatch";
+    const Metrics::Counter badRequest{"rpc_rejected_total", RejectedHelp, "code=\"400\""};
+    const Metrics::Counter rateLimited{"rpc_rejected_total", RejectedHelp, "code=\"429\""};
+    const Metrics::Counter unavailable{"rpc_rejected_total", RejectedHelp, "code=\"503\""};
+    const char* const GzipHelp = "Responses sent gzip-encoded, by where the encoding came from";
+    const Metrics::Counter gzipCached{"rpc_gzip_responses_total", GzipHelp, "source=\"cache\""};
+    const Metrics::Counter gzipInline{"rpc_gzip_responses_total", GzipHelp, "source=\"inline\""};
+}
+
+// Sends the precompressed form when the body has one, and compresses on
+// the spot only bodies the response cache did not keep. Returns true if the
+// body went out gzip-encoded.
+bool SetBody(crow::response& res, const SerializedBody& body, bool acceptsGzip) {
+    const CompressionConfig& compression = context.compression;
+    res.code = body->status;
+    if (compression.enabled) res.set_header("Vary", "Accept-Encoding");
+    if (acceptsGzip && !body->gzip.empty()) {
+        RpcMetrics::gzipCached.inc();
+        res.set_header("Content-Encoding", "gzip");
+        res.body = body->gzip;
+        return true;
+    }
+    if (acceptsGzip && compression.enabled && body->text.size() >= compression.minBytes) {
+        RpcMetrics::gzipInline.inc();
+        res.set_header("Content-Encoding", "gzip");
+        res.body = Compression::gzip(body->text, compression.level);
+        return true;
+    }
+    res.body = body->text;
+    return false;
+}
+
+crow::response JsonError(int code, const string& message) {
+    crow::response res(code, json{{"success", false}, {"error", message}}.dump());
+    res.set_header("Content-Type", "application/json");
+    res.set_header("Access-Control-Allow-Origin", "*");
+    return res;
+}
+
+// The entity tag from an If-None-Match list (W/ prefixes ignored, since a
+// 304 only needs weak comparison) that names this version in either
+// encoding, or nullptr. `*` matches the identity tag.
+const string* MatchingETag(string_view ifNoneMatch, const string& tag, const string& gzipTag) {
+    for (size_t start = 0; start < ifNoneMatch.size();) {
+        size_t end = ifNoneMatch.find(',', start);
+        if (end == string_view::npos) end = ifNoneMatch.size();
+        string_view entry = ifNoneMatch.substr(start, end - start);
+        while (!entry.empty() && entry.front() == ' ') entry.remove_prefix(1);
+        while (!entry.empty() && entry.back() == ' ') entry.remove_suffix(1);
+        if (entry.substr(0, 2) == "W/") entry.remove_prefix(2);
+        if (entry == tag || entry == "*") return &tag;
+        if (entry == gzipTag) return &gzipTag;
+        start = end + 1;
+    }
+    return nullptr;
+}
+
+// Response cache key for a read. While the snapshot is fresh, bodies are
+// cached per snapshot generation, so neither a full reload nor a delta
+// that changed rows is answered from bodies built before it.
+string RpcCacheKey(const string& key) {
+    if (!context.locations->snapshotFresh()) return key;
+    return key + '@' + to_string(context.locations->snapshotGeneration());
+}
+
+// GET form of a cached read. Every response has a strong ETag hashed from
+// its own bytes, so a tag names one body in every worker and across
+// restarts, whether it came from the snapshot or from SQL. An If-None-Match
+// naming it is answered 304 once the body is found, normally a response
+// cache hit.
+template <typename Builder>
+crow::response CacheableGet(const crow::request& req, const string& key, Builder&& appendData) {
+    uint64_t version = context.locations->dataVersion();
+    string cacheKey = RpcCacheKey(key);
+
+    crow::response res;
+    res.set_header("Cache-Control", "public, max-age=" + to_string(context.httpMaxAgeSeconds));
+    res.set_header("Access-Control-Allow-Origin", "*");
+
+    SerializedBody body;
+    try {
+        Deadline::Scope deadline(context.rpcDeadline);
+        body = context.responseCache->getOrBuild(version, cacheKey, appendData);
+    } catch (const LocationNotFound& e) {
+        return JsonError(404, e.what());
+    } catch (const DatabaseUnavailable& e) {
+        return JsonError(503, e.what());
+    } catch (const DeadlineExceeded& e) {
+        return JsonError(504, e.what());
+    } catch (const exception& e) {
+        return JsonError(500, e.what());
+    }
+    string tag = body->etag.empty() ? ResponseBody::entityTag(body->text) : body->etag;
+    string gzipTag = tag.substr(0, tag.size() - 1) + "-gzip\"";
+    if (const string* match = MatchingETag(req.get_header_value("If-None-Match"), tag, gzipTag)) {
+        res.code = 304;
+        res.set_header("ETag", *match);
+        if (context.compression.enabled) res.set_header("Vary", "Accept-Encoding");
+        return res;
+    }
+
+    bool acceptsGzip = context.compression.enabled &&
+                       Compression::acceptsGzip(req.get_header_value("Accept-Encoding"));
+    res.set_header("Content-Type", "application/json");
+    bool gzipped = SetBody(res, body, acceptsGzip);
+    res.set_header("ETag", gzipped ? gzipTag : tag);
+    return res;
+}
+
+// ADMIN_TOKEN unset or empty disables every admin operation. The compare
+// takes the same time wherever the first mismatch is, so response timing
+// does not reveal how much of a guess was right.
+bool AdminAuthorized(string_view given) {
+    const char* token = getenv("ADMIN_TOKEN");
+    if (!token || !*token) return false;
+    string_view expected(token);
+    unsigned char diff = given.size() == expected.size() ? 0 : 1;
+    for (size_t i = 0; i < given.size(); i++) {
+        diff |= static_cast<unsigned char>(given[i] ^ expected[i % expected.size()]);
+    }
+    return diff == 0;
+}
+
+// The credentials of an "Authorization: Bearer ..." header, or empty.
+string_view BearerToken(string_view authorization) {
+    constexpr string_view Scheme = "Bearer ";
+    if (authorization.substr(0, Scheme.size()) != Scheme) return {};
+    return authorization.substr(Scheme.size());
+}
+
+// Shortest text that parses back to the same double.
+string FormatDouble(double value) {
+    char buf[32];
+    return string(buf, to_chars(buf, buf + sizeof(buf), value).ptr);
+}
+
+// Percent-encodes everything but RFC 3986 unreserved characters.
+string UrlEncode(string_view text) {
+    static const char* const Hex = "0123456789ABCDEF";
+    string out;
+    out.reserve(text.size());
+    for (unsigned char c : text) {
+        if (isalnum(c) || c == '-' || c == '.' || c == '_' || c == '~') {
+            out += static_cast<char>(c);
+        } else {
+            out += '%';
+            out += Hex[c >> 4];
+            out += Hex[c & 15];
+        }
+    }
+    return out;
+}
+
+// False while the circuit breaker is open and the pool has no idle
+// connection left to serve from. Without a pool the store does not need
+// the database, so it is always available.
+bool DatabaseAvailable() {
+    return !context.pool || context.pool->available() || context.pool->idleCount() > 0;
+}
+
+// Values other components already keep, read when /metrics is scraped.
+void RegisterObservedMetrics() {
+    if (context.pool) {
+        Metrics::observe("db_pool_connections", "Open pooled connections", "", false,
+                         [] { return context.pool->size(); });
+        Metrics::observe("db_pool_idle_connections", "Idle pooled connections", "", false,
+                         [] { return context.pool->idleCount(); });
+        Metrics::observe("db_breaker_open", "1 while the connection circuit breaker is open", "", false,
+                         [] { return context.pool->available() ? 0.0 : 1.0; });
+    }
+    for (size_t i = 0; context.replicas && i < context.replicas->size(); i++) {
+        string labels = "replica=\"" + to_string(i) + '"';
+        Metrics::observe("db_replica_lag_seconds", "Replay lag at a read replica's last check", labels, false,
+                         [i] { return context.replicas->replica(i).lagSeconds(); });
+        Metrics::observe("db_replica_healthy", "1 while a read replica is taking reads", labels, false,
+                         [i] { return context.replicas->replica(i).healthy() ? 1.0 : 0.0; });
+    }
+    Metrics::observe("cache_hits_total", "Cache lookups answered from the cache", "cache=\"response\"", true,
+                     [] { return context.responseCache->hits(); });
+    Metrics::observe("cache_hits_total", "Cache lookups answered from the cache", "cache=\"location\"", true,
+                     [] { return context.locations->cacheHits(); });
+    Metrics::observe("cache_misses_total", "Cache lookups that had to load", "cache=\"response\"", true,
+                     [] { return context.responseCache->misses(); });
+    Metrics::observe("cache_misses_total", "Cache lookups that had to load", "cache=\"location\"", true,
+                     [] { return context.locations->cacheMisses(); });
+    if (context.rateLimiter) {
+        Metrics::observe("rate_limiter_log_pending", "Log calls recorded but not yet written", "", false,
+                         [] { return context.rateLimiter->pendingLogCalls(); });
+    }
+    Metrics::observe("location_snapshot_fresh", "1 while the resident snapshot can answer reads", "", false,
+                     [] { return context.locations->snapshotFresh() ? 1.0 : 0.0; });
+}
+
+}
+
+// RPC Methods
+SerializedBody SnapshotRowsBody(const SnapshotRows& rows, FieldMask fields = LocationFields::All) {
+    return ResponseBody::of(ResponseCache::successBody([&](string& out) {
+        JsonWriter::appendLocations(out, rows, fields);
+    }));
+}
+
+// params.fields, which list views use to drop the keys they do not show;
+// every field when absent.
+FieldMask Fields(const RpcParams& params) {
+    return params.fields ? LocationFields::parse(*params.fields) : LocationFields::All;
+}
+
+// Response cache key suffix keeping projections apart from full rows.
+string FieldsKey(FieldMask fields) {
+    return fields == LocationFields::All ? string() : "|" + to_string(fields);
+}
+
+int TopLimit(const RpcParams& params) {
+    int limit = params.limit.value_or(10);
+    if (limit < 0 || static_cast<size_t>(limit) > context.maxPageSize)
+        throw runtime_error("Invalid 'limit' (0-" + to_string(context.maxPageSize) + ")");
+    return limit;
+}
+
+// Keyset page: after_rating/after_id are the rating and id of the last row
+// of the previous page.
+SerializedBody GetTopLocationsPage(const RpcParams& params, int limit) {
+    if (!params.afterRating || !params.afterId)
+        throw runtime_error("'after_rating' and 'after_id' must be given together");
+    FieldMask fields = Fields(params);
+    if (auto local = context.locations->topPageLocal(*params.afterRating, *params.afterId, limit))
+        return SnapshotRowsBody(*local, fields);
+    auto rows = context.locations->getTopLocationsAfter(*params.afterRating, *params.afterId, limit);
+    return ResponseBody::of(ResponseCache::successBody([&](string& out) {
+        JsonWriter::appendLocations(out, rows, fields);
+    }));
+}
+
+// The resident snapshot, when enabled and fresh, answers ahead of the cache
+// and the database. A projection skips the full-row cache and asks the
+// store for just its columns.
+void AppendTopLocations(string& out, int limit, FieldMask fields) {
+    if (auto local = context.locations->topLocal(limit)) JsonWriter::appendLocations(out, *local, fields);
+    else if (fields == LocationFields::All) JsonWriter::appendLocations(out, *context.locations->getTopLocations(limit));
+    else JsonWriter::appendLocations(out, context.locations->getTopLocations(limit, fields), fields);
+}
+
+void AppendLocationById(string& out, const string& id, FieldMask fields) {
+    if (auto local = context.locations->locationByIdLocal(id)) {
+        JsonWriter::appendLocation(out, local->snapshot->view(local->rows[0]), fields);
+    } else if (fields == LocationFields::All) {
+        JsonWriter::appendLocation(out, *context.locations->getLocationById(id));
+    } else {
+        JsonWriter::appendLocation(out, context.locations->getLocationById(id, fields)[0], fields);
+    }
+}
+
+SerializedBody GetTopLocations(const RpcParams& params) {
+    int limit = TopLimit(params);
+    if (params.afterRating || params.afterId) return GetTopLocationsPage(params, limit);
+    FieldMask fields = Fields(params);
+    return context.responseCache->getOrBuild(context.locations->dataVersion(),
+                                             RpcCacheKey("top:" + to_string(limit) + FieldsKey(fields)),
+                                             [&](string& out) { AppendTopLocations(out, limit, fields); });
+}
+
+SerializedBody GetLocationById(const RpcParams& params) {
+    if (!params.id)
+        throw runtime_error("Invalid or missing 'id'");
+    const string& id = *params.id;
+    FieldMask fields = Fields(params);
+    return context.responseCache->getOrBuild(context.locations->dataVersion(),
+                                             RpcCacheKey("id:" + id + FieldsKey(fields)),
+                                             [&](string& out) { AppendLocationById(out, id, fields); });
+}
+
+// Batch form of getLocationById: every id in the batch is looked up together.
+vector<SerializedBody> GetLocationByIdBatch(const vector<RpcParams>& calls) {
+    vector<string> ids;
+    for (const auto& call : calls) {
+        if (call.id) ids.push_back(*call.id);
+    }
+    vector<exception_ptr> errors;
+    auto locations = context.locations->getLocationsByIds(ids, &errors);
+
+    vector<SerializedBody> responses;
+    responses.reserve(calls.size());
+    size_t next = 0;
+    for (const auto& call : calls) {
+        if (!call.id) {
+            responses.push_back(ResponseBody::of(
+                json{{"success", false}, {"error", "Invalid or missing 'id'"}}.dump()));
+            continue;
+        }
+        const exception_ptr& error = errors[next];
+        const auto& loc = locations[next++];
+        if (error) {
+            responses.push_back(PlainRpcDispatcher::errorBody(error));
+            continue;
+        }
+        if (!loc) {
+            responses.push_back(ResponseBody::of(
+                json{{"success", false}, {"error", "Location not found"}}.dump()));
+            continue;
+        }
+        FieldMask fields;
+        try {
+            fields = Fields(call);
+        } catch (const exception& e) {
+            responses.push_back(ResponseBody::of(json{{"success", false}, {"error", e.what()}}.dump()));
+            continue;
+        }
+        responses.push_back(ResponseBody::of(ResponseCache::successBody([&](string& out) {
+            JsonWriter::appendLocation(out, *loc, fields);
+        })));
+    }
+    return responses;
+}
+
+// Looks up several locations in one round-trip. data holds one entry per
+// requested id, in order, with null for ids that did not match.
+SerializedBody GetLocationsByIds(const RpcParams& params) {
+    if (!params.ids)
+        throw runtime_error("Invalid or missing 'ids'");
+    if (params.ids->size() > PlainRpcDispatcher::MaxBatchSize)
+        throw runtime_error("Too many ids (max " + to_string(PlainRpcDispatcher::MaxBatchSize) + ")");
+    // A lookup that failed on its own reads as null, like an unknown id.
+    vector<exception_ptr> errors;
+    auto locations = context.locations->getLocationsByIds(*params.ids, &errors);
+    return ResponseBody::of(ResponseCache::successBody([&](string& out) {
+        JsonWriter::appendLocations(out, locations);
+    }));
+}
+
+// Answered from the snapshot's search index when it is fresh, otherwise by SQL.
+SerializedBody SearchLocations(const RpcParams& params) {
+    if (!params.query)
+        throw runtime_error("Invalid or missing 'query'");
+    FieldMask fields = Fields(params);
+    if (auto hits = context.locations->searchLocal(*params.query)) return SnapshotRowsBody(*hits, fields);
+    auto results = context.locations->searchLocations(*params.query, fields);
+    return ResponseBody::of(ResponseCache::successBody([&](string& out) {
+        JsonWriter::appendLocations(out, results, fields);
+    }));
+}
+
+// k nearest located rows to params.latitude/longitude, from the snapshot's
+// geo index; there is no database fallback, so it needs LOCATION_SNAPSHOT=1
+// and a snapshot that holds the whole table.
+SerializedBody GetNearbyLocations(const RpcParams& params) {
+    if (!params.latitude || !(abs(*params.latitude) <= 90))
+        throw runtime_error("Invalid or missing 'latitude'");
+    if (!params.longitude || !(abs(*params.longitude) <= 180))
+        throw runtime_error("Invalid or missing 'longitude'");
+    double radiusKm = params.radiusKm.value_or(numeric_limits<double>::infinity());
+    if (!(radiusKm >= 0))
+        throw runtime_error("Invalid 'radius_km'");
+    int limit = params.limit.value_or(10);
+    if (limit < 0 || limit > 100)
+        throw runtime_error("Invalid 'limit' (0-100)");
+    auto nearby = context.locations->nearbyLocal(*params.latitude, *params.longitude, limit, radiusKm);
+    if (!nearby)
+        throw runtime_error("Nearby search unavailable");
+    return SnapshotRowsBody(*nearby);
+}
+
+// Async forms of the hot read methods: the Crow worker returns as soon as
+// the query is sent, and the reply comes on the executor thread (/rpc
+// hands it back to the connection's io thread to send).
+// Bodies go through the same response cache keys as the blocking versions.
+template <typename Query, typename Build>
+void replyFromQuery(const string& baseKey, Query query, Build build, PlainRpcDispatcher::AsyncReply reply) {
+    uint64_t version = context.locations->dataVersion();
+    string key = RpcCacheKey(baseKey);
+    if (auto cached = context.responseCache->find(version, key)) {
+        reply(cached, nullptr);
+        return;
+    }
+    query([=](const LocationRows* rows, exception_ptr error) {
+        if (error) {
+            reply(nullptr, error);
+            return;
+        }
+        try {
+            reply(context.responseCache->store(version, key, ResponseCache::successBody([&](string& out) {
+                build(out, *rows);
+            })), nullptr);
+        } catch (...) {
+            reply(nullptr, current_exception());
+        }
+    });
+}
+
+// A resident snapshot makes these cheap enough to answer inline.
+// Pages and projections have no async form and are answered on the calling
+// thread.
+void GetTopLocationsAsync(const RpcParams& params, PlainRpcDispatcher::AsyncReply reply) {
+    int limit = TopLimit(params);
+    if (params.afterRating || params.afterId || params.fields || context.locations->topLocal(limit)) {
+        reply(GetTopLocations(params), nullptr);
+        return;
+    }
+    replyFromQuery("top:" + to_string(limit),
+        [limit](RowsCallback done) { context.locations->topLocationsAsync(limit, move(done)); },
+        [](string& out, const LocationRows& rows) { JsonWriter::appendLocations(out, rows); },
+        move(reply));
+}
+
+void GetLocationByIdAsync(const RpcParams& params, PlainRpcDispatcher::AsyncReply reply) {
+    if (!params.id)
+        throw runtime_error("Invalid or missing 'id'");
+    string id = *params.id;
+    if (params.fields || context.locations->locationByIdLocal(id)) {
+        reply(GetLocationById(params), nullptr);
+        return;
+    }
+    replyFromQuery("id:" + id,
+        [id](RowsCallback done) { context.locations->locationByIdAsync(id, move(done)); },
+        [](string& out, const LocationRows& rows) {
+            if (rows.empty()) throw LocationNotFound();
+            JsonWriter::appendLocation(out, rows[0]);
+        },
+        move(reply));
+}
+
+void SearchLocationsAsync(const RpcParams& params, PlainRpcDispatcher::AsyncReply reply) {
+    if (!params.query)
+        throw runtime_error("Invalid or missing 'query'");
+    if (params.fields) {
+        reply(SearchLocations(params), nullptr);
+        return;
+    }
+    if (auto hits = context.locations->searchLocal(*params.query)) {
+        reply(SnapshotRowsBody(*hits), nullptr);
+        return;
+    }
+    context.locations->searchLocationsAsync(*params.query, [reply](const LocationRows* rows, exception_ptr error) {
+        if (error) {
+            reply(nullptr, error);
+            return;
+        }
+        reply(ResponseBody::of(ResponseCache::successBody([&](string& out) {
+            JsonWriter::appendLocations(out, *rows);
+        })), nullptr);
+    });
+}
+
+// Admin hook for pushing data changes out of the read cache. Disabled unless
+// ADMIN_TOKEN is set, and then requires params.token to match it.
+json InvalidateCache(const json& params) {
+    if (!params.contains("token") || !params["token"].is_string() ||
+        !AdminAuthorized(params["token"].get_ref<const string&>()))
+        throw runtime_error("Unauthorized");
+    context.locations->invalidateCache();
+    return {{"success", true}};
+}
+
+shared_ptr<PlainRpcDispatcher> BuildRpcDispatcher(const ServerContext& serverContext) {
+    context = serverContext;
+    auto dispatcher = make_shared<PlainRpcDispatcher>();
+    dispatcher->registerTypedMethod("getTopLocations", GetTopLocations);
+    dispatcher->registerTypedMethod("getLocationById", GetLocationById);
+    dispatcher->registerTypedMethod("searchLocations", SearchLocations);
+    dispatcher->registerTypedMethod("getLocationsByIds", GetLocationsByIds);
+    dispatcher->registerTypedMethod("getNearbyLocations", GetNearbyLocations);
+    dispatcher->registerBatchHandler("getLocationById", GetLocationByIdBatch);
+    dispatcher->registerMethod("invalidateCache", InvalidateCache);
+    if (context.locations->hasAsync()) {
+        dispatcher->registerAsyncHandler("getTopLocations", GetTopLocationsAsync);
+        dispatcher->registerAsyncHandler("getLocationById", GetLocationByIdAsync);
+        dispatcher->registerAsyncHandler("searchLocations", SearchLocationsAsync);
+    }
+    dispatcher->freeze();
+    RegisterObservedMetrics();
+    return dispatcher;
+}
+
+void RegisterRoutes(ServerApp& app, shared_ptr<PlainRpcDispatcher> dispatcher) {
+    // Ultra-strict CORS configuration
+    auto& cors = app.get_middleware<crow::CORSHandler>();
+    cors
+        .global()
+        .headers("Content-Type", "Authorization", "X-Requested-With")
+        .methods("POST"_method, "GET"_method, "OPTIONS"_method)
+        .origin("*")
+        .max_age(86400);
+
+    // Health endpoint
+    CROW_ROUTE(app, "/health")([](){
+        return crow::response(200, "OK");
+    });
+
+    // Liveness: the process is up. Readiness: it can answer reads, from
+    // the database or from a fresh resident snapshot.
+    CROW_ROUTE(app, "/health/live")([](){
+        return crow::response(200, "OK");
+    });
+
+    CROW_ROUTE(app, "/health/ready")([](){
+        if (!DatabaseAvailable() && !context.locations->snapshotFresh()) {
+            return crow::response(503, "Database unavailable");
+        }
+        return crow::response(200, "OK");
+    });
+
+    CROW_ROUTE(app, "/metrics")([](){
+        crow::response res(200, Metrics::render());
+        res.set_header("Content-Type", "text/plain; version=0.0.4");
+        return res;
+    });
+
+    // Full export as NDJSON, one location per line, best rating first, in
+    // keyset pages of at most maxPageSize rows ("limit" asks for fewer).
+    // Crow 1.0 cannot stream a handler's body, so the page bounds what is
+    // held; a full page carries a Link rel="next" with the cursor of its
+    // last row. Needs ADMIN_TOKEN as a bearer token.
+    CROW_ROUTE(app, "/locations/export")([](const crow::request& req){
+        if (!AdminAuthorized(BearerToken(req.get_header_value("Authorization")))) {
+            return JsonError(401, "Unauthorized");
+        }
+        int limit = static_cast<int>(context.maxPageSize);
+        optional<double> afterRating;
+        const char* afterId = req.url_params.get("after_id");
+        try {
+            if (const char* value = req.url_params.get("limit")) {
+                size_t used = 0;
+                int requested = stoi(value, &used);
+                if (value[used] != '\0' || requested < 1 || requested > limit) throw invalid_argument("limit");
+                limit = requested;
+            }
+            if (const char* value = req.url_params.get("after_rating")) {
+                size_t used = 0;
+                afterRating = stod(value, &used);
+                if (value[used] != '\0') throw invalid_argument("after_rating");
+            }
+        } catch (const exception&) {
+            return JsonError(400, "Invalid 'limit' (1-" + to_string(context.maxPageSize) + ") or 'after_rating'");
+        }
+        if (afterRating.has_value() != (afterId != nullptr)) {
+            return JsonError(400, "'after_rating' and 'after_id' must be given together");
+        }
+
+        crow::response res;
+        optional<SnapshotRows> local;
+        optional<LocationRows> fetched;
+        vector<LocationView> views;
+        try {
+            Deadline::Scope deadline(context.rpcDeadline);
+            local = afterRating ? context.locations->topPageLocal(*afterRating, afterId, limit)
+                                : context.locations->topLocal(limit);
+            if (local) {
+                views.reserve(local->rows.size());
+                for (uint32_t row : local->rows) views.push_back(local->snapshot->view(row));
+            } else if (!DatabaseAvailable()) {
+                return JsonError(503, "Database unavailable");
+            } else {
+                fetched = afterRating ? context.locations->getTopLocationsAfter(*afterRating, afterId, limit)
+                                      : context.locations->getTopLocations(limit, LocationFields::All);
+                views.assign(fetched->begin(), fetched->end());
+            }
+            for (const auto& view : views) {
+                JsonWriter::appendLocation(res.body, view);
+                res.body += '\n';
+            }
+        } catch (const DatabaseUnavailable& e) {
+            return JsonError(503, e.what());
+        } catch (const DeadlineExceeded& e) {
+            return JsonError(504, e.what());
+        } catch (const exception& e) {
+            cerr << "[Export] " << e.what() << endl;
+            return JsonError(500, "Export failed");
+        }
+        if (!views.empty() && views.size() == static_cast<size_t>(limit)) {
+            const LocationView& last = views.back();
+            res.set_header("Link", "</locations/export?limit=" + to_string(limit) + "&after_rating=" +
+                                       FormatDouble(last.rating) + "&after_id=" + UrlEncode(last.id) +
+                                       ">; rel=\"next\"");
+        }
+        res.set_header("Content-Type", "application/x-ndjson");
+        res.set_header("Access-Control-Allow-Origin", "*");
+        return res;
+    });
+
+    // Cacheable GET forms of getTopLocations and getLocationById, for
+    // browsers and edge caches. Same bodies as /rpc. Crow tries routes in
+    // registration order, so these follow /locations/export and
+    // /locations/top comes before /locations/<id>.
+    CROW_ROUTE(app, "/locations/top")([](const crow::request& req){
+        RpcParams params;
+        int limit;
+        try {
+            if (const char* value = req.url_params.get("limit")) {
+                size_t used = 0;
+                params.limit = stoi(value, &used);
+                if (value[used] != '\0') throw invalid_argument("limit");
+            }
+            limit = TopLimit(params);
+        } catch (const exception&) {
+            return JsonError(400, "Invalid 'limit' (0-" + to_string(context.maxPageSize) + ")");
+        }
+        return CacheableGet(req, "top:" + to_string(limit), [limit](string& out) {
+            AppendTopLocations(out, limit, LocationFields::All);
+        });
+    });
+
+    CROW_ROUTE(app, "/locations/<string>")([](const crow::request& req, const string& id){
+        return CacheableGet(req, "id:" + id, [&id](string& out) {
+            AppendLocationById(out, id, LocationFields::All);
+        });
+    });
+
+    // Main RPC endpoint
+    CROW_ROUTE(app, "/rpc")
+        .methods("POST"_method, "OPTIONS"_method)
+    // Takes the response by reference so async methods can complete it
+    // after the handler returns; every path ends with res.end().
+    ([dispatcher](const crow::request& req, crow::response& res){
+        if (req.method == "OPTIONS"_method) {
+            res.code = 204;
+            res.set_header("Access-Control-Allow-Origin", "*");
+            res.end();
+            return;
+        }
+
+        res.set_header("Content-Type", "application/json");
+        res.set_header("Access-Control-Allow-Origin", "*");
+        bool acceptsGzip = context.compression.enabled &&
+                           Compression::acceptsGzip(req.get_header_value("Accept-Encoding"));
+
+        // Breaker open and no fresh snapshot to answer from: fail at once
+        // rather than queue on a dead database. With the snapshot, only the
+        // calls that still need the database get a 503, from the dispatcher.
+        if (!DatabaseAvailable() && !context.locations->snapshotFresh()) {
+            RpcMetrics::unavailable.inc();
+            res.code = 503;
+            res.body = json{{"success", false}, {"error", "Database unavailable"}}.dump();
+            res.end();
+            return;
+        }
+
+        // Fast path: decode the fields the typed methods need without a
+        // json tree. Anything else takes the full parse below.
+        auto phaseStart = chrono::steady_clock::now();
+        RpcRequest fastRequest;
+        bool fastPath = parseRpcRequest(req.body, fastRequest) &&
+                        dispatcher->hasTypedMethod(fastRequest.method);
+
+        json request;
+        if (!fastPath) {
+            try {
+                request = json::parse(req.body);
+            } catch (...) {
+                RpcMetrics::badRequest.inc();
+                res.code = 400;
+                res.body = json{{"success", false}, {"error", "Invalid JSON"}}.dump();
+                res.end();
+                return;
+            }
+        }
+
+        RpcMetrics::parse.recordSince(phaseStart);
+        phaseStart = chrono::steady_clock::now();
+
+        // A batch counts as one request per call for rate limiting.
+        // The ids point into fastRequest or request, both alive until
+        // the handler returns.
+        vector<const string*> userids;
+        auto collectUserid = [&userids](json& call) {
+            if (call.is_object() && call["params"].contains("userid") && call["params"]["userid"].is_string()) {
+                const string& userid = call["params"]["userid"].get_ref<const string&>();
+                if (!userid.empty()) userids.push_back(&userid);
+            }
+        };
+        if (fastPath) {
+            if (fastRequest.params.userid && !fastRequest.params.userid->empty()) {
+                userids.push_back(&*fastRequest.params.userid);
+            }
+        } else if (request.is_array()) {
+            for (auto& call : request) collectUserid(call);
+        } else {
+            collectUserid(request);
+        }
+
+        for (const string* userid : userids) {
+            if (context.rateLimiter && !context.rateLimiter->tryAcquire(*userid)) {
+                RpcMetrics::rateLimited.inc();
+                res.code = 429;
+                res.body = json{{"success", false}, {"error", "Rate limit exceeded"}}.dump();
+                res.end();
+                return;
+            }
+        }
+
+        RpcMetrics::rateLimit.recordSince(phaseStart);
+        phaseStart = chrono::steady_clock::now();
+
+        // Async queries take the deadline with them when they are queued.
+        Deadline::Scope deadline(context.rpcDeadline);
+
+        if (fastPath && dispatcher->hasAsyncMethod(fastRequest.method)) {
+            string userid = userids.empty() ? string() : *userids.front();
+            // The reply may come on an executor thread, but the response
+            // belongs to the connection's io thread, so it is finished there.
+            dispatcher->dispatchAsync(fastRequest, [&req, &res, userid, phaseStart, acceptsGzip](SerializedBody body) {
+                req.io_service->post([&res, body, userid, phaseStart, acceptsGzip] {
+                    RpcMetrics::dispatch.recordSince(phaseStart);
+                    if (context.rateLimiter && !userid.empty()) context.rateLimiter->recordResponse(userid);
+                    SetBody(res, body, acceptsGzip);
+                    res.end();
+                });
+            });
+            return;
+        }
+
+        SerializedBody body;
+        if (fastPath) body = dispatcher->dispatchBody(fastRequest);
+        else if (request.is_array()) body = dispatcher->dispatchBatch(request);
+        else body = dispatcher->dispatchBody(request);
+        RpcMetrics::dispatch.recordSince(phaseStart);
+        if (context.rateLimiter) {
+            for (const string* userid : userids) context.rateLimiter->recordResponse(*userid);
+        }
+        SetBody(res, body, acceptsGzip);
+        res.end();
+    });
+}
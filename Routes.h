@@ -0,0 +1,47 @@
+#ifndef ROUTES_H
+#define ROUTES_H
+
+#include <crow.h>
+#include <crow/middlewares/cors.h>
+#include "Compression.h"
+#include "ConnectionPool.h"
+#include "LocationService.h"
+#include "PlainRpcDispatcher.h"
+#include <chrono>
+#include <cstddef>
+#include <memory>
+
+class RateLimiter;
+class ReplicaRouter;
+class ResponseCache;
+
+using ServerApp = crow::App<crow::CORSHandler>;
+
+// What the RPC methods and routes serve from. Everything must outlive the
+// app; the pointers are borrowed.
+struct ServerContext {
+    std::shared_ptr<ConnectionPool> pool;  // nullptr: the store needs no database
+    ReplicaRouter* replicas = nullptr;     // nullptr: no read replicas
+    LocationService* locations = nullptr;
+    ResponseCache* responseCache = nullptr;
+    RateLimiter* rateLimiter = nullptr;  // nullptr: no rate limiting
+    size_t maxPageSize = 1000;           // ceiling on getTopLocations' limit
+    CompressionConfig compression;       // /rpc and GET response bodies
+    int httpMaxAgeSeconds = 30;          // Cache-Control max-age of the GET reads
+    std::chrono::milliseconds rpcDeadline{0};  // per-request database budget; 0: none
+};
+
+// Registers the location RPC methods (the async forms too, if the service
+// has an executor) and freezes the dispatcher. Call once per process: the
+// methods read the context from a single global.
+std::shared_ptr<PlainRpcDispatcher> BuildRpcDispatcher(const ServerContext& context);
+
+// CORS plus /health, /health/live, /health/ready, /metrics,
+// /locations/export, the cacheable GET reads /locations/top?limit= and
+// /locations/<id>, and /rpc.
+void RegisterRoutes(ServerApp& app, std::shared_ptr<PlainRpcDispatcher> dispatcher);
+
+// The getTopLocations method itself, for warming its cache entries.
+SerializedBody GetTopLocations(const RpcParams& params);
+
+#endif
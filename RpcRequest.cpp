@@ -0,0 +1,201 @@
+#include "RpcRequest.h"
+#include <climits>
+
+namespace {
+
+// Unset unless every element is a string; the handler then reports the
+// param as invalid, while the params after it are still read.
+std::optional<std::vector<std::string>> stringArray(const json& params, const char* name) {
+    if (!params.contains(name) || !params[name].is_array()) return std::nullopt;
+    std::vector<std::string> values;
+    for (const auto& value : params[name]) {
+        if (!value.is_string()) return std::nullopt;
+        values.push_back(value.get<std::string>());
+    }
+    return values;
+}
+
+}
+
+RpcParams RpcParams::fromJson(const json& params) {
+    RpcParams p;
+    if (params.contains("userid") && params["userid"].is_string()) p.userid = params["userid"].get<std::string>();
+    if (params.contains("limit")) p.limit = params["limit"].get<int>();
+    if (params.contains("id") && params["id"].is_string()) p.id = params["id"].get<std::string>();
+    if (params.contains("query") && params["query"].is_string()) p.query = params["query"].get<std::string>();
+    p.ids = stringArray(params, "ids");
+    p.fields = stringArray(params, "fields");
+    if (params.contains("latitude") && params["latitude"].is_number()) p.latitude = params["latitude"].get<double>();
+    if (params.contains("longitude") && params["longitude"].is_number()) p.longitude = params["longitude"].get<double>();
+    if (params.contains("radius_km") && params["radius_km"].is_number()) p.radiusKm = params["radius_km"].get<double>();
+    if (params.contains("after_rating") && params["after_rating"].is_number()) p.afterRating = params["after_rating"].get<double>();
+    if (params.contains("after_id") && params["after_id"].is_string()) p.afterId = params["after_id"].get<std::string>();
+    return p;
+}
+
+namespace {
+
+// Any callback returning false aborts the parse, which sends the request
+// down the DOM path.
+class RpcRequestSax {
+private:
+    enum class Field { None, Method, Ignored, Userid, Limit, Id, Query, Ids, Latitude, Longitude, RadiusKm, AfterRating, AfterId, Fields };
+
+    RpcRequest& out_;
+    int depth_ = 0;
+    Field field_ = Field::None;
+    bool inParams_ = false;
+    std::vector<std::string>* array_ = nullptr;  // the string array being read
+    bool sawMethod_ = false;
+    bool sawParams_ = false;
+
+    std::optional<std::string>* stringField() {
+        switch (field_) {
+            case Field::Userid: return &out_.params.userid;
+            case Field::Id: return &out_.params.id;
+            case Field::Query: return &out_.params.query;
+            case Field::AfterId: return &out_.params.afterId;
+            default: return nullptr;
+        }
+    }
+
+    std::optional<double>* numberField() {
+        switch (field_) {
+            case Field::Latitude: return &out_.params.latitude;
+            case Field::Longitude: return &out_.params.longitude;
+            case Field::RadiusKm: return &out_.params.radiusKm;
+            case Field::AfterRating: return &out_.params.afterRating;
+            default: return nullptr;
+        }
+    }
+
+    bool number(double value) {
+        auto* target = numberField();
+        if (!target) return scalar();
+        *target = value;
+        field_ = Field::None;
+        return true;
+    }
+
+    // Non-string scalars are only allowed where they are ignored.
+    bool scalar() {
+        bool ok = depth_ == 1 && field_ == Field::Ignored;
+        field_ = Field::None;
+        return ok;
+    }
+
+public:
+    explicit RpcRequestSax(RpcRequest& out) : out_(out) {}
+
+    bool complete() const { return sawMethod_ && sawParams_; }
+
+    bool null() { return scalar(); }
+    bool boolean(bool) { return scalar(); }
+    bool number_float(double value, const std::string&) { return number(value); }
+    bool binary(json::binary_t&) { return false; }
+
+    bool number_integer(json::number_integer_t value) {
+        if (field_ == Field::Limit && value >= INT_MIN && value <= INT_MAX) {
+            out_.params.limit = static_cast<int>(value);
+            field_ = Field::None;
+            return true;
+        }
+        return number(static_cast<double>(value));
+    }
+
+    bool number_unsigned(json::number_unsigned_t value) {
+        if (field_ == Field::Limit && value <= static_cast<json::number_unsigned_t>(INT_MAX)) {
+            out_.params.limit = static_cast<int>(value);
+            field_ = Field::None;
+            return true;
+        }
+        return number(static_cast<double>(value));
+    }
+
+    bool string(std::string& value) {
+        if (array_) {
+            array_->push_back(std::move(value));
+            return true;
+        }
+        if (field_ == Field::Method) {
+            out_.method = std::move(value);
+            sawMethod_ = true;
+        } else if (auto* target = stringField()) {
+            *target = std::move(value);
+        } else if (!(depth_ == 1 && field_ == Field::Ignored)) {
+            return false;
+        }
+        field_ = Field::None;
+        return true;
+    }
+
+    bool start_object(std::size_t) {
+        if (depth_ == 0) {
+            depth_ = 1;
+            return true;
+        }
+        if (depth_ == 1 && inParams_) {
+            depth_ = 2;
+            sawParams_ = true;
+            field_ = Field::None;
+            return true;
+        }
+        return false;
+    }
+
+    bool end_object() {
+        if (depth_ == 2) inParams_ = false;
+        depth_--;
+        return true;
+    }
+
+    // The only arrays accepted are params.ids and params.fields, and only of
+    // strings.
+    bool start_array(std::size_t) {
+        if (depth_ != 2 || array_) return false;
+        if (field_ == Field::Ids) array_ = &out_.params.ids.emplace();
+        else if (field_ == Field::Fields) array_ = &out_.params.fields.emplace();
+        else return false;
+        return true;
+    }
+
+    bool end_array() {
+        array_ = nullptr;
+        field_ = Field::None;
+        return true;
+    }
+
+    bool key(std::string& name) {
+        inParams_ = false;
+        field_ = Field::None;
+        if (depth_ == 1) {
+            if (name == "method") field_ = Field::Method;
+            else if (name == "params") inParams_ = true;
+            else field_ = Field::Ignored;
+            return true;
+        }
+        if (name == "userid") field_ = Field::Userid;
+        else if (name == "limit") field_ = Field::Limit;
+        else if (name == "id") field_ = Field::Id;
+        else if (name == "query") field_ = Field::Query;
+        else if (name == "ids") field_ = Field::Ids;
+        else if (name == "latitude") field_ = Field::Latitude;
+        else if (name == "longitude") field_ = Field::Longitude;
+        else if (name == "radius_km") field_ = Field::RadiusKm;
+        else if (name == "after_rating") field_ = Field::AfterRating;
+        else if (name == "after_id") field_ = Field::AfterId;
+        else if (name == "fields") field_ = Field::Fields;
+        else return false;
+        return true;
+    }
+
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception&) { return false; }
+};
+
+}
+
+bool parseRpcRequest(std::string_view body, RpcRequest& out) {
+    out = RpcRequest{};
+    RpcRequestSax sax(out);
+    return json::sax_parse(body.begin(), body.end(), &sax) && sax.complete();
+}
@@ -0,0 +1,43 @@
+#ifndef RPC_REQUEST_H
+#define RPC_REQUEST_H
+
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using json = nlohmann::json;
+
+// The params the location RPCs understand, already type-checked.
+struct RpcParams {
+    std::optional<std::string> userid;
+    std::optional<int> limit;
+    std::optional<std::string> id;
+    std::optional<std::string> query;
+    std::optional<std::vector<std::string>> ids;
+    std::optional<double> latitude;
+    std::optional<double> longitude;
+    std::optional<double> radiusKm;  // "radius_km"
+    std::optional<double> afterRating;  // "after_rating"
+    std::optional<std::string> afterId;  // "after_id"
+    std::optional<std::vector<std::string>> fields;  // keys to return per location
+
+    // Slow-path conversion from a parsed json tree. Type errors surface the
+    // same way the handlers' own params.value()/is_string() checks did.
+    static RpcParams fromJson(const json& params);
+};
+
+// An /rpc request decoded straight from the body, with no json tree.
+struct RpcRequest {
+    std::string method;
+    RpcParams params;
+};
+
+// SAX-decodes {"method": "...", "params": {...}} into `out`. Returns false if
+// the body is not valid JSON or has any shape the fast path does not cover
+// (missing fields, unknown or non-scalar params, unexpected types); callers
+// then fall back to json::parse and the generic dispatcher path.
+bool parseRpcRequest(std::string_view body, RpcRequest& out);
+
+#endif
@@ -0,0 +1,121 @@
+#include "SearchIndex.h"
+#include <algorithm>
+
+namespace {
+
+bool isTokenByte(unsigned char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c >= 0x80;
+}
+
+template <typename Emit>
+void forEachToken(std::string_view text, Emit emit) {
+    std::string token;
+    for (unsigned char c : text) {
+        if (isTokenByte(c)) {
+            token += static_cast<char>(c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c);
+        } else if (!token.empty()) {
+            emit(token);
+            token.clear();
+        }
+    }
+    if (!token.empty()) emit(token);
+}
+
+uint32_t trigramKey(std::string_view s, size_t i) {
+    return static_cast<uint32_t>(static_cast<unsigned char>(s[i])) << 16 |
+           static_cast<uint32_t>(static_cast<unsigned char>(s[i + 1])) << 8 |
+           static_cast<unsigned char>(s[i + 2]);
+}
+
+}
+
+// Documents are rating ranks rather than rows, so posting lists in
+// ascending order are already in result order.
+SearchIndex::SearchIndex(std::shared_ptr<const LocationSnapshot> snapshot)
+    : snapshot_(std::move(snapshot)) {
+    std::unordered_map<std::string, std::vector<uint32_t>> byTerm;
+    for (uint32_t doc = 0; doc < snapshot_->size(); doc++) {
+        LocationView loc = snapshot_->view(snapshot_->rankedRow(doc));
+        auto add = [&](const std::string& token) {
+            auto& docs = byTerm[token];
+            if (docs.empty() || docs.back() != doc) docs.push_back(doc);
+        };
+        for (std::string_view field : {loc.name, loc.country, loc.state, loc.description}) {
+            forEachToken(field, add);
+        }
+    }
+
+    terms_.reserve(byTerm.size());
+    for (const auto& entry : byTerm) terms_.push_back(entry.first);
+    std::sort(terms_.begin(), terms_.end());
+    postings_.reserve(terms_.size());
+    for (uint32_t t = 0; t < terms_.size(); t++) {
+        postings_.push_back(std::move(byTerm[terms_[t]]));
+        const std::string& term = terms_[t];
+        for (size_t i = 0; i + 3 <= term.size(); i++) {
+            auto& termIds = trigrams_[trigramKey(term, i)];
+            if (termIds.empty() || termIds.back() != t) termIds.push_back(t);
+        }
+    }
+}
+
+bool SearchIndex::hasTokens(std::string_view query) {
+    return std::any_of(query.begin(), query.end(), [](unsigned char c) { return isTokenByte(c); });
+}
+
+void SearchIndex::matchToken(std::string_view token, std::vector<uint64_t>& bits) const {
+    auto markTerm = [&](size_t t) {
+        for (uint32_t doc : postings_[t]) bits[doc >> 6] |= uint64_t{1} << (doc & 63);
+    };
+
+    if (token.size() < 3) {
+        for (auto it = std::lower_bound(terms_.begin(), terms_.end(), token);
+             it != terms_.end() && std::string_view(*it).substr(0, token.size()) == token; ++it) {
+            markTerm(it - terms_.begin());
+        }
+        return;
+    }
+
+    // Terms containing every trigram of the token, rarest trigram first;
+    // then confirmed with a substring check, since the trigrams may be
+    // scattered across the term.
+    std::vector<const std::vector<uint32_t>*> lists;
+    for (size_t i = 0; i + 3 <= token.size(); i++) {
+        auto it = trigrams_.find(trigramKey(token, i));
+        if (it == trigrams_.end()) return;
+        lists.push_back(&it->second);
+    }
+    std::sort(lists.begin(), lists.end(), [](auto* a, auto* b) { return a->size() < b->size(); });
+    for (uint32_t t : *lists.front()) {
+        bool inAll = std::all_of(lists.begin() + 1, lists.end(),
+                                 [t](auto* list) { return std::binary_search(list->begin(), list->end(), t); });
+        if (inAll && terms_[t].find(token) != std::string::npos) markTerm(t);
+    }
+}
+
+std::vector<uint32_t> SearchIndex::search(std::string_view query, size_t limit) const {
+    std::vector<uint32_t> results;
+    size_t words = (snapshot_->size() + 63) / 64;
+    std::vector<uint64_t> matched;
+    std::vector<uint64_t> bits(words);
+    bool first = true;
+    forEachToken(query, [&](const std::string& token) {
+        if (!first && std::none_of(matched.begin(), matched.end(), [](uint64_t w) { return w != 0; })) return;
+        std::fill(bits.begin(), bits.end(), 0);
+        matchToken(token, bits);
+        if (first) {
+            matched = bits;
+            first = false;
+        } else {
+            for (size_t w = 0; w < words; w++) matched[w] &= bits[w];
+        }
+    });
+
+    // The lowest set bits are the best-rated matches.
+    for (size_t w = 0; w < matched.size() && results.size() < limit; w++) {
+        for (uint64_t word = matched[w]; word && results.size() < limit; word &= word - 1) {
+            results.push_back(snapshot_->rankedRow(w * 64 + __builtin_ctzll(word)));
+        }
+    }
+    return results;
+}
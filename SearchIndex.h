@@ -0,0 +1,41 @@
+#ifndef SEARCH_INDEX_H
+#define SEARCH_INDEX_H
+
+#include "LocationSnapshot.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Immutable in-memory full-text index over a LocationSnapshot. name,
+// country, state and description are split into lowercase ASCII-folded
+// tokens (UTF-8 bytes are kept as-is). Every query token must match some
+// token of the location: short query tokens by prefix, tokens of three or
+// more bytes anywhere inside a token, found through a trigram index over
+// the vocabulary. Matches come back best rating first.
+class SearchIndex {
+private:
+    std::shared_ptr<const LocationSnapshot> snapshot_;
+    std::vector<std::string> terms_;                  // sorted vocabulary
+    std::vector<std::vector<uint32_t>> postings_;     // per term, ascending rating ranks
+    std::unordered_map<uint32_t, std::vector<uint32_t>> trigrams_;  // trigram -> term indices
+
+    // Sets the bit of every location matching one query token.
+    void matchToken(std::string_view token, std::vector<uint64_t>& bits) const;
+
+public:
+    explicit SearchIndex(std::shared_ptr<const LocationSnapshot> snapshot);
+
+    // Empty tokenized queries are not answerable here; callers fall back.
+    static bool hasTokens(std::string_view query);
+
+    // Snapshot rows of at most `limit` matches, best rating first.
+    std::vector<uint32_t> search(std::string_view query, size_t limit) const;
+
+    const std::shared_ptr<const LocationSnapshot>& snapshot() const { return snapshot_; }
+    uint64_t dataVersion() const { return snapshot_->dataVersion(); }
+};
+
+#endif
@@ -0,0 +1,252 @@
+#include "SnapshotRefresher.h"
+#include "LocationSnapshot.h"
+#include <poll.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+// How often the Listen loop comes up for air to check for shutdown, full
+// reload deadlines and external invalidations.
+constexpr std::chrono::milliseconds ListenTick{500};
+
+bool sameValue(double a, double b) { return a == b || (std::isnan(a) && std::isnan(b)); }
+
+// True if upserting `loc` would leave `snapshot` as it is.
+bool unchanged(const LocationSnapshot& snapshot, const Location& loc) {
+    auto row = snapshot.find(loc.id);
+    if (!row) return false;
+    LocationView current = snapshot.view(*row);
+    return current.name == loc.name && current.country == loc.country && current.state == loc.state &&
+           current.description == loc.description && current.svg_link == loc.svg_link &&
+           sameValue(current.rating, loc.rating) && sameValue(current.latitude, loc.latitude) &&
+           sameValue(current.longitude, loc.longitude);
+}
+
+}
+
+SnapshotRefresher::SnapshotRefresher(LocationService& service, std::shared_ptr<ConnectionPool> pool,
+                                     SnapshotRefresherConfig config)
+    : service_(service), pool_(std::move(pool)), config_(std::move(config)) {
+    if (!pool_) {
+        throw std::runtime_error("Invalid connection pool provided to SnapshotRefresher.");
+    }
+    if (config_.feed == SnapshotChangeFeed::Poll && config_.changesQuery.empty()) {
+        throw std::runtime_error("SnapshotRefresher: polling needs a changes query");
+    }
+    if (!config_.reloadAtStart && service_.currentSnapshot()) {
+        reloadRequested_ = false;
+        lastFullReload_ = std::chrono::steady_clock::now();
+    }
+    worker_ = std::thread(&SnapshotRefresher::run, this);
+}
+
+SnapshotRefresher::~SnapshotRefresher() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    worker_.join();
+    closeListener();
+}
+
+// Returns false once stopping.
+bool SnapshotRefresher::waitFor(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return !wake_.wait_for(lock, timeout, [this] { return stopping_; });
+}
+
+// Reads the database clock before the table, so a change committed while
+// the reload runs is still after the watermark.
+void SnapshotRefresher::fullReload() {
+    std::string watermark = config_.feed == SnapshotChangeFeed::Poll ? readDatabaseClock() : std::string();
+    auto snapshot = service_.loadSnapshot();
+    size_t rows = snapshot->size(), bytes = snapshot->memoryUsage();
+    service_.publishSnapshot(std::move(snapshot));
+    watermark_ = std::move(watermark);
+    lastFullReload_ = std::chrono::steady_clock::now();
+    reloadRequested_ = false;
+    std::cout << "[Snapshot] Loaded " << rows << " locations (" << bytes / 1024 << " KiB)" << std::endl;
+}
+
+// Already pollOverlap in the past, see SnapshotRefresherConfig.
+std::string SnapshotRefresher::readDatabaseClock() {
+    PooledConnection conn = pool_->checkout();
+    std::string overlap = std::to_string(config_.pollOverlap.count()) + " milliseconds";
+    const char* params[1] = {overlap.c_str()};
+    PGResultWrapper res(PQexecParams(conn.get(), "SELECT (clock_timestamp() - $1::interval)::text", 1, nullptr,
+                                     params, nullptr, nullptr, 0));
+    if (PQresultStatus(res.get()) != PGRES_TUPLES_OK || PQntuples(res.get()) != 1) {
+        throw std::runtime_error("Query failed: " + std::string(PQerrorMessage(conn.get())));
+    }
+    return PQgetvalue(res.get(), 0, 0);
+}
+
+void SnapshotRefresher::applyChanges(const std::vector<std::string>& ids) {
+    auto fetched = service_.fetchLocationsByIds(ids);
+    std::vector<Location> upserts;
+    std::vector<std::string> removed;
+    for (size_t i = 0; i < ids.size(); i++) {
+        if (fetched[i]) upserts.push_back(*fetched[i]);
+        else removed.push_back(ids[i]);
+    }
+    applyRows(std::move(upserts), std::move(removed));
+}
+
+// Only the cache entries of the changed ids (and the top-N lists) are
+// dropped; response bodies are keyed by snapshot generation, which the
+// successor bumps. Rows that match the snapshot already are dropped first,
+// so a delta that changes nothing keeps every cache. If the published
+// snapshot is already behind (an invalidation came from elsewhere), a
+// delta is not enough.
+void SnapshotRefresher::applyRows(std::vector<Location> upserts, std::vector<std::string> removed) {
+    auto base = service_.currentSnapshot();
+    if (!base || base->dataVersion() != service_.dataVersion()) {
+        fullReload();
+        return;
+    }
+    upserts.erase(std::remove_if(upserts.begin(), upserts.end(),
+                                 [&](const Location& loc) { return unchanged(*base, loc); }),
+                  upserts.end());
+    removed.erase(std::remove_if(removed.begin(), removed.end(),
+                                 [&](const std::string& id) { return !base->find(id); }),
+                  removed.end());
+    if (upserts.empty() && removed.empty()) return;
+    std::vector<std::string> changed = removed;
+    for (const auto& loc : upserts) changed.push_back(loc.id);
+    service_.invalidateLocations(changed);
+    service_.publishSnapshot(std::make_shared<const LocationSnapshot>(*base, upserts, removed, base->dataVersion()));
+}
+
+bool SnapshotRefresher::ensureListener() {
+    if (listener_ && PQstatus(listener_) == CONNECTION_OK) return true;
+    closeListener();
+
+    const std::string& conninfo = pool_->config().conninfo;
+    std::string timeout = std::to_string(pool_->config().connectTimeoutSeconds);
+    const char* keywords[] = {"dbname", "connect_timeout", nullptr};
+    const char* values[] = {conninfo.c_str(), timeout.c_str(), nullptr};
+    PGconn* conn = PQconnectdbParams(keywords, values, 1);
+    if (PQstatus(conn) != CONNECTION_OK) {
+        std::cerr << "[Snapshot] LISTEN connection failed: " << PQerrorMessage(conn) << std::endl;
+        PQfinish(conn);
+        return false;
+    }
+    char* channel = PQescapeIdentifier(conn, config_.notifyChannel.c_str(), config_.notifyChannel.size());
+    PGResultWrapper res(PQexec(conn, ("LISTEN " + std::string(channel ? channel : "")).c_str()));
+    PQfreemem(channel);
+    if (PQresultStatus(res.get()) != PGRES_COMMAND_OK) {
+        std::cerr << "[Snapshot] LISTEN failed: " << PQerrorMessage(conn) << std::endl;
+        PQfinish(conn);
+        return false;
+    }
+    listener_ = conn;
+    // Anything that changed while we were not listening is unknown.
+    reloadRequested_ = true;
+    return true;
+}
+
+void SnapshotRefresher::closeListener() {
+    if (listener_) PQfinish(listener_);
+    listener_ = nullptr;
+}
+
+void SnapshotRefresher::collectNotifications(std::chrono::milliseconds timeout,
+                                             std::unordered_set<std::string>& ids) {
+    pollfd fd{PQsocket(listener_), POLLIN, 0};
+    if (::poll(&fd, 1, static_cast<int>(timeout.count())) < 0) return;
+    if (!PQconsumeInput(listener_)) {
+        std::cerr << "[Snapshot] LISTEN connection lost: " << PQerrorMessage(listener_) << std::endl;
+        closeListener();
+        return;
+    }
+    while (PGnotify* notify = PQnotifies(listener_)) {
+        if (*notify->extra) ids.insert(notify->extra);
+        else reloadRequested_ = true;
+        PQfreemem(notify);
+    }
+}
+
+// The next watermark is read before the query, so nothing committed while
+// it runs falls between the two.
+void SnapshotRefresher::poll() {
+    std::string watermark = readDatabaseClock();
+    PooledConnection conn = pool_->checkout();
+    const char* params[1] = {watermark_.c_str()};
+    auto res = std::make_unique<PGResultWrapper>(
+        PQexecParams(conn.get(), config_.changesQuery.c_str(), 1, nullptr, params, nullptr, nullptr, 0));
+    if (PQresultStatus(res->get()) != PGRES_TUPLES_OK) {
+        throw std::runtime_error("Query failed: " + std::string(PQerrorMessage(conn.get())));
+    }
+    conn.release();
+
+    PGresult* result = res->get();
+    int deleted = PQfnumber(result, "deleted");
+    std::vector<bool> isDeleted(PQntuples(result));
+    for (int row = 0; row < PQntuples(result); row++) {
+        isDeleted[row] = deleted >= 0 && PQgetvalue(result, row, deleted)[0] == 't';
+    }
+
+    LocationRows rows(std::move(res));
+    std::vector<Location> upserts;
+    std::vector<std::string> removed;
+    for (size_t row = 0; row < rows.size(); row++) {
+        if (isDeleted[row]) removed.emplace_back(rows[row].id);
+        else upserts.push_back(rows[row].toLocation());
+    }
+    applyRows(std::move(upserts), std::move(removed));
+    watermark_ = std::move(watermark);
+    service_.markSnapshotSynced();
+}
+
+void SnapshotRefresher::run() {
+    for (;;) {
+        try {
+            bool due = std::chrono::steady_clock::now() - lastFullReload_ >= config_.fullReload;
+            auto snapshot = service_.currentSnapshot();
+            // Polling also needs the watermark only a full reload provides.
+            bool noWatermark = config_.feed == SnapshotChangeFeed::Poll && watermark_.empty();
+            if (reloadRequested_ || due || noWatermark || !snapshot ||
+                snapshot->dataVersion() != service_.dataVersion()) {
+                fullReload();
+            }
+
+            switch (config_.feed) {
+                case SnapshotChangeFeed::None:
+                    if (!waitFor(ListenTick)) return;
+                    break;
+
+                case SnapshotChangeFeed::Poll:
+                    if (!waitFor(config_.pollInterval)) return;
+                    poll();
+                    break;
+
+                case SnapshotChangeFeed::Listen: {
+                    if (!ensureListener()) {
+                        if (!waitFor(std::chrono::milliseconds(1000))) return;
+                        break;
+                    }
+                    if (reloadRequested_) break;  // fresh LISTEN: reload first
+                    std::unordered_set<std::string> ids;
+                    collectNotifications(ListenTick, ids);
+                    if (!ids.empty() && listener_) collectNotifications(config_.debounce, ids);
+                    if (!waitFor(std::chrono::milliseconds(0))) return;
+                    if (!listener_) break;
+                    if (!ids.empty() && !reloadRequested_) {
+                        applyChanges(std::vector<std::string>(ids.begin(), ids.end()));
+                    }
+                    // An open LISTEN session that reported nothing means
+                    // nothing changed.
+                    service_.markSnapshotSynced();
+                    break;
+                }
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "[Snapshot] Refresh failed: " << e.what() << std::endl;
+            if (!waitFor(std::chrono::milliseconds(1000))) return;
+        }
+    }
+}
@@ -0,0 +1,89 @@
+#ifndef SNAPSHOT_REFRESHER_H
+#define SNAPSHOT_REFRESHER_H
+
+#include "ConnectionPool.h"
+#include "LocationService.h"
+#include <postgresql/libpq-fe.h>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+// Where changed rows are learned from, between full reloads.
+enum class SnapshotChangeFeed {
+    None,    // full reloads only
+    Listen,  // LISTEN on a channel whose NOTIFY payload is a location id
+    Poll,    // run changesQuery for rows updated since the previous poll
+};
+
+struct SnapshotRefresherConfig {
+    // Full reload period: the only refresh with feed None, and a safety net
+    // for anything the change feed missed otherwise.
+    std::chrono::milliseconds fullReload{60000};
+    SnapshotChangeFeed feed = SnapshotChangeFeed::None;
+    // Listen: a trigger is expected to NOTIFY this channel with the changed
+    // row's id. An empty payload asks for a full reload.
+    std::string notifyChannel = "locations_changed";
+    // Notifications arriving within this window are applied together.
+    std::chrono::milliseconds debounce{200};
+    // Poll: $1 is the watermark as timestamptz text; the query should
+    // return rows with updated_at >= $1, as location columns plus an
+    // optional boolean "deleted" column for soft deletes.
+    std::string changesQuery;
+    std::chrono::milliseconds pollInterval{2000};
+    // The watermark is the database clock at the previous poll minus this.
+    // updated_at is stamped at transaction start (now()), so a row whose
+    // transaction ran longer than this before committing can still be
+    // missed until the next full reload. Rows the overlap fetches again
+    // match the snapshot and change nothing.
+    std::chrono::milliseconds pollOverlap{60000};
+    // False when startup already published a snapshot straight from the
+    // database, so the first full reload waits a full period.
+    bool reloadAtStart = true;
+};
+
+// Keeps LocationService's resident snapshot current from a background
+// thread. Changed rows are fetched on their own and folded into a
+// copy-on-write successor of the published snapshot, which is then swapped
+// in atomically; readers never wait and never see a partial build.
+class SnapshotRefresher {
+private:
+    LocationService& service_;
+    std::shared_ptr<ConnectionPool> pool_;
+    SnapshotRefresherConfig config_;
+
+    PGconn* listener_ = nullptr;  // not pooled: LISTEN is per-session state
+    std::string watermark_;
+    std::chrono::steady_clock::time_point lastFullReload_;
+    bool reloadRequested_ = true;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    std::thread worker_;
+
+    void fullReload();
+    void applyChanges(const std::vector<std::string>& ids);
+    void applyRows(std::vector<Location> upserts, std::vector<std::string> removed);
+    bool ensureListener();
+    void closeListener();
+    // Waits up to `timeout` for notifications and adds their ids to `ids`.
+    void collectNotifications(std::chrono::milliseconds timeout, std::unordered_set<std::string>& ids);
+    void poll();
+    std::string readDatabaseClock();
+    bool waitFor(std::chrono::milliseconds timeout);
+    void run();
+
+public:
+    SnapshotRefresher(LocationService& service, std::shared_ptr<ConnectionPool> pool,
+                      SnapshotRefresherConfig config = {});
+    ~SnapshotRefresher();
+    SnapshotRefresher(const SnapshotRefresher&) = delete;
+    SnapshotRefresher& operator=(const SnapshotRefresher&) = delete;
+};
+
+#endif
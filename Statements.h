@@ -0,0 +1,31 @@
+#ifndef STATEMENTS_H
+#define STATEMENTS_H
+
+#include "ConnectionPool.h"
+#include <vector>
+
+// The fixed set of hot queries, prepared once per pooled connection.
+namespace Statements {
+    constexpr PreparedStatement TopLocations{"top_locations", "SELECT * FROM get_top_locations($1);", 1};
+    constexpr PreparedStatement LocationById{"location_by_id", "SELECT * FROM get_location_by_id($1);", 1};
+    constexpr PreparedStatement SearchLocations{"search_locations", "SELECT * FROM search_locations($1);", 1};
+
+    // Batched forms used by RateLimiter; $1 is a text[] of userids.
+    constexpr PreparedStatement LogUserRequests{
+        "log_user_requests", "SELECT log_user_request(u) FROM unnest($1::text[]) AS u;", 1};
+    constexpr PreparedStatement LogUserResponses{
+        "log_user_responses", "SELECT log_user_response(u) FROM unnest($1::text[]) AS u;", 1};
+    constexpr PreparedStatement UsersBlocked{
+        "users_blocked", "SELECT u, is_user_blocked(u) FROM unnest($1::text[]) AS u;", 1};
+
+    inline std::vector<PreparedStatement> all() {
+        return {TopLocations, LocationById, SearchLocations, LogUserRequests, LogUserResponses, UsersBlocked};
+    }
+
+    // What a read replica needs: the location reads only.
+    inline std::vector<PreparedStatement> reads() {
+        return {TopLocations, LocationById, SearchLocations};
+    }
+}
+
+#endif
@@ -0,0 +1,117 @@
+#include "Workers.h"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <sched.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+size_t cpuCount() { return std::max<size_t>(1, std::thread::hardware_concurrency()); }
+
+void pinToCpus(size_t worker, size_t perWorker) {
+    size_t cpus = cpuCount();
+    size_t first = (worker * perWorker) % cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (size_t i = 0; i < perWorker; i++) CPU_SET((first + i) % cpus, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+        std::cerr << "[Workers] Could not pin worker " << worker << ": " << strerror(errno) << std::endl;
+    }
+}
+
+// In the child, runs serve(worker) and exits with its result; in the
+// parent, returns the child's pid (or -1 if fork failed).
+pid_t startWorker(size_t worker, const WorkersConfig& config, const sigset_t& childMask,
+                  const std::function<int(size_t)>& serve) {
+    pid_t pid = fork();
+    if (pid != 0) return pid;
+
+    sigprocmask(SIG_SETMASK, &childMask, nullptr);
+    if (config.pinCpus) pinToCpus(worker, CpusPerWorker(config));
+    int code = 1;
+    try {
+        code = serve(worker);
+    } catch (const std::exception& e) {
+        std::cerr << "[Workers] Worker " << worker << " failed: " << e.what() << std::endl;
+    }
+    std::exit(code);  // runs the worker's own static destructors (final flushes)
+}
+
+void describeExit(size_t worker, pid_t pid, int status) {
+    std::cerr << "[Workers] Worker " << worker << " (pid " << pid << ") ";
+    if (WIFSIGNALED(status)) std::cerr << "was killed by signal " << WTERMSIG(status);
+    else std::cerr << "exited with status " << WEXITSTATUS(status);
+}
+
+}
+
+size_t CpusPerWorker(const WorkersConfig& config) {
+    if (config.workers <= 1) return cpuCount();
+    return std::max<size_t>(1, cpuCount() / config.workers);
+}
+
+// Signals are taken synchronously with sigwait(): blocked before the first
+// fork, unblocked again in each child so Crow's own handlers see them.
+int RunWorkers(const WorkersConfig& config, const std::function<int(size_t worker)>& serve) {
+    sigset_t watched, childMask;
+    sigemptyset(&watched);
+    sigaddset(&watched, SIGINT);
+    sigaddset(&watched, SIGTERM);
+    sigaddset(&watched, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &watched, &childMask);
+
+    std::vector<pid_t> pids(std::max<size_t>(config.workers, 1), -1);
+    size_t running = 0;
+    for (size_t i = 0; i < pids.size(); i++) {
+        pids[i] = startWorker(i, config, childMask, serve);
+        if (pids[i] < 0) std::cerr << "[Workers] fork failed: " << strerror(errno) << std::endl;
+        else running++;
+    }
+    std::cout << "[Workers] Started " << running << " workers, " << CpusPerWorker(config) << " CPUs each"
+              << std::endl;
+
+    bool stopping = running < pids.size();
+    int exitCode = stopping ? 1 : 0;
+    if (stopping) {
+        for (pid_t pid : pids) if (pid > 0) kill(pid, SIGTERM);
+    }
+    while (running > 0) {
+        int sig = 0;
+        if (sigwait(&watched, &sig) != 0) continue;
+        if (sig != SIGCHLD) {
+            stopping = true;
+            for (pid_t pid : pids) if (pid > 0) kill(pid, sig);
+            continue;
+        }
+        int status = 0;
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            auto it = std::find(pids.begin(), pids.end(), pid);
+            if (it == pids.end()) continue;
+            size_t worker = static_cast<size_t>(it - pids.begin());
+            *it = -1;
+            running--;
+            bool clean = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+            if (stopping) {
+                if (!clean) exitCode = 1;
+                continue;
+            }
+            describeExit(worker, pid, status);
+            std::cerr << "; restarting it" << std::endl;
+            std::this_thread::sleep_for(config.restartDelay);
+            *it = startWorker(worker, config, childMask, serve);
+            if (*it > 0) running++;
+            else std::cerr << "[Workers] fork failed: " << strerror(errno) << std::endl;
+        }
+    }
+    sigprocmask(SIG_SETMASK, &childMask, nullptr);
+    return exitCode;
+}
@@ -0,0 +1,31 @@
+#ifndef WORKERS_H
+#define WORKERS_H
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+
+struct WorkersConfig {
+    // Server processes sharing the listening port. Each has its own pool,
+    // caches, snapshot and rate limiter, so those sizes, and the per-user
+    // rate limit, are per worker (see main.cpp).
+    size_t workers = 1;
+    // Pin worker i to its own slice of the CPUs (cpus / workers of them).
+    bool pinCpus = false;
+    // Delay before replacing a worker that exited without being asked to.
+    std::chrono::milliseconds restartDelay{1000};
+};
+
+// Pre-fork scale-out: forks config.workers processes that each run
+// serve(worker), which must bind the port with SO_REUSEPORT (the patched
+// Crow does when crow::detail::reuse_port is set), so the kernel spreads
+// connections across them with no shared locks or cache lines.
+// Must be called before any thread is started. The parent only supervises:
+// it replaces workers that die, and on SIGINT/SIGTERM passes the signal on
+// and waits for every worker to finish. Returns the process exit code.
+int RunWorkers(const WorkersConfig& config, const std::function<int(size_t worker)>& serve);
+
+// How many CPUs each worker gets; the whole machine for a single process.
+size_t CpusPerWorker(const WorkersConfig& config);
+
+#endif
@@ -0,0 +1,143 @@
+#include "Bench.h"
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+const vector<string> Words = {
+    "lake",   "river",  "harbor", "valley", "ridge",  "forest", "meadow", "canyon", "bay",    "island",
+    "summit", "falls",  "grove",  "marsh",  "dune",   "glacier", "spring", "cliff",  "castle", "bridge",
+    "market", "garden", "tower",  "abbey",  "temple", "square", "old",    "new",    "north",  "south",
+};
+const vector<string> Countries = {"USA", "Canada", "Mexico", "France", "Japan", "Brazil", "Kenya", "Norway"};
+const vector<string> States = {"North", "South", "East", "West", "Central", "Coastal"};
+
+void usage() {
+    cerr << "usage: crow_bench micro [--rows N] [--seconds S]\n"
+            "       crow_bench serve [--rows N] [--snapshot 0|1] [--port P]\n"
+            "       crow_bench load [--url http://host:port] [--rows N] [--snapshot 0|1] [--port P]\n"
+            "                       [--connections C] [--seconds S] [--rate R] [--mix top=1,id=1,search=1]\n"
+            "                       [--gzip 0|1]\n"
+            "load starts an in-process mock server on --port unless --url is given;\n"
+            "--rate switches from closed loop to an open loop of R requests/s;\n"
+            "--snapshot 0 serves reads from the in-memory store through the caches.\n";
+}
+
+}
+
+BenchOptions::BenchOptions(int argc, char** argv, int first) {
+    for (int i = first; i < argc; i++) {
+        string arg = argv[i];
+        if (arg.size() < 3 || arg.compare(0, 2, "--") != 0 || i + 1 == argc) {
+            throw runtime_error("Expected --name value, got '" + arg + "'");
+        }
+        values_[arg.substr(2)] = argv[++i];
+    }
+}
+
+string BenchOptions::get(const string& name, const string& fallback) const {
+    auto it = values_.find(name);
+    return it == values_.end() ? fallback : it->second;
+}
+
+double BenchOptions::number(const string& name, double fallback) const {
+    auto it = values_.find(name);
+    if (it == values_.end()) return fallback;
+    try {
+        return stod(it->second);
+    } catch (...) {
+        throw runtime_error("--" + name + " must be a number");
+    }
+}
+
+vector<Location> SyntheticLocations(size_t count) {
+    mt19937_64 random(42);
+    uniform_real_distribution<double> unit(0.0, 1.0);
+    vector<Location> locations;
+    locations.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        Location loc;
+        loc.id = "loc-" + to_string(i);
+        loc.name = Words[random() % Words.size()] + ' ' + Words[random() % Words.size()];
+        loc.country = Countries[random() % Countries.size()];
+        loc.state = States[random() % States.size()];
+        loc.description = "A " + Words[random() % Words.size()] + " near the " + Words[random() % Words.size()] +
+                          ", popular with visitors all year round.";
+        loc.svg_link = "https://maps.example.com/svg/" + loc.id + ".svg";
+        loc.rating = static_cast<int>(unit(random) * 50) / 10.0;
+        loc.latitude = unit(random) * 140 - 70;
+        loc.longitude = unit(random) * 360 - 180;
+        locations.push_back(move(loc));
+    }
+    return locations;
+}
+
+const string& SearchWord(size_t n) { return Words[n % Words.size()]; }
+
+MockBackend::MockBackend(size_t rows, bool snapshot) : data_(SyntheticLocations(rows)) {
+    store_ = make_shared<MemoryLocationStore>(data_);
+
+    LocationServiceConfig serviceConfig;
+    serviceConfig.snapshotEnabled = snapshot;
+    serviceConfig.snapshotMaxRows = rows + 1;  // never truncated, and the store hides no
+    serviceConfig.snapshotComplete = true;     // rows, so misses are definite
+    serviceConfig.snapshotMaxStaleness = chrono::hours(24 * 365);
+    locations_ = make_unique<LocationService>(store_, serviceConfig);
+    if (snapshot) locations_->publishSnapshot(locations_->loadSnapshot());
+    responseCache_ = make_unique<ResponseCache>(serviceConfig.cacheEnabled, serviceConfig.cache);
+
+    ServerContext context;
+    context.locations = locations_.get();
+    context.responseCache = responseCache_.get();
+    dispatcher_ = BuildRpcDispatcher(context);
+}
+
+MockBackend::~MockBackend() {
+    if (server_.joinable()) {
+        app_.stop();
+        server_.join();
+    }
+}
+
+void MockBackend::listen(unsigned short port) {
+    RegisterRoutes(app_, dispatcher_);
+    app_.loglevel(crow::LogLevel::Warning);
+    app_.port(port).multithreaded();
+    server_ = thread([this] { app_.run(); });
+    app_.wait_for_server_start();
+}
+
+void MockBackend::wait() {
+    if (server_.joinable()) server_.join();
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        usage();
+        return 2;
+    }
+    try {
+        string mode = argv[1];
+        BenchOptions options(argc, argv, 2);
+        if (mode == "micro") return RunMicro(options);
+        if (mode == "load") return RunLoad(options);
+        if (mode == "serve") {
+            MockBackend backend(static_cast<size_t>(options.number("rows", 10000)), options.number("snapshot", 1) != 0);
+            auto port = static_cast<unsigned short>(options.number("port", 18080));
+            backend.listen(port);
+            cout << "Mock server with " << backend.data().size() << " locations on port " << port << endl;
+            backend.wait();
+            return 0;
+        }
+        usage();
+        return 2;
+    } catch (const exception& e) {
+        cerr << "crow_bench: " << e.what() << endl;
+        return 1;
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "LocationService.h"
+#include "MemoryLocationStore.h"
+#include "ResponseCache.h"
+#include "Routes.h"
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// crow_bench: microbenchmarks of the hot paths and an HTTP load generator
+// for /rpc, both run against a mock backend so they need no database.
+
+// `--name value` pairs after the mode.
+class BenchOptions {
+private:
+    std::map<std::string, std::string> values_;
+
+public:
+    BenchOptions(int argc, char** argv, int first);
+    std::string get(const std::string& name, const std::string& fallback) const;
+    double number(const std::string& name, double fallback) const;
+    bool has(const std::string& name) const { return values_.count(name) != 0; }
+};
+
+// `count` made-up locations, the same on every run: ids "loc-0".., names of
+// two words from a small vocabulary (so searches hit), coordinates spread
+// over the map.
+std::vector<Location> SyntheticLocations(size_t count);
+// A word that appears in some synthetic names, for search payloads.
+const std::string& SearchWord(size_t n);
+
+// A LocationService over a MemoryLocationStore of SyntheticLocations(rows),
+// plus the RPC dispatcher and routes over it. With `snapshot` the reads are
+// answered by a resident snapshot, as in production; without it they go
+// through the service's caches to the store. The routes read process-wide
+// state, so create one per process.
+class MockBackend {
+private:
+    std::shared_ptr<MemoryLocationStore> store_;
+    std::unique_ptr<LocationService> locations_;
+    std::unique_ptr<ResponseCache> responseCache_;
+    std::shared_ptr<PlainRpcDispatcher> dispatcher_;
+    std::vector<Location> data_;
+    ServerApp app_;
+    std::thread server_;
+
+public:
+    MockBackend(size_t rows, bool snapshot);
+    ~MockBackend();
+
+    const std::vector<Location>& data() const { return data_; }
+    LocationService& locations() { return *locations_; }
+    PlainRpcDispatcher& dispatcher() { return *dispatcher_; }
+    // Starts serving the real routes on `port` and returns once the server
+    // accepts connections. wait() blocks until it stops (Ctrl-C).
+    void listen(unsigned short port);
+    void wait();
+};
+
+int RunMicro(const BenchOptions& options);
+int RunLoad(const BenchOptions& options);
+
+#endif
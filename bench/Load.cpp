@@ -0,0 +1,209 @@
+#include "Bench.h"
+#include <boost/asio.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+namespace asio = boost::asio;
+using asio::ip::tcp;
+
+namespace {
+
+using Clock = chrono::steady_clock;
+
+enum class Call { Top, ById, Search };
+
+struct Target {
+    string host = "127.0.0.1";
+    string port;
+};
+
+// http://host:port, with or without a trailing path (always /rpc).
+Target parseUrl(const string& url) {
+    string rest = url.compare(0, 7, "http://") == 0 ? url.substr(7) : url;
+    rest = rest.substr(0, rest.find('/'));
+    size_t colon = rest.rfind(':');
+    if (colon == string::npos) return Target{rest, "80"};
+    return Target{rest.substr(0, colon), rest.substr(colon + 1)};
+}
+
+// "top=2,id=1,search=1" as a cumulative table indexed by random draws.
+vector<Call> parseMix(const string& mix) {
+    vector<Call> table;
+    stringstream entries(mix);
+    for (string entry; getline(entries, entry, ',');) {
+        size_t eq = entry.find('=');
+        string name = entry.substr(0, eq);
+        int weight = eq == string::npos ? 1 : stoi(entry.substr(eq + 1));
+        Call call = name == "top" ? Call::Top : name == "id" ? Call::ById : name == "search" ? Call::Search
+                  : throw runtime_error("Unknown call in --mix: " + name);
+        table.insert(table.end(), max(weight, 0), call);
+    }
+    if (table.empty()) throw runtime_error("--mix has no calls");
+    return table;
+}
+
+string requestBody(Call call, size_t ids, mt19937_64& random) {
+    static const int limits[] = {10, 10, 10, 25, 50};
+    string userid = "\"userid\":\"bench-" + to_string(random() % 1000) + "\"";
+    switch (call) {
+        case Call::Top:
+            return R"({"method":"getTopLocations","params":{"limit":)" + to_string(limits[random() % 5]) + ',' +
+                   userid + "}}";
+        case Call::ById:
+            return R"({"method":"getLocationById","params":{"id":"loc-)" + to_string(random() % ids) + "\"," +
+                   userid + "}}";
+        case Call::Search:
+            return R"({"method":"searchLocations","params":{"query":")" + SearchWord(random()) + "\"," + userid +
+                   "}}";
+    }
+    return {};
+}
+
+// One keep-alive connection issuing requests back to back.
+class Connection {
+private:
+    asio::io_context io_;
+    tcp::socket socket_{io_};
+    asio::streambuf buffer_;
+    string request_;
+
+public:
+    Connection(const Target& target, bool gzip) {
+        tcp::resolver resolver(io_);
+        asio::connect(socket_, resolver.resolve(target.host, target.port));
+        socket_.set_option(tcp::no_delay(true));
+        request_ = "POST /rpc HTTP/1.1\r\nHost: " + target.host + (gzip ? "\r\nAccept-Encoding: gzip" : "") +
+                   "\r\nContent-Type: application/json\r\nContent-Length: ";
+    }
+
+    // Sends body and reads the whole response; returns the status code.
+    int post(const string& body) {
+        string message = request_ + to_string(body.size()) + "\r\n\r\n" + body;
+        asio::write(socket_, asio::buffer(message));
+
+        size_t headerEnd = asio::read_until(socket_, buffer_, "\r\n\r\n");
+        string headers(asio::buffers_begin(buffer_.data()), asio::buffers_begin(buffer_.data()) + headerEnd);
+        buffer_.consume(headerEnd);
+        int status = headers.size() > 12 ? stoi(headers.substr(9, 3)) : 0;
+
+        string lower = headers;
+        transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return tolower(c); });
+        size_t field = lower.find("\r\ncontent-length:");
+        size_t length = field == string::npos ? 0 : stoul(lower.substr(field + 17));
+        if (buffer_.size() < length) asio::read(socket_, buffer_, asio::transfer_exactly(length - buffer_.size()));
+        buffer_.consume(length);
+        return status;
+    }
+};
+
+struct WorkerResult {
+    vector<uint64_t> latenciesNs;
+    uint64_t errors = 0;
+};
+
+// Closed loop when ratePerConnection is 0: the next request goes out as
+// soon as the previous answer is in. Open loop otherwise: requests are due
+// on a fixed schedule and latency counts from when each was due, so a
+// stalled server is charged for the queue it causes.
+void runWorker(const Target& target, bool gzip, const vector<Call>& mix, size_t ids, double seconds,
+               double ratePerConnection, size_t index, size_t count, WorkerResult& out) {
+    mt19937_64 random(index * 7919 + 1);
+    auto connection = make_unique<Connection>(target, gzip);
+    auto start = Clock::now();
+    auto end = start + chrono::duration_cast<Clock::duration>(chrono::duration<double>(seconds));
+    auto interval = ratePerConnection > 0
+                        ? chrono::duration_cast<Clock::duration>(chrono::duration<double>(1.0 / ratePerConnection))
+                        : Clock::duration::zero();
+    // Spread the connections' schedules over one interval.
+    auto due = start + interval * index / count;
+
+    while (true) {
+        if (ratePerConnection > 0) {
+            if (due >= end) break;
+            this_thread::sleep_until(due);
+        } else {
+            due = Clock::now();
+            if (due >= end) break;
+        }
+        string body = requestBody(mix[random() % mix.size()], ids, random);
+        int status;
+        try {
+            status = connection->post(body);
+        } catch (const exception&) {
+            out.errors++;
+            connection = make_unique<Connection>(target, gzip);
+            due += interval;
+            continue;
+        }
+        out.latenciesNs.push_back(chrono::duration_cast<chrono::nanoseconds>(Clock::now() - due).count());
+        if (status != 200) out.errors++;
+        due += interval;
+    }
+}
+
+double percentileUs(vector<uint64_t>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t rank = min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()));
+    return sorted[rank] / 1e3;
+}
+
+}
+
+int RunLoad(const BenchOptions& options) {
+    size_t rows = static_cast<size_t>(options.number("rows", 10000));
+    auto connections = static_cast<size_t>(max(1.0, options.number("connections", 8)));
+    double seconds = options.number("seconds", 10);
+    double rate = options.number("rate", 0);
+    bool gzip = options.number("gzip", 0) != 0;
+    vector<Call> mix = parseMix(options.get("mix", "top=1,id=1,search=1"));
+
+    unique_ptr<MockBackend> backend;
+    Target target;
+    if (options.has("url")) {
+        target = parseUrl(options.get("url", ""));
+    } else {
+        auto port = static_cast<unsigned short>(options.number("port", 18080));
+        backend = make_unique<MockBackend>(rows, options.number("snapshot", 1) != 0);
+        backend->listen(port);
+        target.port = to_string(port);
+    }
+
+    printf("%s loop, %zu connections, %.0fs, against %s:%s\n", rate > 0 ? "open" : "closed", connections, seconds,
+           target.host.c_str(), target.port.c_str());
+    vector<WorkerResult> results(connections);
+    vector<thread> workers;
+    auto started = Clock::now();
+    for (size_t i = 0; i < connections; i++) {
+        workers.emplace_back([&, i] {
+            try {
+                runWorker(target, gzip, mix, rows, seconds, rate / connections, i, connections, results[i]);
+            } catch (const exception& e) {
+                cerr << "connection " << i << ": " << e.what() << endl;
+                results[i].errors++;
+            }
+        });
+    }
+    for (auto& worker : workers) worker.join();
+    // An open loop the server cannot keep up with runs past `seconds`.
+    double elapsed = chrono::duration<double>(Clock::now() - started).count();
+
+    vector<uint64_t> latencies;
+    uint64_t errors = 0;
+    for (auto& result : results) {
+        latencies.insert(latencies.end(), result.latenciesNs.begin(), result.latenciesNs.end());
+        errors += result.errors;
+    }
+    sort(latencies.begin(), latencies.end());
+    printf("requests %zu, errors %llu, throughput %.0f req/s\n", latencies.size(),
+           static_cast<unsigned long long>(errors), latencies.size() / elapsed);
+    printf("latency us: p50 %.1f  p99 %.1f  p999 %.1f  max %.1f\n", percentileUs(latencies, 0.5),
+           percentileUs(latencies, 0.99), percentileUs(latencies, 0.999),
+           latencies.empty() ? 0.0 : latencies.back() / 1e3);
+    return errors == 0 ? 0 : 1;
+}
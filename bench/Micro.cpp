@@ -0,0 +1,279 @@
+#include "Bench.h"
+#include "Compression.h"
+#include "GeoIndex.h"
+#include "JsonWriter.h"
+#include "LocationSnapshot.h"
+#include "PlainRpcDispatcher.h"
+#include "RpcRequest.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <stdexcept>
+#include <zlib.h>
+
+using namespace std;
+
+namespace {
+
+using json = nlohmann::json;
+using Clock = chrono::steady_clock;
+
+constexpr int PageRows = 100;
+
+// Keeps results observable so the optimizer cannot drop the work.
+volatile size_t sink;
+
+// Bodies in the shapes the site sends.
+const vector<string> Payloads = {
+    R"({"method":"getTopLocations","params":{"limit":10,"userid":"user-8812"}})",
+    R"({"method":"getTopLocations","params":{"limit":50}})",
+    R"({"method":"getLocationById","params":{"id":"loc-17","userid":"user-8812"}})",
+    R"({"method":"searchLocations","params":{"query":"lake","userid":"user-310"}})",
+    R"({"method":"getLocationsByIds","params":{"ids":["loc-1","loc-2","loc-3","loc-4"],"userid":"user-310"}})",
+    R"({"method":"getNearbyLocations","params":{"latitude":40.7128,"longitude":-74.006,"radius_km":25,"limit":20}})",
+};
+
+// Runs fn in growing batches until `seconds` have passed and prints the
+// mean time per call.
+template <typename Fn>
+void measure(const char* name, double seconds, Fn&& fn) {
+    sink = sink + fn();  // warm caches and lazy statics
+    uint64_t calls = 0;
+    Clock::duration elapsed{};
+    for (uint64_t batch = 1; elapsed < chrono::duration<double>(seconds); batch *= 2) {
+        auto start = Clock::now();
+        for (uint64_t i = 0; i < batch; i++) sink = sink + fn();
+        elapsed += Clock::now() - start;
+        calls += batch;
+    }
+    double ns = chrono::duration<double, nano>(elapsed).count() / calls;
+    printf("%-44s %12.1f ns/op %14.0f op/s\n", name, ns, 1e9 / ns);
+}
+
+// A text-format result like get_top_locations returns, built in memory.
+PGresult* recordedResult(const vector<Location>& locations) {
+    PGresult* result = PQmakeEmptyPGresult(nullptr, PGRES_TUPLES_OK);
+    const char* names[] = {"id", "name", "country", "state", "description", "svg_link", "rating", "latitude", "longitude"};
+    PGresAttDesc attrs[9] = {};
+    for (int c = 0; c < 9; c++) {
+        attrs[c].name = const_cast<char*>(names[c]);
+        attrs[c].typid = c < 6 ? 25 : 701;  // text, float8
+        attrs[c].typlen = c < 6 ? -1 : 8;
+        attrs[c].atttypmod = -1;
+    }
+    PQsetResultAttrs(result, 9, attrs);
+    for (int row = 0; row < static_cast<int>(locations.size()); row++) {
+        const Location& loc = locations[row];
+        string numbers[3] = {to_string(loc.rating), to_string(loc.latitude), to_string(loc.longitude)};
+        const string* values[9] = {&loc.id,    &loc.name,       &loc.country,    &loc.state,     &loc.description,
+                                   &loc.svg_link, &numbers[0], &numbers[1], &numbers[2]};
+        for (int c = 0; c < 9; c++) {
+            PQsetvalue(result, row, c, const_cast<char*>(values[c]->data()), static_cast<int>(values[c]->size()));
+        }
+    }
+    return result;
+}
+
+LocationRows copyRows(const PGresult* recorded) {
+    return LocationRows(make_unique<PGResultWrapper>(PQcopyResult(recorded, PG_COPYRES_ATTRS | PG_COPYRES_TUPLES)));
+}
+
+// The shape the handlers used to build with nlohmann, and the reference
+// JsonWriter output must match byte for byte.
+json locationsJson(const vector<Location>& locations) {
+    json array = json::array();
+    for (const Location& loc : locations) {
+        array.push_back({{"id", loc.id}, {"name", loc.name}, {"country", loc.country}, {"state", loc.state},
+                         {"description", loc.description}, {"svg_link", loc.svg_link}, {"rating", loc.rating},
+                         {"latitude", loc.latitude}, {"longitude", loc.longitude}});
+    }
+    return array;
+}
+
+// A timing of wrong output measures nothing, so every path is checked
+// against a reference before it is timed.
+void expect(bool ok, const string& what) {
+    if (!ok) throw runtime_error("Check failed: " + what);
+}
+
+string gunzip(const string& data) {
+    z_stream stream{};
+    expect(inflateInit2(&stream, 16 + MAX_WBITS) == Z_OK, "inflateInit2");
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in = static_cast<uInt>(data.size());
+    string out;
+    int status = Z_OK;
+    while (status == Z_OK) {
+        char buf[16384];
+        stream.next_out = reinterpret_cast<Bytef*>(buf);
+        stream.avail_out = sizeof(buf);
+        status = inflate(&stream, Z_NO_FLUSH);
+        out.append(buf, sizeof(buf) - stream.avail_out);
+    }
+    inflateEnd(&stream);
+    expect(status == Z_STREAM_END, "gzip output is a complete stream");
+    return out;
+}
+
+// ids of a success envelope's data array, in order.
+vector<string> resultIds(const SerializedBody& body) {
+    json parsed = json::parse(body->text);
+    expect(parsed.value("success", false), "success response: " + body->text.substr(0, 200));
+    vector<string> ids;
+    for (const auto& loc : parsed["data"]) ids.push_back(loc["id"].get<string>());
+    return ids;
+}
+
+vector<string> idsOf(const vector<Location>& locations) {
+    vector<string> ids;
+    for (const Location& loc : locations) ids.push_back(loc.id);
+    return ids;
+}
+
+bool containsFolded(const string& text, const string& word) {
+    string folded = text;
+    for (char& c : folded) c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+    return folded.find(word) != string::npos;
+}
+
+bool sameParams(const RpcParams& a, const RpcParams& b) {
+    return a.userid == b.userid && a.limit == b.limit && a.id == b.id && a.query == b.query && a.ids == b.ids &&
+           a.latitude == b.latitude && a.longitude == b.longitude && a.radiusKm == b.radiusKm &&
+           a.afterRating == b.afterRating && a.afterId == b.afterId && a.fields == b.fields;
+}
+
+// Brute-force answers over the synthetic rows, compared with what each
+// fast path returns for the payloads it is timed on.
+void checkOutputs(MockBackend& backend, const vector<Location>& page, const LocationRows& rows,
+                  const SnapshotRows& snapshotRows) {
+    vector<Location> ranked = backend.data();
+    sort(ranked.begin(), ranked.end(), [](const Location& a, const Location& b) {
+        return a.rating > b.rating || (a.rating == b.rating && a.id < b.id);
+    });
+
+    vector<Location> decoded = rows.toLocations();
+    expect(idsOf(decoded) == idsOf(page), "LocationRows keeps the rows in order");
+    string out;
+    JsonWriter::appendLocations(out, rows);
+    expect(out == locationsJson(decoded).dump(), "JsonWriter LocationRows matches nlohmann");
+    out.clear();
+    JsonWriter::appendLocations(out, snapshotRows);
+    vector<Location> top(ranked.begin(), ranked.begin() + snapshotRows.rows.size());
+    expect(out == locationsJson(top).dump(), "JsonWriter SnapshotRows matches nlohmann over the top rows");
+
+    string body = ResponseCache::successBody([&](string& text) { JsonWriter::appendLocations(text, rows); });
+    expect(gunzip(Compression::gzip(body, 6)) == body, "gzip level 6 round-trips");
+    expect(gunzip(Compression::gzip(body, 1)) == body, "gzip level 1 round-trips");
+
+    for (const string& payload : Payloads) {
+        RpcRequest request;
+        expect(parseRpcRequest(payload, request), "fast path takes " + payload);
+        json parsed = json::parse(payload);
+        expect(request.method == parsed["method"].get<string>() &&
+                   sameParams(request.params, RpcParams::fromJson(parsed["params"])),
+               "parseRpcRequest agrees with json::parse on " + payload);
+    }
+
+    PlainRpcDispatcher& dispatcher = backend.dispatcher();
+    for (const string& payload : Payloads) {
+        RpcRequest request;
+        parseRpcRequest(payload, request);
+        expect(dispatcher.dispatchBody(request)->text == dispatcher.dispatchBody(json::parse(payload))->text,
+               "typed and json dispatch agree on " + payload);
+    }
+
+    auto answer = [&](size_t payload) {
+        RpcRequest request;
+        parseRpcRequest(Payloads[payload], request);
+        return resultIds(dispatcher.dispatchBody(request));
+    };
+    expect(answer(0) == idsOf(vector<Location>(ranked.begin(), ranked.begin() + 10)), "getTopLocations order");
+    expect(answer(2) == vector<string>{"loc-17"}, "getLocationById");
+
+    vector<string> matches;
+    for (const Location& loc : ranked) {
+        if (containsFolded(loc.name, "lake") || containsFolded(loc.country, "lake") ||
+            containsFolded(loc.state, "lake") || containsFolded(loc.description, "lake"))
+            matches.push_back(loc.id);
+    }
+    vector<string> hits = answer(3);
+    expect(!hits.empty() && hits.size() <= matches.size() && equal(hits.begin(), hits.end(), matches.begin()),
+           "searchLocations returns the best-rated matches");
+
+    vector<pair<double, string>> distances;
+    for (const Location& loc : backend.data()) {
+        double km = GeoIndex::distanceKm(40.7128, -74.006, loc.latitude, loc.longitude);
+        if (km <= 25) distances.emplace_back(km, loc.id);
+    }
+    sort(distances.begin(), distances.end());
+    vector<string> nearest;
+    for (size_t i = 0; i < distances.size() && i < 20; i++) nearest.push_back(distances[i].second);
+    expect(answer(5) == nearest, "getNearbyLocations matches a linear scan");
+}
+
+}
+
+int RunMicro(const BenchOptions& options) {
+    size_t rowCount = static_cast<size_t>(options.number("rows", 10000));
+    if (rowCount < PageRows) throw runtime_error("--rows must be at least " + to_string(PageRows));
+    MockBackend backend(rowCount, true);
+    double seconds = options.number("seconds", 0.5);
+
+    vector<Location> page(backend.data().begin(), backend.data().begin() + min<size_t>(PageRows, backend.data().size()));
+    unique_ptr<PGResultWrapper> recorded(new PGResultWrapper(recordedResult(page)));
+    LocationRows rows = copyRows(recorded->get());
+    SnapshotRows snapshotRows = *backend.locations().topLocal(PageRows);
+
+    checkOutputs(backend, page, rows, snapshotRows);
+    printf("checks: outputs match the reference\n");
+    printf("rows: %zu-row result, %zu-location snapshot\n", page.size(), backend.data().size());
+    measure("rows/PQcopyResult (baseline)", seconds, [&] {
+        PGResultWrapper copy(PQcopyResult(recorded->get(), PG_COPYRES_ATTRS | PG_COPYRES_TUPLES));
+        return static_cast<size_t>(PQntuples(copy.get()));
+    });
+    measure("rows/LocationRows (incl. copy)", seconds, [&] { return copyRows(recorded->get()).size(); });
+    measure("rows/toLocations", seconds, [&] { return rows.toLocations().size(); });
+
+    measure("serialize/nlohmann json dump", seconds, [&] { return locationsJson(page).dump().size(); });
+    measure("serialize/JsonWriter LocationRows", seconds, [&] {
+        string out;
+        JsonWriter::appendLocations(out, rows);
+        return out.size();
+    });
+    measure("serialize/JsonWriter SnapshotRows", seconds, [&] {
+        string out;
+        JsonWriter::appendLocations(out, snapshotRows);
+        return out.size();
+    });
+
+    string topBody = ResponseCache::successBody([&](string& out) { JsonWriter::appendLocations(out, rows); });
+    measure("serialize/gzip level 6 (100 locations)", seconds, [&] { return Compression::gzip(topBody, 6).size(); });
+    measure("serialize/gzip level 1 (100 locations)", seconds, [&] { return Compression::gzip(topBody, 1).size(); });
+
+    measure("parse/json::parse (mix)", seconds, [&, i = size_t{0}]() mutable {
+        return json::parse(Payloads[i++ % Payloads.size()]).size();
+    });
+    measure("parse/parseRpcRequest (mix)", seconds, [&, i = size_t{0}]() mutable {
+        RpcRequest request;
+        return static_cast<size_t>(parseRpcRequest(Payloads[i++ % Payloads.size()], request));
+    });
+
+    PlainRpcDispatcher& dispatcher = backend.dispatcher();
+    auto typed = [&](const string& payload) {
+        RpcRequest request;
+        if (!parseRpcRequest(payload, request)) throw runtime_error("Payload not on the fast path: " + payload);
+        return request;
+    };
+    RpcRequest top = typed(Payloads[0]), byId = typed(Payloads[2]), search = typed(Payloads[3]),
+               nearby = typed(Payloads[5]);
+    json topJson = json::parse(Payloads[0]);
+    measure("dispatch/getTopLocations typed (cached)", seconds, [&] { return dispatcher.dispatchBody(top)->text.size(); });
+    measure("dispatch/getTopLocations json (cached)", seconds, [&] { return dispatcher.dispatchBody(topJson)->text.size(); });
+    measure("dispatch/getLocationById typed (cached)", seconds, [&] { return dispatcher.dispatchBody(byId)->text.size(); });
+    measure("dispatch/searchLocations typed", seconds, [&] { return dispatcher.dispatchBody(search)->text.size(); });
+    measure("dispatch/getNearbyLocations typed", seconds, [&] { return dispatcher.dispatchBody(nearby)->text.size(); });
+    return 0;
+}
@@ -0,0 +1,61 @@
+# PATCH_COMMAND for Crow, run with its source tree as working directory. Crow opens, binds and
+# listens on its acceptor in one constructor call, so there is no point at
+# which SO_REUSEPORT could be set from outside. This builds the acceptor
+# through crow::detail::open_acceptor instead, which sets SO_REUSEPORT
+# before bind() whenever crow::detail::reuse_port is true (the worker
+# processes set it; see Workers.h).
+
+set(server_header "include/crow/http_server.h")
+file(READ "${server_header}" source)
+
+if(source MATCHES "crow::detail::open_acceptor")
+    return()  # already patched
+endif()
+
+set(pattern "acceptor_\\(io_service_, (tcp::endpoint\\([^;\n]*port\\))\\)")
+if(NOT source MATCHES "${pattern}")
+    message(FATAL_ERROR "PatchCrowReusePort: acceptor construction not found in ${server_header}; "
+                        "update the pattern for this Crow version")
+endif()
+string(REGEX REPLACE "${pattern}"
+       "acceptor_(crow::detail::open_acceptor<decltype(acceptor_)>(io_service_, \\1))" source "${source}")
+
+set(helper [=[
+#include <atomic>
+#include <sys/socket.h>
+
+namespace crow
+{
+    namespace detail
+    {
+        // Set before app.run() to let other processes bind the same port.
+        inline std::atomic<bool> reuse_port{false};
+
+        template<typename Acceptor, typename Context, typename Endpoint>
+        Acceptor open_acceptor(Context& io, const Endpoint& endpoint)
+        {
+            Acceptor acceptor(io);
+            acceptor.open(endpoint.protocol());
+            acceptor.set_option(typename Acceptor::reuse_address(true));
+            if (reuse_port.load())
+            {
+                int on = 1;
+                ::setsockopt(acceptor.native_handle(), SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+            }
+            acceptor.bind(endpoint);
+            acceptor.listen();
+            return acceptor;
+        }
+    } // namespace detail
+} // namespace crow
+]=])
+
+string(FIND "${source}" "#pragma once" pragma)
+if(pragma LESS 0)
+    message(FATAL_ERROR "PatchCrowReusePort: no #pragma once in ${server_header}")
+endif()
+string(LENGTH "#pragma once" pragma_length)
+math(EXPR insert_at "${pragma} + ${pragma_length}")
+string(SUBSTRING "${source}" 0 ${insert_at} head)
+string(SUBSTRING "${source}" ${insert_at} -1 tail)
+file(WRITE "${server_header}" "${head}\n${helper}${tail}")
@@ -8,345 +8,328 @@
 #include <stdexcept>
 #include <thread>
 #include <chrono>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <sstream>
+#include "AsyncQueryExecutor.h"
+#include "ConnectionPool.h"
+#include "ConnectionSupervisor.h"
+#include "LocationService.h"
+#include "LocationSnapshot.h"
+#include "PgLocationStore.h"
+#include "ResponseCache.h"
+#include "RateLimiter.h"
+#include "ReplicaRouter.h"
+#include "Routes.h"
+#include "SnapshotRefresher.h"
+#include "Statements.h"
+#include "Workers.h"
 
 using json = nlohmann::json;
 using namespace std;
 
-// Location data structure
-struct Location {
-    string id;
-    string name;
-    string country;
-    string state;
-    string description;
-    string svg_link;
-    double rating;
-};
-
-// Database connection wrapper
-class DatabaseConnection {
-private:
-    PGconn* conn_;
-public:
-    explicit DatabaseConnection(const char* conninfo) {
-        conn_ = PQconnectdb(conninfo);
-        if (PQstatus(conn_) != CONNECTION_OK) {
-            string error = PQerrorMessage(conn_);
-            PQfinish(conn_);
-            conn_ = nullptr;
-            throw runtime_error("Database connection failed: " + error);
-        }
-    }
-    ~DatabaseConnection() { if (conn_) PQfinish(conn_); }
-    PGconn* get() const { return conn_; }
-    bool isValid() const { return conn_ && PQstatus(conn_) == CONNECTION_OK; }
-};
-
-// Location service
-class LocationService {
-private:
-    PGconn* conn;
-    mutable mutex db_mutex_;
-    
-    string sanitizeString(const string& input) const {
-        string sanitized = input;
-        sanitized.erase(remove_if(sanitized.begin(), sanitized.end(),
-            [](unsigned char c) { return c < 32 && c != '\t' && c != '\n' && c != '\r'; }),
-            sanitized.end());
-        return sanitized;
-    }
-
-    Location rowToLocation(PGresult* res, int row) const {
-        return Location{
-            .id = sanitizeString(PQgetvalue(res, row, 0) ? PQgetvalue(res, row, 0) : ""),
-            .name = sanitizeString(PQgetvalue(res, row, 1) ? PQgetvalue(res, row, 1) : ""),
-            .country = sanitizeString(PQgetvalue(res, row, 2) ? PQgetvalue(res, row, 2) : ""),
-            .state = sanitizeString(PQgetvalue(res, row, 3) ? PQgetvalue(res, row, 3) : ""),
-            .description = sanitizeString(PQgetvalue(res, row, 4) ? PQgetvalue(res, row, 4) : ""),
-            .svg_link = sanitizeString(PQgetvalue(res, row, 5) ? PQgetvalue(res, row, 5) : ""),
-            .rating = PQgetvalue(res, row, 6) ? stod(PQgetvalue(res, row, 6)) : 0.0
-        };
-    }
-
-public:
-    LocationService(PGconn* connection) : conn(connection) {
-        if (!conn) throw runtime_error("Invalid database connection");
-    }
-
-    vector<Location> getTopLocations(int limit) {
-        lock_guard<mutex> lock(db_mutex_);
-        string query = "SELECT * FROM get_top_locations($1);";
-        string limitStr = to_string(limit);
-        const char* paramValues[1] = {limitStr.c_str()};
-
-        PGresult* res = PQexecParams(conn, query.c_str(), 1, nullptr, paramValues, nullptr, nullptr, 0);
-        if (PQresultStatus(res) != PGRES_TUPLES_OK) {
-            PQclear(res);
-            throw runtime_error("Query failed: " + string(PQerrorMessage(conn)));
-        }
-
-        vector<Location> locations;
-        int rows = PQntuples(res);
-        for (int i = 0; i < rows; i++) {
-            locations.push_back(rowToLocation(res, i));
-        }
-        PQclear(res);
-        return locations;
-    }
-
-    Location getLocationById(const string& id) {
-        lock_guard<mutex> lock(db_mutex_);
-        string query = "SELECT * FROM get_location_by_id($1);";
-        const char* paramValues[1] = {id.c_str()};
+// Global instances
+shared_ptr<ConnectionPool> db_pool;
+shared_ptr<AsyncQueryExecutor> asyncQueries;
+shared_ptr<ReplicaRouter> replicaRouter;
+unique_ptr<LocationService> locationService;
+unique_ptr<RateLimiter> rateLimiter;
+unique_ptr<ResponseCache> responseCache;
+unique_ptr<ConnectionSupervisor> dbSupervisor;
+unique_ptr<SnapshotRefresher> snapshotRefresher;
+string global_conninfo;
 
-        PGresult* res = PQexecParams(conn, query.c_str(), 1, nullptr, paramValues, nullptr, nullptr, 0);
-        if (PQresultStatus(res) != PGRES_TUPLES_OK) {
-            PQclear(res);
-            throw runtime_error("Query failed: " + string(PQerrorMessage(conn)));
-        }
-        if (PQntuples(res) == 0) {
-            PQclear(res);
-            throw runtime_error("Location not found");
-        }
-        Location loc = rowToLocation(res, 0);
-        PQclear(res);
-        return loc;
+size_t envSize(const char* name, size_t fallback) {
+    const char* value = getenv(name);
+    if (!value || !*value) return fallback;
+    try {
+        return stoul(value);
+    } catch (...) {
+        cerr << "[Config] Ignoring invalid " << name << "=" << value << endl;
+        return fallback;
     }
+}
 
-    vector<Location> searchLocations(const string& query) {
-        lock_guard<mutex> lock(db_mutex_);
-        string sqlQuery = "SELECT * FROM search_locations($1);";
-        const char* paramValues[1] = {query.c_str()};
-
-        PGresult* res = PQexecParams(conn, sqlQuery.c_str(), 1, nullptr, paramValues, nullptr, nullptr, 0);
-        if (PQresultStatus(res) != PGRES_TUPLES_OK) {
-            PQclear(res);
-            throw runtime_error("Query failed: " + string(PQerrorMessage(conn)));
-        }
+// httpThreads is the number of Crow worker threads, past which more
+// connections would just sit idle.
+ConnectionPoolConfig poolConfigFromEnv(size_t httpThreads) {
+    ConnectionPoolConfig config;
+    config.conninfo = global_conninfo;
+    config.statements = Statements::all();
+    config.maxSize = envSize("DB_POOL_MAX", max<size_t>(4, httpThreads));
+    config.minSize = envSize("DB_POOL_MIN", 2);
+    config.checkoutTimeout = chrono::milliseconds(envSize("DB_POOL_TIMEOUT_MS", 2000));
+    config.healthCheckAfter = chrono::milliseconds(envSize("DB_POOL_HEALTHCHECK_MS", 30000));
+    config.connectTimeoutSeconds = static_cast<int>(envSize("DB_CONNECT_TIMEOUT_S", 5));
+    config.breakerThreshold = static_cast<int>(envSize("DB_BREAKER_THRESHOLD", 3));
+    config.statementTimeout = chrono::milliseconds(envSize("DB_STATEMENT_TIMEOUT_MS", 0));
+    return config;
+}
 
-        vector<Location> locations;
-        int rows = PQntuples(res);
-        for (int i = 0; i < rows; i++) {
-            locations.push_back(rowToLocation(res, i));
-        }
-        PQclear(res);
-        return locations;
-    }
-};
+LocationServiceConfig locationServiceConfigFromEnv() {
+    LocationServiceConfig config;
+    config.cache.capacity = envSize("CACHE_CAPACITY", 1024);
+    config.cache.ttl = chrono::milliseconds(envSize("CACHE_TTL_MS", 30000));
+    config.cacheEnabled = config.cache.capacity > 0 && config.cache.ttl.count() > 0;
+    config.snapshotEnabled = envSize("LOCATION_SNAPSHOT", 0) != 0;
+    size_t refreshMs = envSize("LOCATION_SNAPSHOT_REFRESH_MS", 60000);
+    config.snapshotMaxStaleness = chrono::milliseconds(envSize("LOCATION_SNAPSHOT_MAX_STALENESS_MS", 2 * refreshMs));
+    config.snapshotMaxRows = envSize("LOCATION_SNAPSHOT_MAX_ROWS", 100000);
+    config.snapshotComplete = envSize("LOCATION_SNAPSHOT_COMPLETE", 0) != 0;
+    config.searchResultLimit = envSize("SEARCH_RESULT_LIMIT", 50);
+    return config;
+}
 
-// Global instances
-unique_ptr<DatabaseConnection> db_connection;
-unique_ptr<LocationService> locationService;
-string global_conninfo;
+PgLocationStoreConfig pgStoreConfigFromEnv() {
+    PgLocationStoreConfig config;
+    config.binaryResults = envSize("DB_BINARY_RESULTS", 0) != 0;
+    if (const char* query = getenv("TOP_LOCATIONS_PAGE_QUERY")) config.topPageQuery = query;
+    config.hedgePercentile = static_cast<int>(envSize("DB_HEDGE_PERCENTILE", 0));
+    config.hedgeMinDelay = chrono::milliseconds(envSize("DB_HEDGE_MIN_DELAY_MS", 2));
+    config.hedgeMaxPercent = static_cast<int>(envSize("DB_HEDGE_MAX_PERCENT", 5));
+    return config;
+}
 
-bool ensureDbConnection(int retries = 5, int delayMs = 2000) {
-    for (int i = 0; i < retries; i++) {
-        if (!db_connection || !db_connection->isValid()) {
-            try {
-                db_connection = make_unique<DatabaseConnection>(global_conninfo.c_str());
-                locationService = make_unique<LocationService>(db_connection->get());
-                cout << "[DB] Connected to database.\n";
-                return true;
-            } catch (const exception& e) {
-                cerr << "[DB] Connection attempt " << i+1 << " failed: " << e.what() << endl;
-                this_thread::sleep_for(chrono::milliseconds(delayMs));
-            }
-        } else {
-            return true;
-        }
-    }
-    return false;
+CompressionConfig compressionConfigFromEnv() {
+    CompressionConfig config;
+    config.enabled = envSize("RESPONSE_GZIP", 1) != 0;
+    config.minBytes = envSize("RESPONSE_GZIP_MIN_BYTES", 1024);
+    config.level = static_cast<int>(clamp<size_t>(envSize("RESPONSE_GZIP_LEVEL", 6), 1, 9));
+    return config;
 }
 
-json locationToJson(const Location& loc) {
-    return json{
-        {"id", loc.id},
-        {"name", loc.name},
-        {"country", loc.country},
-        {"state", loc.state},
-        {"description", loc.description},
-        {"svg_link", loc.svg_link},
-        {"rating", loc.rating}
-    };
+// The limits are per user and per worker. SO_REUSEPORT picks the worker by
+// connection, so a keep-alive client sends everything to one worker, which
+// must allow it the full limit; totals across workers are bounded by the
+// database's is_user_blocked. RATE_LIMIT_SPLIT_WORKERS=1 divides the limits
+// by the worker count instead, for clients known to spread over many
+// connections.
+RateLimiterConfig rateLimiterConfigFromEnv(size_t workers) {
+    RateLimiterConfig config;
+    bool split = envSize("RATE_LIMIT_SPLIT_WORKERS", 0) != 0;
+    double share = split ? 1.0 / static_cast<double>(max<size_t>(workers, 1)) : 1.0;
+    config.requestsPerSecond = static_cast<double>(envSize("RATE_LIMIT_PER_SEC", 5)) * share;
+    config.burst = max(static_cast<double>(envSize("RATE_LIMIT_BURST", 20)) * share, 1.0);
+    config.flushInterval = chrono::milliseconds(envSize("RATE_LIMIT_FLUSH_MS", 1000));
+    config.maxPendingCalls = envSize("RATE_LIMIT_MAX_PENDING", config.maxPendingCalls);
+    config.flushBatchSize = max<size_t>(envSize("RATE_LIMIT_FLUSH_BATCH", config.flushBatchSize), 1);
+    return config;
 }
 
-void logUserRequest(PGconn* conn, const string& userid) {
-    const char* param[1] = { userid.c_str() };
-    PGresult* res = PQexecParams(conn, "SELECT log_user_request($1);", 1, nullptr, param, nullptr, nullptr, 0);
-    PQclear(res);
+ConnectionSupervisorConfig supervisorConfigFromEnv() {
+    ConnectionSupervisorConfig config;
+    config.interval = chrono::milliseconds(envSize("DB_SUPERVISOR_INTERVAL_MS", 1000));
+    config.maxBackoff = chrono::milliseconds(envSize("DB_RECONNECT_MAX_BACKOFF_MS", 30000));
+    return config;
 }
 
-void logUserResponse(PGconn* conn, const string& userid) {
-    const char* param[1] = { userid.c_str() };
-    PGresult* res = PQexecParams(conn, "SELECT log_user_response($1);", 1, nullptr, param, nullptr, nullptr, 0);
-    PQclear(res);
+SnapshotRefresherConfig snapshotRefresherConfigFromEnv() {
+    SnapshotRefresherConfig config;
+    config.fullReload = chrono::milliseconds(envSize("LOCATION_SNAPSHOT_REFRESH_MS", 60000));
+    string feed = getenv("LOCATION_SNAPSHOT_FEED") ? getenv("LOCATION_SNAPSHOT_FEED") : "";
+    if (feed == "listen") config.feed = SnapshotChangeFeed::Listen;
+    else if (feed == "poll") config.feed = SnapshotChangeFeed::Poll;
+    else if (!feed.empty() && feed != "none") cerr << "[Config] Ignoring invalid LOCATION_SNAPSHOT_FEED=" << feed << endl;
+    if (const char* channel = getenv("LOCATION_SNAPSHOT_CHANNEL")) config.notifyChannel = channel;
+    if (const char* query = getenv("LOCATION_SNAPSHOT_CHANGES_QUERY")) config.changesQuery = query;
+    config.pollInterval = chrono::milliseconds(envSize("LOCATION_SNAPSHOT_POLL_MS", 2000));
+    config.pollOverlap = chrono::milliseconds(envSize("LOCATION_SNAPSHOT_POLL_OVERLAP_MS", 60000));
+    return config;
 }
 
-bool isUserBlocked(PGconn* conn, const string& userid) {
-    const char* param[1] = { userid.c_str() };
-    PGresult* res = PQexecParams(conn, "SELECT is_user_blocked($1);", 1, nullptr, param, nullptr, nullptr, 0);
-    if (PQresultStatus(res) != PGRES_TUPLES_OK || PQntuples(res) == 0) {
-        PQclear(res);
-        return false;
-    }
-    bool blocked = (strcmp(PQgetvalue(res, 0, 0), "t") == 0);
-    PQclear(res);
-    return blocked;
+WorkersConfig workersConfigFromEnv() {
+    WorkersConfig config;
+    config.workers = max<size_t>(envSize("WORKERS", 1), 1);
+    config.pinCpus = envSize("WORKER_PIN_CPUS", 0) != 0;
+    config.restartDelay = chrono::milliseconds(envSize("WORKER_RESTART_DELAY_MS", 1000));
+    return config;
 }
 
-// RPC Dispatcher
-class PlainRpcDispatcher {
-private:
-    using MethodHandler = function<json(const json&)>;
-    unordered_map<string, MethodHandler> methods_;
+AsyncQueryConfig asyncQueryConfigFromEnv() {
+    AsyncQueryConfig config;
+    config.threads = envSize("ASYNC_DB_THREADS", 2);
+    return config;
+}
 
-public:
-    void registerMethod(const string& method, MethodHandler handler) {
-        if (methods_.find(method) != methods_.end()) {
-            throw runtime_error("Method already registered");
-        }
-        methods_[method] = handler;
+// DATABASE_REPLICA_URLS is a comma-separated list of read replicas. Each
+// gets a pool sized like the primary's that prepares only the reads.
+ReplicaRouterConfig replicaRouterConfigFromEnv(size_t httpThreads) {
+    ReplicaRouterConfig config;
+    stringstream urls(getenv("DATABASE_REPLICA_URLS") ? getenv("DATABASE_REPLICA_URLS") : "");
+    for (string url; getline(urls, url, ',');) {
+        url.erase(0, url.find_first_not_of(' '));
+        url.erase(url.find_last_not_of(' ') + 1);
+        if (url.empty()) continue;
+        ConnectionPoolConfig pool = poolConfigFromEnv(httpThreads);
+        pool.conninfo = url;
+        pool.statements = Statements::reads();
+        config.replicas.push_back(move(pool));
     }
+    config.supervisor = supervisorConfigFromEnv();
+    config.maxLag = chrono::milliseconds(envSize("DB_REPLICA_MAX_LAG_MS", 5000));
+    config.checkInterval = chrono::milliseconds(envSize("DB_REPLICA_CHECK_MS", 1000));
+    return config;
+}
 
-    json dispatch(const json& request) {
-        if (!request.contains("method") || !request["method"].is_string()) {
-            throw runtime_error("Invalid request: missing method");
-        }
-        if (!request.contains("params") || !request["params"].is_object()) {
-            throw runtime_error("Invalid request: missing params");
+// Opt-in (WARMUP=1) startup phase: loads the resident snapshot and the
+// hottest top-locations bodies before the server listens, so a fresh deploy
+// does not send its first minutes of traffic to the database. The snapshot
+// is mapped from LOCATION_SNAPSHOT_FILE (written at the previous shutdown)
+// if it is younger than LOCATION_SNAPSHOT_FILE_MAX_AGE_MS, else read from
+// the database. Returns true if it came from the database.
+bool WarmUp(const LocationServiceConfig& serviceConfig) {
+    bool fromDatabase = false;
+    const char* path = getenv("LOCATION_SNAPSHOT_FILE");
+    if (serviceConfig.snapshotEnabled) {
+        bool loaded = false;
+        if (path && *path) {
+            try {
+                auto maxAge = chrono::milliseconds(envSize("LOCATION_SNAPSHOT_FILE_MAX_AGE_MS", 3600000));
+                auto age = filesystem::file_time_type::clock::now() - filesystem::last_write_time(path);
+                if (age <= maxAge) {
+                    // Rows may have changed since it was saved, so it only
+                    // answers reads once the refresher's reload at start
+                    // has confirmed or replaced it; until then they go to SQL.
+                    auto snapshot = LocationSnapshot::mapFrom(path, locationService->dataVersion());
+                    locationService->publishSnapshot(std::move(snapshot), false);
+                    loaded = true;
+                    cout << "[Warmup] Loaded snapshot from " << path << " (unconfirmed)" << endl;
+                } else {
+                    cout << "[Warmup] Ignoring stale snapshot file " << path << endl;
+                }
+            } catch (const exception& e) {
+                cerr << "[Warmup] Cannot use snapshot file: " << e.what() << endl;
+            }
         }
-
-        string method = request["method"];
-        auto it = methods_.find(method);
-        if (it == methods_.end()) {
-            throw runtime_error("Method not found");
+        if (!loaded && db_pool->available()) {
+            try {
+                locationService->publishSnapshot(locationService->loadSnapshot());
+                fromDatabase = true;
+                cout << "[Warmup] Loaded snapshot from the database" << endl;
+            } catch (const exception& e) {
+                cerr << "[Warmup] Snapshot load failed: " << e.what() << endl;
+            }
         }
+    }
 
+    stringstream limits(getenv("WARMUP_TOP_LIMITS") ? getenv("WARMUP_TOP_LIMITS") : "10");
+    for (string limit; getline(limits, limit, ',');) {
         try {
-            return it->second(request["params"]);
+            RpcParams params;
+            params.limit = stoi(limit);
+            GetTopLocations(params);
         } catch (const exception& e) {
-            return json{{"success", false}, {"error", e.what()}};
+            cerr << "[Warmup] getTopLocations(" << limit << ") failed: " << e.what() << endl;
         }
     }
-};
-
-// RPC Methods
-json GetTopLocations(const json& params) {
-    int limit = params.value("limit", 10);
-    auto locations = locationService->getTopLocations(limit);
-    json arr = json::array();
-    for (const auto& loc : locations) arr.push_back(locationToJson(loc));
-    return {{"success", true}, {"data", arr}};
-}
-
-json GetLocationById(const json& params) {
-    if (!params.contains("id") || !params["id"].is_string())
-        throw runtime_error("Invalid or missing 'id'");
-    auto loc = locationService->getLocationById(params["id"].get<string>());
-    return {{"success", true}, {"data", locationToJson(loc)}};
+    return fromDatabase;
 }
 
-json SearchLocations(const json& params) {
-    if (!params.contains("query") || !params["query"].is_string())
-        throw runtime_error("Invalid or missing 'query'");
-    auto results = locationService->searchLocations(params["query"].get<string>());
-    json arr = json::array();
-    for (const auto& loc : results) arr.push_back(locationToJson(loc));
-    return {{"success", true}, {"data", arr}};
+// Persists the resident snapshot for the next start's warmup.
+void SaveSnapshot() {
+    const char* path = getenv("LOCATION_SNAPSHOT_FILE");
+    auto snapshot = locationService->currentSnapshot();
+    if (!path || !*path || !snapshot) return;
+    try {
+        snapshot->writeTo(path);
+        cout << "[Snapshot] Saved " << snapshot->size() << " locations to " << path << endl;
+    } catch (const exception& e) {
+        cerr << "[Snapshot] Save failed: " << e.what() << endl;
+    }
 }
 
-int main() {
+// One complete server: pool, caches, background threads and the Crow app.
+// Runs in the process itself, or in each worker when WORKERS > 1; worker 0
+// is the one that saves the snapshot at shutdown.
+int Serve(size_t worker, size_t workers, size_t cpus) {
     try {
-        // Initialize database
-        global_conninfo =           
-            "postgresql://postgres.vxqsqaysrpxliofqxjyu:the-plus-maps-password"
-            "@aws-0-us-east-2.pooler.supabase.com:5432/postgres?sslmode=require";
-        ensureDbConnection();
-
+        // Everything below is created once and lives for the whole process;
+        // reconnecting is the supervisor's job, never a request's.
+        auto serviceConfig = locationServiceConfigFromEnv();
+        size_t httpThreads = max<size_t>(envSize("HTTP_THREADS", cpus), 1);
+        db_pool = make_shared<ConnectionPool>(poolConfigFromEnv(httpThreads));
+        // RPC_ASYNC=0 serves every call on the blocking path.
+        bool async = envSize("RPC_ASYNC", 1) != 0;
+        if (async) {
+            asyncQueries = make_shared<AsyncQueryExecutor>(db_pool, asyncQueryConfigFromEnv());
+        }
+        auto replicaConfig = replicaRouterConfigFromEnv(httpThreads);
+        if (!replicaConfig.replicas.empty()) {
+            if (async) replicaConfig.asyncThreads = asyncQueryConfigFromEnv().threads;
+            replicaRouter = make_shared<ReplicaRouter>(db_pool, replicaConfig);
+        }
+        auto store = make_shared<PgLocationStore>(db_pool, pgStoreConfigFromEnv(), asyncQueries, replicaRouter);
+        locationService = make_unique<LocationService>(store, serviceConfig);
+        rateLimiter = make_unique<RateLimiter>(db_pool, rateLimiterConfigFromEnv(workers));
+        auto compression = compressionConfigFromEnv();
+        responseCache = make_unique<ResponseCache>(serviceConfig.cacheEnabled, serviceConfig.cache, compression);
+        dbSupervisor = make_unique<ConnectionSupervisor>(db_pool, supervisorConfigFromEnv());
+        if (dbSupervisor->start()) {
+            cout << "[DB] Connected to database.\n";
+        } else {
+            cerr << "[DB] Starting without a database; reconnecting in the background" << endl;
+        }
+        if (replicaRouter) {
+            size_t healthy = replicaRouter->start();
+            cout << "[DB] " << healthy << " of " << replicaRouter->size() << " read replicas healthy\n";
+        }
         // Set up RPC methods
-        auto dispatcher = make_shared<PlainRpcDispatcher>();
-        dispatcher->registerMethod("getTopLocations", GetTopLocations);
-        dispatcher->registerMethod("getLocationById", GetLocationById);
-        dispatcher->registerMethod("searchLocations", SearchLocations);
-
-        // Configure Crow with CORS
-        crow::App<crow::CORSHandler> app;
-        
-        // Ultra-strict CORS configuration
-        auto& cors = app.get_middleware<crow::CORSHandler>();
-        cors
-            .global()
-            .headers("Content-Type", "Authorization", "X-Requested-With")
-            .methods("POST"_method, "GET"_method, "OPTIONS"_method)
-            .origin("*")
-            .max_age(86400);
-
-        // Health endpoint
-        CROW_ROUTE(app, "/health")([](){
-            return crow::response(200, "OK");
-        });
-
-        // Main RPC endpoint
-        CROW_ROUTE(app, "/rpc")
-            .methods("POST"_method, "OPTIONS"_method)
-        ([&dispatcher](const crow::request& req){
-            if (req.method == "OPTIONS"_method) {
-                crow::response res(204);
-                res.set_header("Access-Control-Allow-Origin", "*");
-                return res;
-            }
-
-            crow::response res;
-            res.set_header("Content-Type", "application/json");
-            res.set_header("Access-Control-Allow-Origin", "*");
-
-            if (!ensureDbConnection()) {
-                res.code = 503;
-                res.body = json{{"success", false}, {"error", "Database unavailable"}}.dump();
-                return res;
-            }
-
-            json request;
-            try {
-                request = json::parse(req.body);
-            } catch (...) {
-                res.code = 400;
-                res.body = json{{"success", false}, {"error", "Invalid JSON"}}.dump();
-                return res;
-            }
-
-            string userid;
-            if (request["params"].contains("userid") && request["params"]["userid"].is_string()) {
-                userid = request["params"]["userid"].get<string>();
-
-                if (!userid.empty()) {
-                    if (isUserBlocked(db_connection->get(), userid)) {
-                        res.code = 429;
-                        res.body = json{{"success", false}, {"error", "Rate limit exceeded"}}.dump();
-                        return res;
-                    }
-                    logUserRequest(db_connection->get(), userid);
-                    if (isUserBlocked(db_connection->get(), userid)) {
-                        res.code = 429;
-                        res.body = json{{"success", false}, {"error", "Rate limit exceeded"}}.dump();
-                        return res;
-                    }
-                }
-            }
+        ServerContext context;
+        context.pool = db_pool;
+        context.replicas = replicaRouter.get();
+        context.locations = locationService.get();
+        context.responseCache = responseCache.get();
+        context.rateLimiter = rateLimiter.get();
+        context.maxPageSize = envSize("MAX_PAGE_SIZE", 1000);
+        context.compression = compression;
+        context.httpMaxAgeSeconds = static_cast<int>(envSize("HTTP_CACHE_MAX_AGE_S", 30));
+        context.rpcDeadline = chrono::milliseconds(envSize("RPC_DEADLINE_MS", 5000));
+        auto dispatcher = BuildRpcDispatcher(context);
+
+        bool snapshotFromDatabase = envSize("WARMUP", 0) != 0 && WarmUp(serviceConfig);
+        if (serviceConfig.snapshotEnabled) {
+            auto refresherConfig = snapshotRefresherConfigFromEnv();
+            refresherConfig.reloadAtStart = !snapshotFromDatabase;
+            snapshotRefresher = make_unique<SnapshotRefresher>(*locationService, db_pool, refresherConfig);
+        }
 
-            json response = dispatcher->dispatch(request);
-            if (!userid.empty()) logUserResponse(db_connection->get(), userid);
-            res.body = response.dump();
-            return res;
-        });
+        // Configure Crow with CORS and the routes
+        ServerApp app;
+        RegisterRoutes(app, dispatcher);
 
         // Start server
-        cout << "Server running on port 8080\n";
-        app.port(8080).multithreaded().run();
+        cout << "Server running on port 8080 (worker " << worker << ", " << httpThreads << " threads)\n";
+        app.port(8080).concurrency(static_cast<uint16_t>(min<size_t>(httpThreads, UINT16_MAX))).run();
+        if (worker == 0) SaveSnapshot();
 
     } catch (const exception& e) {
         cerr << "Fatal error: " << e.what() << endl;
         return 1;
     }
     return 0;
-}
\ No newline at end of file
+}
+
+int main() {
+    // DATABASE_URL names the primary, which takes every write. Checked
+    // before forking, so a missing setting is not a crash loop of workers.
+    const char* databaseUrl = getenv("DATABASE_URL");
+    if (!databaseUrl || !*databaseUrl) {
+        cerr << "Fatal error: DATABASE_URL is not set" << endl;
+        return 1;
+    }
+    global_conninfo = databaseUrl;
+
+    // WORKERS=N forks N copies of the whole server before any of it starts;
+    // they share port 8080 through SO_REUSEPORT.
+    WorkersConfig workers = workersConfigFromEnv();
+    size_t cpus = CpusPerWorker(workers);
+    if (workers.workers > 1) {
+        return RunWorkers(workers, [&workers, cpus](size_t worker) {
+            crow::detail::reuse_port = true;
+            return Serve(worker, workers.workers, cpus);
+        });
+    }
+    return Serve(0, 1, cpus);
+}
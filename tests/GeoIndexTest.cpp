@@ -0,0 +1,109 @@
+#include "GeoIndex.h"
+#include "Test.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <utility>
+
+using namespace std;
+
+namespace {
+
+Location at(const string& id, double latitude, double longitude) {
+    Location loc;
+    loc.id = id;
+    loc.name = id;
+    loc.rating = 3.0;
+    loc.latitude = latitude;
+    loc.longitude = longitude;
+    return loc;
+}
+
+vector<string> idsOf(const LocationSnapshot& snapshot, const vector<uint32_t>& rows) {
+    vector<string> ids;
+    for (uint32_t row : rows) ids.emplace_back(snapshot.view(row).id);
+    return ids;
+}
+
+// The answer nearest() must give, by a scan over every row.
+vector<string> linearNearest(const vector<Location>& locations, double latitude, double longitude, size_t k,
+                             double maxKm) {
+    vector<pair<double, string>> candidates;
+    for (const Location& loc : locations) {
+        if (isnan(loc.latitude)) continue;
+        double km = GeoIndex::distanceKm(latitude, longitude, loc.latitude, loc.longitude);
+        if (km <= maxKm) candidates.emplace_back(km, loc.id);
+    }
+    sort(candidates.begin(), candidates.end());
+    vector<string> ids;
+    for (size_t i = 0; i < candidates.size() && i < k; i++) ids.push_back(candidates[i].second);
+    return ids;
+}
+
+}
+
+TEST(GeoDistance) {
+    CHECK(GeoIndex::distanceKm(51.5, -0.12, 51.5, -0.12) == 0);
+    // One degree along the equator, and a quarter of a meridian.
+    CHECK(abs(GeoIndex::distanceKm(0, 0, 0, 1) - 111.195) < 0.01);
+    CHECK(abs(GeoIndex::distanceKm(0, 0, 90, 0) - 10007.56) < 0.1);
+    // Across the antimeridian is the short way round.
+    CHECK(abs(GeoIndex::distanceKm(0, 179.5, 0, -179.5) - 111.195) < 0.01);
+    CHECK(GeoIndex::distanceKm(40, 10, -20, 30) == GeoIndex::distanceKm(-20, 30, 40, 10));
+}
+
+TEST(GeoNearestMatchesLinearScan) {
+    mt19937_64 random(7);
+    uniform_real_distribution<double> lat(-89.0, 89.0), lon(-180.0, 180.0);
+    vector<Location> locations;
+    for (int i = 0; i < 2000; i++) locations.push_back(at("p" + to_string(i), lat(random), lon(random)));
+    // A dense cluster, so some cells hold many points.
+    for (int i = 0; i < 300; i++) {
+        locations.push_back(at("c" + to_string(i), 48.85 + lat(random) / 900, 2.35 + lon(random) / 1800));
+    }
+    LocationSnapshot snapshot(locations, 1);
+    GeoIndex index(snapshot);
+    CHECK(index.size() == locations.size());
+
+    const pair<double, double> queries[] = {{48.85, 2.35}, {0, 0}, {89.9, 10}, {-89.9, -170}, {10, 179.99},
+                                            {-35, -179.99}, {60, 90}};
+    for (const auto& [latitude, longitude] : queries) {
+        for (size_t k : {1, 5, 40}) {
+            CHECK(idsOf(snapshot, index.nearest(latitude, longitude, k, INFINITY)) ==
+                  linearNearest(locations, latitude, longitude, k, INFINITY));
+            CHECK(idsOf(snapshot, index.nearest(latitude, longitude, k, 500)) ==
+                  linearNearest(locations, latitude, longitude, k, 500));
+        }
+    }
+}
+
+TEST(GeoNearestWrapsAtTheAntimeridian) {
+    vector<Location> locations = {at("east", 0, 179.9), at("west", 0, -179.8), at("far", 0, 0)};
+    LocationSnapshot snapshot(locations, 1);
+    GeoIndex index(snapshot);
+    CHECK(idsOf(snapshot, index.nearest(0, -179.95, 2, INFINITY)) == (vector<string>{"east", "west"}));
+    CHECK(idsOf(snapshot, index.nearest(0, 179.95, 1, 50)) == vector<string>{"east"});
+}
+
+TEST(GeoNearestSkipsRowsWithoutCoordinates) {
+    vector<Location> locations = {at("here", 10, 10), at("unknown", NoCoordinate, NoCoordinate),
+                                  at("there", 10.5, 10)};
+    LocationSnapshot snapshot(locations, 1);
+    GeoIndex index(snapshot);
+    CHECK(index.size() == 2);
+    CHECK(idsOf(snapshot, index.nearest(10, 10, 10, INFINITY)) == (vector<string>{"here", "there"}));
+}
+
+TEST(GeoNearestEdgeCases) {
+    vector<Location> locations = {at("a", 10, 10), at("b", 20, 20)};
+    LocationSnapshot snapshot(locations, 1);
+    GeoIndex index(snapshot);
+    CHECK(index.nearest(10, 10, 0, INFINITY).empty());
+    CHECK(index.nearest(91, 10, 5, INFINITY).empty());
+    CHECK(index.nearest(10, NAN, 5, INFINITY).empty());
+    CHECK(idsOf(snapshot, index.nearest(10, 10, 5, 0)) == vector<string>{"a"});
+    CHECK(index.nearest(-60, -100, 5, 100).empty());
+
+    LocationSnapshot empty(vector<Location>{}, 1);
+    CHECK(GeoIndex(empty).nearest(0, 0, 5, INFINITY).empty());
+}
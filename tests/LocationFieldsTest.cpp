@@ -0,0 +1,39 @@
+#include "LocationService.h"
+#include "Test.h"
+#include <stdexcept>
+
+using namespace std;
+
+TEST(FieldMaskParseAlwaysKeepsId) {
+    CHECK(LocationFields::parse({}) == LocationFields::Id);
+    CHECK(LocationFields::parse({"id"}) == LocationFields::Id);
+}
+
+TEST(FieldMaskParseCombinesKeys) {
+    using namespace LocationFields;
+    CHECK(parse({"name", "rating"}) == (Id | Name | Rating));
+    CHECK(parse({"rating", "name", "rating"}) == (Id | Name | Rating));
+    CHECK(parse({"country", "state", "description", "svg_link"}) == (Id | Country | State | Description | SvgLink));
+    CHECK(parse({"name", "country", "state", "description", "svg_link", "rating", "latitude"}) == All);
+}
+
+TEST(FieldMaskParseTreatsCoordinatesAsOneField) {
+    using namespace LocationFields;
+    CHECK(parse({"latitude"}) == (Id | Coordinates));
+    CHECK(parse({"longitude"}) == (Id | Coordinates));
+    CHECK(parse({"latitude", "longitude"}) == (Id | Coordinates));
+}
+
+TEST(FieldMaskParseRejectsUnknownKeys) {
+    CHECK_THROWS(LocationFields::parse({"name", "password"}), invalid_argument);
+    CHECK_THROWS(LocationFields::parse({"Name"}), invalid_argument);
+    CHECK_THROWS(LocationFields::parse({""}), invalid_argument);
+}
+
+TEST(FieldMaskColumns) {
+    using namespace LocationFields;
+    CHECK(columns(All) == "*");
+    CHECK(columns(Id | Coordinates) == "*");
+    CHECK(columns(Id) == "id");
+    CHECK(columns(Rating | Name) == "id, name, rating");
+}
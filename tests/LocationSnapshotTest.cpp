@@ -0,0 +1,147 @@
+#include "LocationSnapshot.h"
+#include "Test.h"
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+Location make(const string& id, double rating, const string& country = "Norway", const string& state = "North") {
+    Location loc;
+    loc.id = id;
+    loc.name = "Place " + id;
+    loc.country = country;
+    loc.state = state;
+    loc.description = "About " + id;
+    loc.svg_link = "https://maps.example.com/" + id + ".svg";
+    loc.rating = rating;
+    return loc;
+}
+
+// Rows in byRating order.
+vector<string> rankedIds(const LocationSnapshot& snapshot) {
+    vector<string> ids;
+    for (size_t rank = 0; rank < snapshot.size(); rank++) ids.emplace_back(snapshot.view(snapshot.rankedRow(rank)).id);
+    return ids;
+}
+
+bool sameDouble(double a, double b) { return a == b || (isnan(a) && isnan(b)); }
+
+bool sameView(const LocationView& a, const LocationView& b) {
+    return a.id == b.id && a.name == b.name && a.country == b.country && a.state == b.state &&
+           a.description == b.description && a.svg_link == b.svg_link && sameDouble(a.rating, b.rating) &&
+           sameDouble(a.latitude, b.latitude) && sameDouble(a.longitude, b.longitude);
+}
+
+// A path under the temp directory, removed with the object.
+struct TempPath {
+    string path = (getenv("TMPDIR") ? string(getenv("TMPDIR")) : string("/tmp")) + "/crow_tests_snapshot_" +
+                  to_string(getpid()) + ".bin";
+    ~TempPath() { remove(path.c_str()); }
+};
+
+}
+
+TEST(SnapshotRanksByRatingThenId) {
+    LocationSnapshot snapshot(vector<Location>{make("c", 4), make("a", 5), make("d", 3), make("b", 4)}, 1);
+    CHECK(rankedIds(snapshot) == (vector<string>{"a", "b", "c", "d"}));
+    CHECK(snapshot.top(2).size() == 2);
+    CHECK(snapshot.top(10).size() == 4);
+    CHECK(snapshot.view(snapshot.top(1)[0]).id == "a");
+}
+
+TEST(SnapshotRankAfter) {
+    LocationSnapshot snapshot(vector<Location>{make("c", 4), make("a", 5), make("d", 3), make("b", 4)}, 1);
+    // Keyset continuation from each row is the next rank.
+    for (size_t rank = 0; rank < snapshot.size(); rank++) {
+        uint32_t row = snapshot.rankedRow(rank);
+        CHECK(snapshot.rankAfter(snapshot.rating(row), snapshot.view(row).id) == rank + 1);
+    }
+    CHECK(snapshot.rankAfter(10, "") == 0);
+    CHECK(snapshot.rankAfter(5, "") == 0);
+    CHECK(snapshot.rankAfter(4, "a") == 1);    // before both 4s
+    CHECK(snapshot.rankAfter(4, "bb") == 2);   // between b and c
+    CHECK(snapshot.rankAfter(4, "z") == 3);    // after both 4s
+    CHECK(snapshot.rankAfter(4.5, "") == 1);   // a rating no row has
+    CHECK(snapshot.rankAfter(0, "") == 4);
+    CHECK(snapshot.rankAfter(-1, "zzz") == 4);
+
+    LocationSnapshot empty(vector<Location>{}, 1);
+    CHECK(empty.rankAfter(5, "a") == 0);
+}
+
+TEST(SnapshotRanksNanRatingsLast) {
+    LocationSnapshot snapshot(vector<Location>{make("n2", NAN), make("b", 1), make("n1", NAN), make("a", 5)}, 1);
+    CHECK(rankedIds(snapshot) == (vector<string>{"a", "b", "n1", "n2"}));
+    CHECK(snapshot.rankAfter(1, "b") == 2);
+    CHECK(snapshot.rankAfter(0, "") == 2);
+    CHECK(snapshot.rankAfter(NAN, "n1") == 3);
+    CHECK(snapshot.rankAfter(NAN, "") == 2);
+}
+
+TEST(SnapshotFindAndUpdate) {
+    LocationSnapshot base(vector<Location>{make("a", 5), make("b", 4), make("c", 3)}, 1);
+    CHECK(base.find("b").has_value());
+    CHECK(!base.find("x").has_value());
+
+    LocationSnapshot updated(base, {make("b", 1), make("x", 4.5)}, {"a"}, 2);
+    CHECK(rankedIds(updated) == (vector<string>{"x", "c", "b"}));
+    CHECK(!updated.find("a").has_value());
+    CHECK(updated.rating(*updated.find("b")) == 1);
+    CHECK(updated.dataVersion() == 2);
+    // base is untouched.
+    CHECK(rankedIds(base) == (vector<string>{"a", "b", "c"}));
+}
+
+TEST(SnapshotFileRoundTrip) {
+    vector<Location> locations = {make("a", 5, "France", "Central"), make("b", 4.25), make("c", 4.25, "Japan", ""),
+                                  make("d", 0)};
+    locations[0].latitude = 48.8566;
+    locations[0].longitude = 2.3522;
+    locations[1].latitude = -33.9;
+    locations[1].longitude = 151.2;
+    locations[2].name = "K\xC5\x8Dy\xC5\x8D \"quoted\"\n";
+    locations[3].description = "";
+    LocationSnapshot original(locations, 3);
+
+    TempPath file;
+    original.writeTo(file.path);
+    auto mapped = LocationSnapshot::mapFrom(file.path, 9);
+    CHECK(mapped->dataVersion() == 9);
+    CHECK(mapped->size() == original.size());
+    for (uint32_t row = 0; row < original.size(); row++) {
+        CHECK(sameView(mapped->view(row), original.view(row)));
+        CHECK(mapped->rankedRow(row) == original.rankedRow(row));
+    }
+    for (const Location& loc : locations) {
+        auto row = mapped->find(loc.id);
+        CHECK(row.has_value() && sameView(mapped->view(*row), LocationView::of(loc)));
+    }
+    CHECK(!mapped->find("missing").has_value());
+    CHECK(mapped->rankAfter(4.25, "b") == original.rankAfter(4.25, "b"));
+}
+
+TEST(SnapshotFileRejectsBadFiles) {
+    TempPath file;
+    CHECK_THROWS(LocationSnapshot::mapFrom(file.path, 1), runtime_error);
+
+    {
+        ofstream out(file.path, ios::binary);
+        out << "definitely not a snapshot file, but long enough to hold a header";
+    }
+    CHECK_THROWS(LocationSnapshot::mapFrom(file.path, 1), runtime_error);
+
+    LocationSnapshot(vector<Location>{make("a", 5), make("b", 4)}, 1).writeTo(file.path);
+    ifstream in(file.path, ios::binary);
+    string bytes((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    in.close();
+    {
+        ofstream out(file.path, ios::binary | ios::trunc);
+        out.write(bytes.data(), static_cast<streamsize>(bytes.size() / 2));
+    }
+    CHECK_THROWS(LocationSnapshot::mapFrom(file.path, 1), runtime_error);
+}
@@ -0,0 +1,39 @@
+#include "RpcRequest.h"
+#include "Test.h"
+
+using namespace std;
+
+TEST(RpcParamsFromJsonReadsEveryParam) {
+    RpcParams p = RpcParams::fromJson(json::parse(
+        R"({"userid":"u","limit":5,"ids":["a","b"],"fields":["name"],"latitude":1.5,"longitude":-2,)"
+        R"("radius_km":10,"after_rating":4.5,"after_id":"x"})"));
+    CHECK(p.userid == "u");
+    CHECK(p.limit == 5);
+    CHECK(p.ids == (vector<string>{"a", "b"}));
+    CHECK(p.fields == vector<string>{"name"});
+    CHECK(p.latitude == 1.5 && p.longitude == -2.0 && p.radiusKm == 10.0);
+    CHECK(p.afterRating == 4.5 && p.afterId == "x");
+}
+
+TEST(RpcParamsFromJsonSkipsOnlyMalformedArrays) {
+    RpcParams p = RpcParams::fromJson(json::parse(
+        R"({"ids":["a",1],"fields":["name",{}],"latitude":1.5,"radius_km":3,"after_rating":2,"after_id":"x"})"));
+    CHECK(!p.ids);
+    CHECK(!p.fields);
+    CHECK(p.latitude == 1.5);
+    CHECK(p.radiusKm == 3.0);
+    CHECK(p.afterRating == 2.0 && p.afterId == "x");
+}
+
+TEST(ParseRpcRequestMatchesFromJson) {
+    const char* body = R"({"method":"getLocationsByIds","params":{"ids":["a","b"],"userid":"u"}})";
+    RpcRequest request;
+    CHECK(parseRpcRequest(body, request));
+    CHECK(request.method == "getLocationsByIds");
+    RpcParams slow = RpcParams::fromJson(json::parse(body)["params"]);
+    CHECK(request.params.ids == slow.ids);
+    CHECK(request.params.userid == slow.userid);
+
+    CHECK(!parseRpcRequest(R"({"method":"getLocationsByIds","params":{"ids":["a",1]}})", request));
+    CHECK(!parseRpcRequest("not json", request));
+}
@@ -0,0 +1,48 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <string>
+#include <vector>
+
+// crow_tests: a small self-registering test runner, so the unit tests need
+// nothing beyond the core library. TEST(Name) { ... } defines a case;
+// CHECK(cond) records a failure and carries on, so one run reports every
+// broken expectation of a case.
+
+struct TestCase {
+    const char* name;
+    void (*run)();
+};
+
+std::vector<TestCase>& TestCases();
+
+struct TestRegistration {
+    TestRegistration(const char* name, void (*run)()) { TestCases().push_back({name, run}); }
+};
+
+void RecordFailure(const char* file, int line, const std::string& what);
+
+#define TEST(name)                                                   \
+    static void name();                                              \
+    static TestRegistration name##Registration(#name, name);         \
+    static void name()
+
+#define CHECK(cond)                                                  \
+    do {                                                             \
+        if (!(cond)) RecordFailure(__FILE__, __LINE__, #cond);       \
+    } while (0)
+
+// Passes if `expr` throws `Exception` (or a type derived from it).
+#define CHECK_THROWS(expr, Exception)                                                            \
+    do {                                                                                         \
+        bool thrown = false;                                                                     \
+        try {                                                                                    \
+            (void)(expr);                                                                        \
+        } catch (const Exception&) {                                                             \
+            thrown = true;                                                                       \
+        } catch (...) {                                                                          \
+        }                                                                                        \
+        if (!thrown) RecordFailure(__FILE__, __LINE__, #expr " throws " #Exception);             \
+    } while (0)
+
+#endif
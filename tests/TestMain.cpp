@@ -0,0 +1,44 @@
+#include "Test.h"
+#include <exception>
+#include <iostream>
+
+using namespace std;
+
+namespace {
+
+size_t failures = 0;
+
+}
+
+vector<TestCase>& TestCases() {
+    static vector<TestCase> cases;
+    return cases;
+}
+
+void RecordFailure(const char* file, int line, const string& what) {
+    failures++;
+    cerr << file << ":" << line << ": check failed: " << what << endl;
+}
+
+// Runs every registered case, or only those named on the command line.
+int main(int argc, char** argv) {
+    size_t ran = 0, failed = 0;
+    for (const TestCase& test : TestCases()) {
+        if (argc > 1) {
+            bool wanted = false;
+            for (int i = 1; i < argc; i++) wanted = wanted || argv[i] == string(test.name);
+            if (!wanted) continue;
+        }
+        size_t before = failures;
+        try {
+            test.run();
+        } catch (const exception& e) {
+            RecordFailure(test.name, 0, string("unexpected exception: ") + e.what());
+        }
+        ran++;
+        if (failures != before) failed++;
+        cout << (failures == before ? "[ ok ] " : "[FAIL] ") << test.name << endl;
+    }
+    cout << ran - failed << "/" << ran << " tests passed" << endl;
+    return failed == 0 && ran > 0 ? 0 : 1;
+}